@@ -1,108 +1,301 @@
 #pragma once
 
+#include <algorithm>
 #include <chrono>
 #include <cstdint>
 #include <fstream>
 #include <iostream>
 #include <random>
+#include <type_traits>
 #include <sstream>
+#include <string>
 #include <utility>
 #include <vector>
 
+#include <benchmark/construction_profile.hpp>
+#include <benchmark/perf_counter.hpp>
+#include <benchmark/report.hpp>
 #include <blocktree/blocktree.hpp>
+#include <blocktree/native_block_tree.hpp>
+#include <compressed_blocks/compressed_blocks.hpp>
 #include <concepts.hpp>
 #include <file_access/file_access.hpp>
 #include <grammar/grammar.hpp>
 #include <grammar/sampled_scan_query_grammar.hpp>
 #include <lzend/lzend.hpp>
+#include <util/memory_policy.hpp>
 
 #include <compute_lzend.hpp>
 #include <malloc_count.h>
 
 namespace gracli {
 
+/**
+ * @brief The memory currently in use by the heap and by allocations mapped according to the memory policy.
+ */
+inline auto memory_in_use() -> size_t { return malloc_count_current() + MemoryPolicy::mapped_bytes(); }
+
+/**
+ * @brief Writes the current memory policy as key=value pairs for use in a RESULT line.
+ */
+inline void write_memory_policy_fields(std::ostream &out) {
+    const MemoryPolicy &policy = MemoryPolicy::global();
+    out << " huge_pages=" << policy.huge_pages_name() << " numa=" << policy.numa_name();
+}
+
+/**
+ * @brief Options for building data structures which are not part of their type.
+ */
+struct BuildOptions {
+    /**
+     * @brief The maximum number of jumps per access in LzEnd (see `BasicLzEnd::bound_hops`) or 0 for no bound
+     */
+    size_t lzend_max_hops = 0;
+    /**
+     * @brief The size of the LzEnd cache in KiB (see `BasicLzEnd::enable_cache`) or 0 for no cache
+     */
+    size_t lzend_cache_kib = 0;
+    /**
+     * @brief The shape of block trees built by gracli. Saved block trees keep the shape they were built with.
+     */
+    bt::BlockTreeParams blocktree;
+    /**
+     * @brief How the file on disk is read
+     */
+    FileAccessOptions file_access;
+    /**
+     * @brief The number of characters per block of compressed blocks. Saved compressed blocks keep their block size.
+     */
+    size_t cb_block_size = cb::CompressedBlocks::DEFAULT_BLOCK_SIZE;
+    /**
+     * @brief The number of decoded blocks cached by compressed blocks (see `CompressedBlocks::enable_cache`) or 0 for
+     * no cache
+     */
+    size_t cb_cache_blocks = 0;
+
+    /**
+     * @brief Returns the suffix of the name of an LzEnd data structure built with these options.
+     */
+    [[nodiscard]] auto lzend_suffix() const -> std::string {
+        std::string suffix;
+        if (lzend_max_hops > 0) {
+            suffix += "_hops" + std::to_string(lzend_max_hops);
+        }
+        if (lzend_cache_kib > 0) {
+            suffix += "_cache" + std::to_string(lzend_cache_kib) + "k";
+        }
+        return suffix;
+    }
+
+    /**
+     * @brief Returns the suffix of the name of a block tree built by gracli with these options.
+     */
+    [[nodiscard]] auto blocktree_suffix() const -> std::string {
+        std::string suffix = "_a" + std::to_string(blocktree.arity) + "_r" + std::to_string(blocktree.root_arity) +
+                             "_l" + std::to_string(blocktree.leaf_length);
+        if (blocktree.prefix_suffix > 0) {
+            suffix += "_ps" + std::to_string(blocktree.prefix_suffix);
+        }
+        return suffix;
+    }
+
+    /**
+     * @brief Returns the suffix of the name of compressed blocks built with these options.
+     */
+    [[nodiscard]] auto compressed_blocks_suffix() const -> std::string {
+        std::string suffix = "_b" + std::to_string(cb_block_size);
+        if (cb_cache_blocks > 0) {
+            suffix += "_cache" + std::to_string(cb_cache_blocks);
+        }
+        return suffix;
+    }
+
+    /**
+     * @brief Returns the suffix of the name of the file on disk read with these options. It is empty for the default
+     * of one pread per query without advice.
+     */
+    [[nodiscard]] auto file_access_suffix() const -> std::string {
+        std::string suffix;
+        if (file_access.mode != FileAccessMode::Pread) {
+            suffix += "_" + file_access.mode_name();
+        }
+        if (file_access.mode == FileAccessMode::Direct) {
+            if (file_access.direct_cache_kib > 0) {
+                suffix += "_cache" + std::to_string(file_access.direct_cache_kib) + "k";
+            }
+        } else if (file_access.advice != FileAdvice::Normal) {
+            suffix += "_" + file_access.advice_name();
+        }
+        return suffix;
+    }
+
+    /**
+     * @brief The process-wide options used by `build_random_access`.
+     */
+    static auto global() -> BuildOptions & {
+        static BuildOptions options;
+        return options;
+    }
+};
+
+/**
+ * @brief Returns the counters of the data structure's cache, if it has one.
+ */
+template<typename DS>
+auto cache_counters(const DS &ds) -> CacheCounters {
+    if constexpr (requires { ds.cache(); }) {
+        if (const auto *cache = ds.cache()) {
+            return {(int64_t) cache->size_in_bytes(), (int64_t) cache->hits(), (int64_t) cache->misses(),
+                    cache->hit_rate()};
+        }
+    }
+    return {};
+}
+
+/**
+ * @brief Resets the hit and miss counters of the data structure's cache, if it has one.
+ */
+template<typename DS>
+void reset_cache_counters(DS &ds) {
+    if constexpr (requires { ds.cache(); }) {
+        if (auto *cache = ds.cache()) {
+            cache->reset_counters();
+        }
+    }
+}
+
+/**
+ * @brief Writes the counters of the data structure's cache as key=value pairs for use in a RESULT line, if it has one.
+ */
+template<typename DS>
+void write_cache_fields(std::ostream &out, const DS &ds) {
+    const CacheCounters counters = cache_counters(ds);
+    if (counters.bytes >= 0) {
+        out << " cache_bytes=" << counters.bytes << " cache_hits=" << counters.hits
+            << " cache_misses=" << counters.misses << " cache_hit_rate=" << counters.hit_rate;
+    }
+}
+
 template<typename DS>
 struct QueryDSResult {
-    DS      ds;
-    size_t  source_length;
-    size_t  constr_time;
-    int64_t space;
+    DS                  ds;
+    size_t              source_length;
+    size_t              constr_time;
+    int64_t             space;
+    ConstructionProfile profile;
 
-    QueryDSResult(DS &&ds, size_t source_length, size_t constr_time, int64_t space) :
+    QueryDSResult(DS &&ds, size_t source_length, size_t constr_time, int64_t space, ConstructionProfile &&profile) :
         ds{std::move(ds)},
         source_length{source_length},
         constr_time{constr_time},
-        space{space} {}
+        space{space},
+        profile{std::move(profile)} {}
 };
 
 template<typename Grm>
 auto build_random_access(const std::string &file) -> QueryDSResult<Grm> {
     using TimePoint = std::chrono::steady_clock::time_point;
 
+    ConstructionProfile profile;
+
     TimePoint begin       = std::chrono::steady_clock::now();
-    size_t    space_begin = malloc_count_current();
+    size_t    space_begin = memory_in_use();
 
+    // Decoding is part of the construction, so the time and space include it like the profile does
+    profile.phase("decode");
     Grammar gr = Grammar::from_file(file);
 
-    begin       = std::chrono::steady_clock::now();
-    space_begin = malloc_count_current();
-
-    Grm qgr(std::move(gr));
+    Grm qgr(std::move(gr), profile);
+    profile.finish();
 
     auto source_length = qgr.source_length();
 
     TimePoint end       = std::chrono::steady_clock::now();
-    size_t    space_end = malloc_count_current();
+    size_t    space_end = memory_in_use();
 
     size_t  constr_time = std::chrono::duration_cast<std::chrono::milliseconds>(end - begin).count();
     int64_t space       = (int64_t) space_end - (int64_t) space_begin;
 
-    return {std::move(qgr), source_length, constr_time, space};
+    return {std::move(qgr), source_length, constr_time, space, std::move(profile)};
 }
 
 template<>
 auto build_random_access<std::string>(const std::string &file) -> QueryDSResult<std::string> {
     using TimePoint = std::chrono::steady_clock::time_point;
 
+    ConstructionProfile profile;
+
     TimePoint   begin       = std::chrono::steady_clock::now();
-    size_t      space_begin = malloc_count_current();
+    size_t      space_begin = memory_in_use();
     std::string source;
+    profile.phase("read");
     {
         std::ifstream     ifs(file);
         std::stringstream ss;
         ss << ifs.rdbuf();
         source = ss.str();
     }
+    profile.finish();
     TimePoint end           = std::chrono::steady_clock::now();
-    size_t    space_end     = malloc_count_current();
+    size_t    space_end     = memory_in_use();
     auto      source_length = source.length();
 
     size_t  constr_time = std::chrono::duration_cast<std::chrono::milliseconds>(end - begin).count();
     int64_t space_delta = (int64_t) space_end - (int64_t) space_begin;
 
-    return {std::move(source), source_length, constr_time, space_delta};
+    return {std::move(source), source_length, constr_time, space_delta, std::move(profile)};
 }
 
-template<>
-auto build_random_access<lz::LzEnd>(const std::string &file) -> QueryDSResult<lz::LzEnd> {
+/**
+ * @brief Builds an LzEnd data structure with the given phrase locator from a parsing, or loads it if the file is a
+ * serialized index.
+ */
+template<typename LzEndDS>
+auto build_lzend(const std::string &file) -> QueryDSResult<LzEndDS> {
     using TimePoint = std::chrono::steady_clock::time_point;
     using namespace lz;
 
-    // Decoding
-    size_t    space_begin      = malloc_count_current();
-    TimePoint begin            = std::chrono::steady_clock::now();
-    auto [parsing, input_size] = decode(file);
+    ConstructionProfile profile;
 
-    // Construct DS
-    lz::LzEnd lz_end = lz::LzEnd::from_parsing(std::move(parsing), input_size);
-    TimePoint end    = std::chrono::steady_clock::now();
+    // Decoding
+    size_t    space_begin = memory_in_use();
+    TimePoint begin       = std::chrono::steady_clock::now();
+    LzEndDS lz_end = [&] {
+        if (LzEndDS::is_index_file(file)) {
+            // A serialized index needs no construction
+            profile.phase("load");
+            return LzEndDS::load(file);
+        }
+        profile.phase("decode");
+        return with_decoded(file, [&](auto &&parsing, const size_t input_size) {
+            // Construct DS
+            return LzEndDS::from_parsing(std::move(parsing), input_size, profile);
+        });
+    }();
+    if (const size_t max_hops = BuildOptions::global().lzend_max_hops; max_hops > 0) {
+        profile.phase("bound_hops");
+        lz_end.bound_hops(max_hops);
+    }
+    lz_end.enable_cache(BuildOptions::global().lzend_cache_kib << 10);
+    profile.finish();
+    TimePoint end = std::chrono::steady_clock::now();
 
-    size_t  space_end   = malloc_count_current();
+    size_t  space_end   = memory_in_use();
     size_t  constr_time = std::chrono::duration_cast<std::chrono::milliseconds>(end - begin).count();
     int64_t space       = (int64_t) space_end - (int64_t) space_begin;
 
     size_t source_length = lz_end.source_length();
-    return {std::move(lz_end), source_length, constr_time, space};
+    return {std::move(lz_end), source_length, constr_time, space, std::move(profile)};
+}
+
+template<>
+auto build_random_access<lz::LzEnd>(const std::string &file) -> QueryDSResult<lz::LzEnd> {
+    return build_lzend<lz::LzEnd>(file);
+}
+
+template<>
+auto build_random_access<lz::SampledLzEnd>(const std::string &file) -> QueryDSResult<lz::SampledLzEnd> {
+    return build_lzend<lz::SampledLzEnd>(file);
 }
 
 template<>
@@ -110,17 +303,21 @@ auto build_random_access<FileAccess>(const std::string &file) -> QueryDSResult<F
     using namespace lz;
     using TimePoint = std::chrono::steady_clock::time_point;
 
+    ConstructionProfile profile;
+
     // Decoding
-    size_t    space_begin = malloc_count_current();
+    size_t    space_begin = memory_in_use();
     TimePoint begin       = std::chrono::steady_clock::now();
-    auto      file_access = FileAccess::from_file(file);
-    TimePoint end         = std::chrono::steady_clock::now();
-    size_t    space_end   = malloc_count_current();
+    profile.phase("open");
+    auto file_access = FileAccess::from_file(file, BuildOptions::global().file_access);
+    profile.finish();
+    TimePoint end = std::chrono::steady_clock::now();
+    size_t    space_end   = memory_in_use();
     size_t    time        = std::chrono::duration_cast<std::chrono::milliseconds>(end - begin).count();
     int64_t   space_delta = (int64_t) space_end - (int64_t) space_begin;
 
     const size_t source_length = file_access.source_length();
-    return {std::move(file_access), source_length, time, space_delta};
+    return {std::move(file_access), source_length, time, space_delta, std::move(profile)};
 }
 
 template<>
@@ -128,17 +325,63 @@ auto build_random_access<BlockTreeRandomAccess>(const std::string &file) -> Quer
     using namespace lz;
     using TimePoint = std::chrono::steady_clock::time_point;
 
+    ConstructionProfile profile;
+
     // Decoding
-    size_t    space_begin = malloc_count_current();
+    size_t    space_begin = memory_in_use();
+    TimePoint begin       = std::chrono::steady_clock::now();
+    profile.phase("load");
+    auto bt = BlockTreeRandomAccess::from_file(file);
+    profile.finish();
+    TimePoint end = std::chrono::steady_clock::now();
+    size_t    space_end   = memory_in_use();
+    size_t    time        = std::chrono::duration_cast<std::chrono::milliseconds>(end - begin).count();
+    int64_t   space_delta = (int64_t) space_end - (int64_t) space_begin;
+
+    const size_t source_length = bt.source_length();
+    return {std::move(bt), source_length, time, space_delta, std::move(profile)};
+}
+
+template<>
+auto build_random_access<bt::BlockTree>(const std::string &file) -> QueryDSResult<bt::BlockTree> {
+    using TimePoint = std::chrono::steady_clock::time_point;
+
+    ConstructionProfile profile;
+
+    size_t    space_begin = memory_in_use();
     TimePoint begin       = std::chrono::steady_clock::now();
-    auto      bt          = BlockTreeRandomAccess::from_file(file);
-    TimePoint end         = std::chrono::steady_clock::now();
-    size_t    space_end   = malloc_count_current();
+    auto      bt          = bt::BlockTree::from_file(file, BuildOptions::global().blocktree, profile);
+    profile.finish();
+    TimePoint end = std::chrono::steady_clock::now();
+    size_t    space_end   = memory_in_use();
     size_t    time        = std::chrono::duration_cast<std::chrono::milliseconds>(end - begin).count();
     int64_t   space_delta = (int64_t) space_end - (int64_t) space_begin;
 
+    // A saved block tree is mapped instead of read into the heap, so its file is counted as the space it needs
+    space_delta += (int64_t) bt.mapped_bytes();
+
     const size_t source_length = bt.source_length();
-    return {std::move(bt), source_length, time, space_delta};
+    return {std::move(bt), source_length, time, space_delta, std::move(profile)};
+}
+
+template<>
+auto build_random_access<cb::CompressedBlocks>(const std::string &file) -> QueryDSResult<cb::CompressedBlocks> {
+    using TimePoint = std::chrono::steady_clock::time_point;
+
+    ConstructionProfile profile;
+
+    size_t    space_begin = memory_in_use();
+    TimePoint begin       = std::chrono::steady_clock::now();
+    auto      cb          = cb::CompressedBlocks::from_file(file, BuildOptions::global().cb_block_size, profile);
+    cb.enable_cache(BuildOptions::global().cb_cache_blocks);
+    profile.finish();
+    TimePoint end = std::chrono::steady_clock::now();
+    size_t    space_end   = memory_in_use();
+    size_t    time        = std::chrono::duration_cast<std::chrono::milliseconds>(end - begin).count();
+    int64_t   space_delta = (int64_t) space_end - (int64_t) space_begin;
+
+    const size_t source_length = cb.source_length();
+    return {std::move(cb), source_length, time, space_delta, std::move(profile)};
 }
 
 template<CharRandomAccess Grm>
@@ -154,11 +397,14 @@ void benchmark_random_access(QueryDSResult<Grm> &&data,
 
     size_t c = 0;
 
+    PerfCounter dtlb = PerfCounter::dtlb_load_misses();
+    dtlb.start();
     auto begin = std::chrono::steady_clock::now();
     for (size_t i = 0; i < num_queries; i++) {
         c += qgr.at(rand_int(gen));
     }
     auto end              = std::chrono::steady_clock::now();
+    auto dtlb_misses      = dtlb.stop();
     auto query_time_total = std::chrono::duration_cast<std::chrono::milliseconds>(end - begin).count();
 
     // so the calls are hopefully not optimized away
@@ -178,7 +424,11 @@ void benchmark_random_access(QueryDSResult<Grm> &&data,
               << " type=random_access"
               << " ds=" << name << " input_file=" << file_name << " input_size=" << data.source_length
               << " num_queries=" << num_queries << " space=" << data.space << " construction_time=" << data.constr_time
-              << " query_time_total=" << query_time_total << std::endl;
+              << " query_time_total=" << query_time_total;
+    data.profile.write_result_fields(std::cout);
+    write_memory_policy_fields(std::cout);
+    write_cache_fields(std::cout, qgr);
+    std::cout << " dtlb_load_misses=" << dtlb_misses << std::endl;
 }
 
 template<CharRandomAccess Grm>
@@ -202,6 +452,8 @@ void benchmark_substring(QueryDSResult<Grm> &&data,
 
     char buf[length];
 
+    PerfCounter dtlb = PerfCounter::dtlb_load_misses();
+    dtlb.start();
     std::chrono::steady_clock::time_point begin = std::chrono::steady_clock::now();
     size_t                                c     = 0;
     for (size_t i = 0; i < num_queries; i++) {
@@ -209,6 +461,7 @@ void benchmark_substring(QueryDSResult<Grm> &&data,
         c += buf[0];
     }
     std::chrono::steady_clock::time_point end = std::chrono::steady_clock::now();
+    auto dtlb_misses                          = dtlb.stop();
     auto query_time_total = std::chrono::duration_cast<std::chrono::milliseconds>(end - begin).count();
     // so the calls are hopefully not optimized away
     if (c < 1) {
@@ -227,7 +480,11 @@ void benchmark_substring(QueryDSResult<Grm> &&data,
               << " type=substring"
               << " ds=" << name << " input_file=" << file_name << " input_size=" << data.source_length
               << " num_queries=" << num_queries << " substring_length=" << length << " space=" << data.space
-              << " construction_time=" << data.constr_time << " query_time_total=" << query_time_total << std::endl;
+              << " construction_time=" << data.constr_time << " query_time_total=" << query_time_total;
+    data.profile.write_result_fields(std::cout);
+    write_memory_policy_fields(std::cout);
+    write_cache_fields(std::cout, qgr);
+    std::cout << " dtlb_load_misses=" << dtlb_misses << std::endl;
 }
 
 void benchmark_substring(QueryDSResult<std::string> &&data,
@@ -243,6 +500,8 @@ void benchmark_substring(QueryDSResult<std::string> &&data,
 
     char buf[length];
 
+    PerfCounter dtlb = PerfCounter::dtlb_load_misses();
+    dtlb.start();
     std::chrono::steady_clock::time_point begin = std::chrono::steady_clock::now();
     size_t                                c     = 0;
     for (size_t i = 0; i < num_queries; i++) {
@@ -253,6 +512,7 @@ void benchmark_substring(QueryDSResult<std::string> &&data,
     }
 
     std::chrono::steady_clock::time_point end = std::chrono::steady_clock::now();
+    auto dtlb_misses                          = dtlb.stop();
     auto query_time_total = std::chrono::duration_cast<std::chrono::milliseconds>(end - begin).count();
     // so the calls are hopefully not optimized away
     if (c < 1) {
@@ -271,7 +531,169 @@ void benchmark_substring(QueryDSResult<std::string> &&data,
               << " type=substring"
               << " ds=" << name << " input_file=" << file_name << " input_size=" << data.source_length
               << " num_queries=" << num_queries << " substring_length=" << length << " space=" << data.space
-              << " construction_time=" << data.constr_time << " query_time_total=" << query_time_total << std::endl;
+              << " construction_time=" << data.constr_time << " query_time_total=" << query_time_total;
+    data.profile.write_result_fields(std::cout);
+    write_memory_policy_fields(std::cout);
+    std::cout << " dtlb_load_misses=" << dtlb_misses << std::endl;
+}
+
+/**
+ * @brief Returns the length of the longest common prefix of the suffixes of the string starting at i and j. This is the
+ * uncompressed baseline of `LongestCommonExtension` data structures.
+ */
+inline auto lce(const std::string &s, const size_t i, const size_t j) -> size_t {
+    if (std::max(i, j) >= s.length()) {
+        return 0;
+    }
+    const auto mismatch = std::mismatch(s.begin() + i, s.end(), s.begin() + j, s.end());
+    return mismatch.first - (s.begin() + i);
+}
+
+/**
+ * @brief Benchmarks longest common extension queries of uniformly random pairs of positions. Besides the time, the
+ * mean extension length is reported, since random pairs in texts which are not repetitive mostly differ right away.
+ */
+template<typename DS>
+void benchmark_lce(QueryDSResult<DS> &&data, const std::string &file, size_t num_queries, const std::string &name) {
+    std::random_device                    rd;
+    std::mt19937                          gen(rd());
+    std::uniform_int_distribution<size_t> rand_int(0, data.source_length - 1);
+
+    DS &ds = data.ds;
+
+    std::vector<std::pair<size_t, size_t>> pairs(num_queries);
+    std::generate(pairs.begin(), pairs.end(), [&] { return std::pair{rand_int(gen), rand_int(gen)}; });
+
+    PerfCounter dtlb = PerfCounter::dtlb_load_misses();
+    dtlb.start();
+    std::chrono::steady_clock::time_point begin = std::chrono::steady_clock::now();
+    size_t                                total = 0;
+    for (const auto &[i, j] : pairs) {
+        if constexpr (std::is_same_v<DS, std::string>) {
+            total += lce(ds, i, j);
+        } else {
+            total += ds.lce(i, j);
+        }
+    }
+    std::chrono::steady_clock::time_point end = std::chrono::steady_clock::now();
+    auto dtlb_misses                          = dtlb.stop();
+    auto query_time_total = std::chrono::duration_cast<std::chrono::milliseconds>(end - begin).count();
+
+    std::string file_name;
+    auto        last = file.find_last_of('/');
+    if (last < std::string::npos) {
+        file_name = file.substr(last + 1);
+    } else {
+        file_name = file;
+    }
+
+    std::cout << "RESULT"
+              << " type=lce"
+              << " ds=" << name << " input_file=" << file_name << " input_size=" << data.source_length
+              << " num_queries=" << num_queries << " lce_mean=" << (double) total / std::max(num_queries, (size_t) 1)
+              << " space=" << data.space << " construction_time=" << data.constr_time
+              << " query_time_total=" << query_time_total;
+    data.profile.write_result_fields(std::cout);
+    write_memory_policy_fields(std::cout);
+    write_cache_fields(std::cout, ds);
+    std::cout << " dtlb_load_misses=" << dtlb_misses << std::endl;
+}
+
+template<typename DS>
+    requires LongestCommonExtension<DS> || std::is_same_v<DS, std::string>
+void benchmark_lce(const std::string &file, size_t num_queries, const std::string &name) {
+    QueryDSResult<DS> result = build_random_access<DS>(file);
+    benchmark_lce<DS>(std::move(result), file, num_queries, name);
+}
+
+/**
+ * @brief Benchmarks rank and select queries of characters drawn uniformly from the supported alphabet. The memory and
+ * time needed to build the support for them are measured like `space` and `construction_time` and reported as
+ * `rank_select_space` and `rank_select_construction_time`.
+ *
+ * @param alphabet The characters to support or an empty vector for all characters of the text
+ */
+template<CharRankSelect DS>
+void benchmark_rank_select(const std::string          &file,
+                           size_t                      num_queries,
+                           const std::vector<uint8_t> &alphabet,
+                           const std::string          &name) {
+    using TimePoint = std::chrono::steady_clock::time_point;
+
+    QueryDSResult<DS> data = build_random_access<DS>(file);
+    DS               &ds   = data.ds;
+
+    size_t    space_begin = memory_in_use();
+    TimePoint begin       = std::chrono::steady_clock::now();
+    ds.enable_rank_select(alphabet);
+    TimePoint end       = std::chrono::steady_clock::now();
+    size_t    space_end = memory_in_use();
+
+    size_t  rank_select_time  = std::chrono::duration_cast<std::chrono::milliseconds>(end - begin).count();
+    int64_t rank_select_space = (int64_t) space_end - (int64_t) space_begin;
+
+    const std::vector<uint8_t> &supported = ds.rank_alphabet();
+    if (supported.empty()) {
+        std::cerr << "No characters to benchmark rank and select with" << std::endl;
+        return;
+    }
+
+    std::random_device                    rd;
+    std::mt19937                          gen(rd());
+    std::uniform_int_distribution<size_t> rand_char(0, supported.size() - 1);
+    std::uniform_int_distribution<size_t> rand_int(0, data.source_length);
+
+    std::vector<std::pair<uint8_t, size_t>> rank_queries(num_queries);
+    std::vector<std::pair<uint8_t, size_t>> select_queries(num_queries);
+    for (size_t q = 0; q < num_queries; q++) {
+        const uint8_t c = supported[rand_char(gen)];
+        rank_queries[q] = {c, rand_int(gen)};
+    }
+    for (size_t q = 0; q < num_queries; q++) {
+        const uint8_t c     = supported[rand_char(gen)];
+        const size_t  total = ds.rank(c, data.source_length);
+        select_queries[q]   = {c, std::uniform_int_distribution<size_t>(1, std::max(total, (size_t) 1))(gen)};
+    }
+
+    size_t sum = 0;
+
+    begin = std::chrono::steady_clock::now();
+    for (const auto &[c, i] : rank_queries) {
+        sum += ds.rank(c, i);
+    }
+    end                        = std::chrono::steady_clock::now();
+    const auto rank_time_total = std::chrono::duration_cast<std::chrono::milliseconds>(end - begin).count();
+
+    begin = std::chrono::steady_clock::now();
+    for (const auto &[c, k] : select_queries) {
+        sum += ds.select(c, k);
+    }
+    end                          = std::chrono::steady_clock::now();
+    const auto select_time_total = std::chrono::duration_cast<std::chrono::milliseconds>(end - begin).count();
+
+    // so the calls are hopefully not optimized away
+    if (sum < 1) {
+        std::cout << sum;
+    }
+
+    std::string file_name;
+    auto        last = file.find_last_of('/');
+    if (last < std::string::npos) {
+        file_name = file.substr(last + 1);
+    } else {
+        file_name = file;
+    }
+
+    std::cout << "RESULT"
+              << " type=rank_select"
+              << " ds=" << name << " input_file=" << file_name << " input_size=" << data.source_length
+              << " num_queries=" << num_queries << " alphabet_size=" << supported.size() << " space=" << data.space
+              << " rank_select_space=" << rank_select_space << " construction_time=" << data.constr_time
+              << " rank_select_construction_time=" << rank_select_time << " rank_time_total=" << rank_time_total
+              << " select_time_total=" << select_time_total;
+    data.profile.write_result_fields(std::cout);
+    write_memory_policy_fields(std::cout);
+    std::cout << std::endl;
 }
 
 template<Substring Grm>
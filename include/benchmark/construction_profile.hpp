@@ -0,0 +1,100 @@
+#pragma once
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include <util/memory_policy.hpp>
+
+#include <malloc_count.h>
+
+namespace gracli {
+
+/**
+ * @brief Records the time and the memory peak of each phase in the construction of a data structure.
+ *
+ * This is a `PhaseObserver`. Each call to `phase` ends the phase before it and starts a new one. `finish` ends the
+ * last phase. Memory peaks are measured with malloc_count and are relative to the memory in use when the profile was
+ * created, so they are directly comparable to the `space` of a data structure.
+ */
+class ConstructionProfile {
+    using TimePoint = std::chrono::steady_clock::time_point;
+
+    struct Phase {
+        std::string name;
+        /**
+         * @brief The time this phase took in milliseconds
+         */
+        size_t time;
+        /**
+         * @brief The highest amount of memory in use at any point during this phase
+         */
+        int64_t peak;
+    };
+
+    std::vector<Phase> m_phases;
+
+    /**
+     * @brief The name of the currently running phase. Empty if no phase is running.
+     */
+    std::string m_current;
+    TimePoint   m_current_begin;
+
+    /**
+     * @brief The memory in use before construction started.
+     */
+    size_t m_space_base;
+
+  public:
+    ConstructionProfile() :
+        m_phases{},
+        m_current{},
+        m_current_begin{},
+        m_space_base{malloc_count_current() + MemoryPolicy::mapped_bytes()} {}
+
+    void phase(const char *name) {
+        finish();
+        m_current       = name;
+        m_current_begin = std::chrono::steady_clock::now();
+        malloc_count_reset_peak();
+    }
+
+    void finish() {
+        if (m_current.empty()) {
+            return;
+        }
+        TimePoint end  = std::chrono::steady_clock::now();
+        size_t    time = std::chrono::duration_cast<std::chrono::milliseconds>(end - m_current_begin).count();
+        // Mapped memory is not seen by malloc_count, so we can only add what is mapped at the end of the phase
+        int64_t peak = (int64_t) (malloc_count_peak() + MemoryPolicy::mapped_bytes()) - (int64_t) m_space_base;
+        m_phases.push_back({std::move(m_current), time, peak});
+        m_current.clear();
+    }
+
+    /**
+     * @brief The highest amount of memory in use at any point during construction
+     */
+    [[nodiscard]] auto peak() const -> int64_t {
+        int64_t peak = 0;
+        for (const auto &phase : m_phases) {
+            peak = std::max(peak, phase.peak);
+        }
+        return peak;
+    }
+
+    /**
+     * @brief Writes the profile as key=value pairs for use in a RESULT line.
+     * Each pair is preceded by a space.
+     */
+    void write_result_fields(std::ostream &out) const {
+        for (const auto &phase : m_phases) {
+            out << " " << phase.name << "_time=" << phase.time << " " << phase.name << "_peak=" << phase.peak;
+        }
+        out << " construction_peak=" << peak();
+    }
+};
+
+} // namespace gracli
@@ -0,0 +1,168 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+
+#include <blocktree/blocktree.hpp>
+#include <blocktree/native_block_tree.hpp>
+#include <compressed_blocks/compressed_blocks.hpp>
+#include <file_access/file_access.hpp>
+#include <grammar/grammar_index.hpp>
+#include <grammar/naive_query_grammar.hpp>
+#include <grammar/sampled_scan_query_grammar.hpp>
+#include <lzend/lzend.hpp>
+
+namespace gracli {
+
+/**
+ * @brief The data structures available in gracli. The values are the ids used on the command line.
+ */
+enum class GrammarType : uint8_t {
+    ReproducedString,
+    Naive,
+    SampledScan512,
+    SampledScan6400,
+    SampledScan25600,
+    LzEnd,
+    FileAccess,
+    BlockTree,
+    SampledLzEnd,
+    NativeBlockTree,
+    CompressedBlocks,
+    GrammarIndex,
+};
+
+/**
+ * @brief The number of variants in `GrammarType`
+ */
+static const unsigned int GRAMMAR_TYPE_COUNT = 12;
+
+/**
+ * @brief The kind of input file a data structure is built from
+ */
+enum class FileType : uint8_t {
+    Plaintext,
+    Grammar,
+    LzEnd,
+    BlockTree,
+};
+
+/**
+ * @brief Returns the name of a data structure as it is used in the `ds` field of benchmark results.
+ */
+inline auto grammar_type_name(const GrammarType type) -> std::string {
+    switch (type) {
+        case GrammarType::ReproducedString:
+            return "string";
+        case GrammarType::Naive:
+            return "naive";
+        case GrammarType::SampledScan512:
+            return "sampled_scan_512";
+        case GrammarType::SampledScan6400:
+            return "sampled_scan_6400";
+        case GrammarType::SampledScan25600:
+            return "sampled_scan_25600";
+        case GrammarType::LzEnd:
+            return "lzend";
+        case GrammarType::FileAccess:
+            return "file_access";
+        case GrammarType::BlockTree:
+            return "blocktree";
+        case GrammarType::SampledLzEnd:
+            return "lzend_sampled";
+        case GrammarType::NativeBlockTree:
+            return "blocktree_native";
+        case GrammarType::CompressedBlocks:
+            return "compressed_blocks";
+        case GrammarType::GrammarIndex:
+            return "grammar_index";
+    }
+    return "";
+}
+
+/**
+ * @brief Returns the kind of file the given data structure is built from.
+ */
+inline auto grammar_type_file_type(const GrammarType type) -> FileType {
+    switch (type) {
+        case GrammarType::ReproducedString:
+        case GrammarType::FileAccess:
+        case GrammarType::NativeBlockTree:
+        case GrammarType::CompressedBlocks:
+            return FileType::Plaintext;
+        case GrammarType::Naive:
+        case GrammarType::SampledScan512:
+        case GrammarType::SampledScan6400:
+        case GrammarType::SampledScan25600:
+        case GrammarType::GrammarIndex:
+            return FileType::Grammar;
+        case GrammarType::LzEnd:
+        case GrammarType::SampledLzEnd:
+            return FileType::LzEnd;
+        case GrammarType::BlockTree:
+            return FileType::BlockTree;
+    }
+    return FileType::Plaintext;
+}
+
+/**
+ * @brief Calls `f.template operator()<DS>()` with the C++ type `DS` of the given data structure.
+ *
+ * @param type The data structure
+ * @param f A callable with a templated call operator, usually a templated lambda
+ */
+template<typename F>
+void with_grammar_type(const GrammarType type, F &&f) {
+    switch (type) {
+        case GrammarType::ReproducedString: {
+            f.template operator()<std::string>();
+            break;
+        }
+        case GrammarType::Naive: {
+            f.template operator()<NaiveQueryGrammar>();
+            break;
+        }
+        case GrammarType::SampledScan512: {
+            f.template operator()<SampledScanQueryGrammar<512>>();
+            break;
+        }
+        case GrammarType::SampledScan6400: {
+            f.template operator()<SampledScanQueryGrammar<6400>>();
+            break;
+        }
+        case GrammarType::SampledScan25600: {
+            f.template operator()<SampledScanQueryGrammar<25600>>();
+            break;
+        }
+        case GrammarType::LzEnd: {
+            f.template operator()<lz::LzEnd>();
+            break;
+        }
+        case GrammarType::FileAccess: {
+            f.template operator()<FileAccess>();
+            break;
+        }
+        case GrammarType::BlockTree: {
+            f.template operator()<BlockTreeRandomAccess>();
+            break;
+        }
+        case GrammarType::SampledLzEnd: {
+            f.template operator()<lz::SampledLzEnd>();
+            break;
+        }
+        case GrammarType::NativeBlockTree: {
+            f.template operator()<bt::BlockTree>();
+            break;
+        }
+        case GrammarType::CompressedBlocks: {
+            f.template operator()<cb::CompressedBlocks>();
+            break;
+        }
+        case GrammarType::GrammarIndex: {
+            f.template operator()<GrammarIndex<6400>>();
+            break;
+        }
+    }
+}
+
+} // namespace gracli
@@ -0,0 +1,83 @@
+#pragma once
+
+#include <cstdint>
+#include <cstring>
+
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+namespace gracli {
+
+/**
+ * @brief A hardware performance counter of the calling thread, read via perf_event_open.
+ *
+ * If the counter is not available (e.g. because of perf_event_paranoid or inside a VM), `stop` returns -1.
+ */
+class PerfCounter {
+    int m_fd;
+
+    PerfCounter(const uint32_t type, const uint64_t config) {
+        perf_event_attr attr;
+        std::memset(&attr, 0, sizeof(attr));
+        attr.type           = type;
+        attr.size           = sizeof(attr);
+        attr.config         = config;
+        attr.disabled       = 1;
+        attr.exclude_kernel = 1;
+        attr.exclude_hv     = 1;
+        m_fd                = (int) syscall(SYS_perf_event_open, &attr, 0, -1, -1, 0);
+    }
+
+  public:
+    /**
+     * @brief Counts load misses in the data TLB.
+     */
+    static auto dtlb_load_misses() -> PerfCounter {
+        return {PERF_TYPE_HW_CACHE,
+                PERF_COUNT_HW_CACHE_DTLB | (PERF_COUNT_HW_CACHE_OP_READ << 8) |
+                    (PERF_COUNT_HW_CACHE_RESULT_MISS << 16)};
+    }
+
+    PerfCounter(const PerfCounter &) = delete;
+
+    PerfCounter(PerfCounter &&other) noexcept : m_fd{other.m_fd} { other.m_fd = -1; }
+
+    ~PerfCounter() {
+        if (m_fd >= 0) {
+            close(m_fd);
+        }
+    }
+
+    [[nodiscard]] inline auto available() const -> bool { return m_fd >= 0; }
+
+    /**
+     * @brief Resets the counter to 0 and starts counting.
+     */
+    void start() {
+        if (available()) {
+            ioctl(m_fd, PERF_EVENT_IOC_RESET, 0);
+            ioctl(m_fd, PERF_EVENT_IOC_ENABLE, 0);
+        }
+    }
+
+    /**
+     * @brief Stops counting.
+     *
+     * @return The number of events since `start` or -1 if the counter is not available
+     */
+    auto stop() -> int64_t {
+        if (!available()) {
+            return -1;
+        }
+        ioctl(m_fd, PERF_EVENT_IOC_DISABLE, 0);
+        uint64_t count;
+        if (read(m_fd, &count, sizeof(count)) != sizeof(count)) {
+            return -1;
+        }
+        return (int64_t) count;
+    }
+};
+
+} // namespace gracli
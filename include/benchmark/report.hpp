@@ -0,0 +1,142 @@
+#pragma once
+
+#include <cstdint>
+#include <iomanip>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include <benchmark/statistics.hpp>
+
+namespace gracli {
+
+/**
+ * @brief The counters of the cache of a data structure. All values are -1 if the data structure has no cache.
+ */
+struct CacheCounters {
+    int64_t bytes    = -1;
+    int64_t hits     = -1;
+    int64_t misses   = -1;
+    double  hit_rate = -1;
+};
+
+/**
+ * @brief The result of one benchmark configuration, i.e. one data structure, query type, substring length and query
+ * count, measured over several trials.
+ */
+struct BenchmarkRecord {
+    std::string ds;
+    std::string input_file;
+    size_t      input_size;
+    /**
+     * @brief Either "random_access", "substring", "count" or "locate"
+     */
+    std::string type;
+    /**
+     * @brief The length of the substrings or, for "count" and "locate", of the patterns
+     */
+    size_t      substring_length;
+    size_t      num_queries;
+    /**
+     * @brief The number of threads the queries of a trial were split among
+     */
+    size_t      threads;
+    size_t      warmup;
+    int64_t     space;
+    size_t      construction_time;
+    int64_t     construction_peak;
+    std::string huge_pages;
+    std::string numa;
+    /**
+     * @brief Nanoseconds per query over all trials. This is the wall-clock time of a trial divided by its number of
+     * queries, so with several threads it is the inverse of the throughput.
+     */
+    Summary query_time;
+    /**
+     * @brief The mean number of dTLB load misses per query or -1 if they could not be counted
+     */
+    double dtlb_misses_per_query;
+    /**
+     * @brief The counters of the data structure's cache over the measured trials
+     */
+    CacheCounters cache;
+    /**
+     * @brief The number of queries in flight if the queries were run as batches by a `BatchReader` or 0 otherwise
+     */
+    size_t queue_depth = 0;
+    /**
+     * @brief The mean number of completed queries per second of batched trials or -1 for unbatched ones
+     */
+    double iops = -1;
+    /**
+     * @brief The latencies of single queries in nanoseconds over all measured batched trials or -1 for unbatched ones
+     */
+    Percentiles latency = {-1, -1, -1, -1};
+    /**
+     * @brief The mean number of occurrences per pattern of "count" and "locate" queries or -1 for other queries
+     */
+    double occurrences = -1;
+};
+
+/**
+ * @brief Writes the records as a JSON array of objects, one object per record.
+ */
+inline void write_json(std::ostream &out, const std::vector<BenchmarkRecord> &records) {
+    // Strings in the records are file and data structure names, so we only escape what can realistically occur there
+    const auto quote = [](const std::string &s) {
+        std::string quoted = "\"";
+        for (const char c : s) {
+            if (c == '"' || c == '\\') {
+                quoted += '\\';
+            }
+            quoted += c;
+        }
+        return quoted + "\"";
+    };
+
+    out << std::fixed << std::setprecision(3) << "[";
+    for (size_t i = 0; i < records.size(); i++) {
+        const BenchmarkRecord &r = records[i];
+        out << (i == 0 ? "\n" : ",\n") << "  {"
+            << "\"ds\": " << quote(r.ds) << ", \"input_file\": " << quote(r.input_file)
+            << ", \"input_size\": " << r.input_size << ", \"type\": " << quote(r.type)
+            << ", \"substring_length\": " << r.substring_length << ", \"num_queries\": " << r.num_queries
+            << ", \"threads\": " << r.threads << ", \"trials\": " << r.query_time.samples
+            << ", \"warmup\": " << r.warmup << ", \"space\": " << r.space
+            << ", \"construction_time\": " << r.construction_time << ", \"construction_peak\": " << r.construction_peak
+            << ", \"huge_pages\": " << quote(r.huge_pages) << ", \"numa\": " << quote(r.numa)
+            << ", \"dtlb_misses_per_query\": " << r.dtlb_misses_per_query << ", \"cache_bytes\": " << r.cache.bytes
+            << ", \"cache_hit_rate\": " << r.cache.hit_rate << ", \"ns_per_query\": {"
+            << "\"mean\": " << r.query_time.mean << ", \"stddev\": " << r.query_time.stddev
+            << ", \"min\": " << r.query_time.min << ", \"max\": " << r.query_time.max
+            << ", \"ci95_low\": " << r.query_time.ci95_low() << ", \"ci95_high\": " << r.query_time.ci95_high()
+            << "}, \"queue_depth\": " << r.queue_depth << ", \"iops\": " << r.iops << ", \"latency_ns\": {"
+            << "\"p50\": " << r.latency.p50 << ", \"p90\": " << r.latency.p90 << ", \"p99\": " << r.latency.p99
+            << ", \"p999\": " << r.latency.p999 << "}, \"occurrences\": " << r.occurrences << "}";
+    }
+    out << "\n]" << std::endl;
+}
+
+/**
+ * @brief Writes the records as CSV with a header line.
+ */
+inline void write_csv(std::ostream &out, const std::vector<BenchmarkRecord> &records) {
+    out << "ds,input_file,input_size,type,substring_length,num_queries,threads,trials,warmup,space,construction_time,"
+           "construction_peak,huge_pages,numa,dtlb_misses_per_query,cache_bytes,cache_hit_rate,ns_per_query_mean,"
+           "ns_per_query_stddev,ns_per_query_min,ns_per_query_max,ns_per_query_ci95_low,ns_per_query_ci95_high,"
+           "queue_depth,iops,latency_ns_p50,latency_ns_p90,latency_ns_p99,latency_ns_p999,occurrences\n";
+    out << std::fixed << std::setprecision(3);
+    for (const BenchmarkRecord &r : records) {
+        out << r.ds << "," << r.input_file << "," << r.input_size << "," << r.type << "," << r.substring_length << ","
+            << r.num_queries << "," << r.threads << "," << r.query_time.samples << "," << r.warmup << "," << r.space
+            << "," << r.construction_time << "," << r.construction_peak << "," << r.huge_pages << "," << r.numa << ","
+            << r.dtlb_misses_per_query << "," << r.cache.bytes << "," << r.cache.hit_rate << "," << r.query_time.mean
+            << "," << r.query_time.stddev << "," << r.query_time.min << "," << r.query_time.max << ","
+            << r.query_time.ci95_low() << "," << r.query_time.ci95_high() << "," << r.queue_depth << "," << r.iops
+            << "," << r.latency.p50 << "," << r.latency.p90 << "," << r.latency.p99 << "," << r.latency.p999 << ","
+            << r.occurrences << "\n";
+    }
+    out.flush();
+}
+
+} // namespace gracli
@@ -0,0 +1,94 @@
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <numeric>
+#include <vector>
+
+namespace gracli {
+
+/**
+ * @brief Summary statistics over the measurements of repeated benchmark trials.
+ */
+struct Summary {
+    size_t samples;
+    double mean;
+    double stddev;
+    double min;
+    double max;
+    /**
+     * @brief The half-width of the 95% confidence interval of the mean
+     */
+    double ci95;
+
+    [[nodiscard]] inline auto ci95_low() const -> double { return mean - ci95; }
+    [[nodiscard]] inline auto ci95_high() const -> double { return mean + ci95; }
+};
+
+/**
+ * @brief The two-sided 97.5% quantile of Student's t-distribution with the given degrees of freedom.
+ * For more than 30 degrees of freedom, the quantile of the normal distribution is used.
+ */
+inline auto student_t_975(const size_t degrees_of_freedom) -> double {
+    static const double TABLE[] = {12.706, 4.303, 3.182, 2.776, 2.571, 2.447, 2.365, 2.306, 2.262, 2.228,
+                                   2.201,  2.179, 2.160, 2.145, 2.131, 2.120, 2.110, 2.101, 2.093, 2.086,
+                                   2.080,  2.074, 2.069, 2.064, 2.060, 2.056, 2.052, 2.048, 2.045, 2.042};
+    if (degrees_of_freedom == 0) {
+        return 0;
+    }
+    if (degrees_of_freedom > 30) {
+        return 1.960;
+    }
+    return TABLE[degrees_of_freedom - 1];
+}
+
+/**
+ * @brief Calculates mean, sample standard deviation and the 95% confidence interval of the mean of the given values.
+ */
+inline auto summarize(const std::vector<double> &values) -> Summary {
+    const size_t n = values.size();
+    if (n == 0) {
+        return {0, 0, 0, 0, 0, 0};
+    }
+
+    const double mean = std::accumulate(values.cbegin(), values.cend(), 0.0) / n;
+
+    double square_sum = 0;
+    for (const double v : values) {
+        square_sum += (v - mean) * (v - mean);
+    }
+    const double stddev = n > 1 ? std::sqrt(square_sum / (n - 1)) : 0;
+    const double ci95   = n > 1 ? student_t_975(n - 1) * stddev / std::sqrt((double) n) : 0;
+
+    const auto [min, max] = std::minmax_element(values.cbegin(), values.cend());
+    return {n, mean, stddev, *min, *max, ci95};
+}
+
+/**
+ * @brief Percentiles of a distribution, e.g. of the latencies of single queries.
+ */
+struct Percentiles {
+    double p50;
+    double p90;
+    double p99;
+    double p999;
+};
+
+/**
+ * @brief Calculates the percentiles of the given values using the nearest-rank method. All percentiles are -1 if there
+ * are no values.
+ */
+inline auto percentiles(std::vector<double> values) -> Percentiles {
+    if (values.empty()) {
+        return {-1, -1, -1, -1};
+    }
+    std::sort(values.begin(), values.end());
+    const auto rank = [&](const double p) {
+        const auto r = (size_t) std::ceil(p * (double) values.size());
+        return values[std::clamp<size_t>(r, 1, values.size()) - 1];
+    };
+    return {rank(0.5), rank(0.9), rank(0.99), rank(0.999)};
+}
+
+} // namespace gracli
@@ -1,34 +1,37 @@
 #pragma once
 
+#include <fstream>
+#include <memory>
+#include <string>
+
 #include <compressed/CBlockTree.h>
 #include <pointer_based/BlockTree.h>
 
 namespace gracli {
 
+/**
+ * @brief Random access on a block tree of MinimalistBlockTrees.
+ *
+ * The queries of `CBlockTree` only read the tree and keep their state on the stack, so the queries here are const and
+ * can be run by any number of threads at once. Copies share the same tree, which is freed together with the last copy,
+ * so one loaded block tree can be handed to several query sessions.
+ */
 class BlockTreeRandomAccess {
-    std::unique_ptr<CBlockTree> m_cbt;
-    BlockTreeRandomAccess(CBlockTree *bt) : m_cbt{bt} {}
+    std::shared_ptr<CBlockTree> m_cbt;
+    explicit BlockTreeRandomAccess(std::shared_ptr<CBlockTree> bt) : m_cbt{std::move(bt)} {}
 
-public:
+  public:
     static auto from_file(const std::string &path) -> BlockTreeRandomAccess {
         std::ifstream ifs(path);
 
-        auto *cbt = new CBlockTree(ifs);
-        
-        return BlockTreeRandomAccess(cbt);
+        return BlockTreeRandomAccess(std::make_shared<CBlockTree>(ifs));
     }
 
-    inline auto at(size_t i) -> char {
-        return (char) m_cbt->access(i);
-    }
+    inline auto at(size_t i) const -> char { return (char) m_cbt->access(i); }
 
-    inline auto substr(char* buf, size_t i, size_t len) -> char* {
-        return m_cbt->substr(buf, i, len);
-    }
+    inline auto substr(char *buf, size_t i, size_t len) const -> char * { return m_cbt->substr(buf, i, len); }
 
-    inline auto source_length() -> size_t {
-        return this->m_cbt->input_size_;
-    }
+    inline auto source_length() const -> size_t { return m_cbt->input_size_; }
 };
 
 } // namespace gracli
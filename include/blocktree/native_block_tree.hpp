@@ -0,0 +1,876 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <bit>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <iterator>
+#include <limits>
+#include <stdexcept>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include <concepts.hpp>
+#include <util/construction_phases.hpp>
+#include <util/karp_rabin.hpp>
+#include <util/mapped_file.hpp>
+#include <util/serialization.hpp>
+
+#include <word_packing.hpp>
+
+namespace gracli::bt {
+
+/**
+ * @brief The shape of a block tree.
+ */
+struct BlockTreeParams {
+    /**
+     * @brief The number of children of an internal block
+     */
+    size_t arity = 2;
+    /**
+     * @brief The maximum number of blocks on the top level
+     */
+    size_t root_arity = 128;
+    /**
+     * @brief The length of the blocks on the lowest level, whose text is stored explicitly
+     */
+    size_t leaf_length = 16;
+    /**
+     * @brief The number of characters stored explicitly at the start and at the end of each back block. Accesses to
+     * these characters need not follow the back pointer.
+     */
+    size_t prefix_suffix = 0;
+};
+
+namespace detail {
+
+/**
+ * @brief Finds the leftmost occurrence in the text of each of the given windows of the text.
+ *
+ * Windows with the same content are grouped, and the text is scanned with a rolling Karp-Rabin fingerprint which is
+ * looked up among the fingerprints of the groups. Candidates are compared character by character, so the result is
+ * exact. The scan is split into ranges of `chunk_size` positions which are scanned in parallel.
+ *
+ * @param text The text
+ * @param len The length of the windows
+ * @param starts The start positions of the windows in ascending order. All windows must end inside the text.
+ * @param chunk_size The number of positions scanned by one task
+ * @return For each window the start of its leftmost occurrence
+ */
+template<typename Char>
+auto leftmost_occurrences(const Char                  *text,
+                          const size_t                 len,
+                          const std::vector<uint64_t> &starts,
+                          const size_t                 chunk_size) -> std::vector<uint64_t> {
+    constexpr uint32_t NONE  = UINT32_MAX;
+    const size_t       count = starts.size();
+    const KarpRabin    kr;
+
+    std::vector<uint64_t> fingerprints(count);
+#pragma omp parallel for schedule(static)
+    for (size_t i = 0; i < count; i++) {
+        fingerprints[i] = kr.fingerprint(text + starts[i], len);
+    }
+
+    // The windows are grouped by their content. Each group is represented by its leftmost window, and groups whose
+    // fingerprints collide are chained.
+    std::unordered_map<uint64_t, uint32_t> first_group;
+    std::vector<uint64_t>                  group_start;
+    std::vector<uint32_t>                  next_group;
+    std::vector<uint32_t>                  group_of(count);
+    first_group.reserve(count);
+    for (size_t i = 0; i < count; i++) {
+        const auto [it, inserted] = first_group.try_emplace(fingerprints[i], (uint32_t) group_start.size());
+        uint32_t group            = it->second;
+        if (inserted) {
+            group_start.push_back(starts[i]);
+            next_group.push_back(NONE);
+        } else {
+            while (std::memcmp(text + group_start[group], text + starts[i], len * sizeof(Char)) != 0) {
+                if (next_group[group] == NONE) {
+                    next_group[group] = (uint32_t) group_start.size();
+                    group_start.push_back(starts[i]);
+                    next_group.push_back(NONE);
+                }
+                group = next_group[group];
+            }
+        }
+        group_of[i] = group;
+    }
+    fingerprints.clear();
+    fingerprints.shrink_to_fit();
+
+    // Most positions match no window, so a bit per fingerprint hash rules them out before the hash map is queried
+    const size_t          filter_bits = std::bit_ceil(std::max<size_t>(8 * group_start.size(), 64));
+    std::vector<uint64_t> filter(filter_bits / 64);
+    for (const auto &[fingerprint, group] : first_group) {
+        const size_t bit = fingerprint & (filter_bits - 1);
+        filter[bit / 64] |= 1ULL << (bit % 64);
+    }
+
+    std::vector<std::atomic<uint64_t>> leftmost(group_start.size());
+    for (size_t group = 0; group < group_start.size(); group++) {
+        leftmost[group].store(group_start[group], std::memory_order_relaxed);
+    }
+
+    // An earlier occurrence of a window starts before the window itself, so only positions before the last window
+    // need to be scanned
+    const size_t   scan_end   = count == 0 ? 0 : starts.back();
+    const size_t   num_chunks = (scan_end + chunk_size - 1) / chunk_size;
+    const uint64_t out_pow    = kr.pow(len - 1);
+#pragma omp parallel for schedule(dynamic, 1)
+    for (size_t chunk = 0; chunk < num_chunks; chunk++) {
+        const size_t begin       = chunk * chunk_size;
+        const size_t end         = std::min(begin + chunk_size, scan_end);
+        uint64_t     fingerprint = kr.fingerprint(text + begin, len);
+        for (size_t p = begin; p < end; p++) {
+            if (p > begin) {
+                fingerprint = kr.roll(fingerprint, KarpRabin::mul((uint64_t) text[p - 1], out_pow), text[p + len - 1]);
+            }
+            const size_t bit = fingerprint & (filter_bits - 1);
+            if (!((filter[bit / 64] >> (bit % 64)) & 1)) {
+                continue;
+            }
+            const auto it = first_group.find(fingerprint);
+            if (it == first_group.end()) {
+                continue;
+            }
+            for (uint32_t group = it->second; group != NONE; group = next_group[group]) {
+                uint64_t current = leftmost[group].load(std::memory_order_relaxed);
+                if (p >= current || std::memcmp(text + p, text + group_start[group], len * sizeof(Char)) != 0) {
+                    continue;
+                }
+                while (p < current && !leftmost[group].compare_exchange_weak(current, p, std::memory_order_relaxed)) {}
+            }
+        }
+    }
+
+    std::vector<uint64_t> result(count);
+    for (size_t i = 0; i < count; i++) {
+        result[i] = leftmost[group_of[i]].load(std::memory_order_relaxed);
+    }
+    return result;
+}
+
+} // namespace detail
+
+/**
+ * @brief A block tree built by gracli itself.
+ *
+ * The text is divided into at most `root_arity` blocks of length `leaf_length * arity^h`. On each level, a block is
+ * internal if it or one of the two pairs of adjacent blocks containing it is the leftmost occurrence of its content in
+ * the text. Internal blocks are divided into `arity` blocks on the next level. Every other block is a back block, which
+ * points to the leftmost occurrence of its content. That occurrence always lies in at most two adjacent internal blocks
+ * of the same level. The internal blocks of the lowest level store their text.
+ *
+ * An access descends from the top level, following at most one back pointer per level. The queries are const and can
+ * be run by any number of threads at once.
+ */
+class BlockTree {
+  public:
+    using Char = uint8_t;
+
+    /**
+     * @brief The magic number at the start of a saved block tree ("GRLBTREE" in little endian)
+     */
+    static constexpr uint64_t INDEX_MAGIC = 0x4545'5254'424c'5247;
+
+  private:
+    /**
+     * @brief A level while it is built.
+     */
+    struct LevelData {
+        size_t                block_length;
+        size_t                num_blocks;
+        std::vector<uint64_t> internal;
+        std::vector<uint64_t> internal_rank;
+        std::vector<size_t>   targets;
+        size_t                target_bits;
+        size_t                prefix_suffix;
+        std::vector<Char>     prefix_suffix_text;
+    };
+
+    /**
+     * @brief A level of the tree. The arrays point into the flat representation of the tree.
+     */
+    struct Level {
+        /**
+         * @brief The length of the blocks on this level
+         */
+        size_t block_length;
+        size_t num_blocks;
+        /**
+         * @brief A bit for each block which is set if the block is internal
+         */
+        const uint64_t *internal;
+        /**
+         * @brief For each word of `internal`, the number of internal blocks before it
+         */
+        const uint64_t *internal_rank;
+        /**
+         * @brief The targets of the back blocks in order, stored with `target_bits` bits each. A target is the index of
+         * the block containing the start of the source times the block length plus the offset of the source in it.
+         */
+        const size_t *targets;
+        size_t        target_bits;
+        /**
+         * @brief The number of characters stored at the start and at the end of each back block on this level
+         */
+        size_t prefix_suffix;
+        /**
+         * @brief The first and last `prefix_suffix` characters of each back block in order
+         */
+        const Char *prefix_suffix_text;
+
+        [[nodiscard]] inline auto is_internal(const size_t block) const -> bool {
+            return (internal[block / 64] >> (block % 64)) & 1;
+        }
+
+        /**
+         * @brief Returns the number of internal blocks before the given block.
+         */
+        [[nodiscard]] inline auto internal_before(const size_t block) const -> size_t {
+            const uint64_t word = internal[block / 64] & ((1ULL << (block % 64)) - 1);
+            return internal_rank[block / 64] + std::popcount(word);
+        }
+
+        [[nodiscard]] inline auto target(const size_t back_block) const -> size_t {
+            return word_packing::accessor(targets, target_bits)[back_block];
+        }
+    };
+
+    /**
+     * @brief The start of the flat representation. All fields are 64 bit words.
+     */
+    struct Header {
+        uint64_t magic;
+        /**
+         * @brief The size of the whole representation in bytes
+         */
+        uint64_t total_bytes;
+        uint64_t source_length;
+        uint64_t arity;
+        uint64_t root_arity;
+        uint64_t leaf_length;
+        uint64_t prefix_suffix;
+        uint64_t num_levels;
+        uint64_t leaves_offset;
+        uint64_t leaves_bytes;
+    };
+
+    /**
+     * @brief Describes a level in the flat representation. The headers of all levels follow the `Header`, and the
+     * offsets are in bytes from the start of the representation.
+     */
+    struct LevelHeader {
+        uint64_t block_length;
+        uint64_t num_blocks;
+        uint64_t target_bits;
+        uint64_t prefix_suffix;
+        uint64_t internal_offset;
+        uint64_t internal_words;
+        uint64_t internal_rank_offset;
+        uint64_t targets_offset;
+        uint64_t targets_words;
+        uint64_t prefix_suffix_offset;
+        uint64_t prefix_suffix_bytes;
+    };
+
+    /**
+     * @brief The alignment of the arrays in the flat representation, so that no array shares a cache line with another
+     */
+    static constexpr size_t ARRAY_ALIGNMENT = 64;
+
+    size_t             m_source_length;
+    BlockTreeParams    m_params;
+    std::vector<Level> m_levels;
+    /**
+     * @brief The text of the internal blocks on the lowest level in order
+     */
+    const Char *m_leaves;
+
+    /**
+     * @brief The flat representation if the tree was built in memory
+     */
+    std::vector<uint64_t> m_buffer;
+    /**
+     * @brief The flat representation if the tree was loaded from a file
+     */
+    MappedFile m_mapping;
+
+    BlockTree() : m_source_length{0}, m_leaves{nullptr} {}
+
+    /**
+     * @brief Returns the start and the size in bytes of the flat representation.
+     */
+    [[nodiscard]] auto representation() const -> std::pair<const uint8_t *, size_t> {
+        if (m_mapping.data() != nullptr) {
+            return {m_mapping.data(), m_mapping.size()};
+        }
+        return {reinterpret_cast<const uint8_t *>(m_buffer.data()), m_buffer.size() * sizeof(uint64_t)};
+    }
+
+    /**
+     * @brief Writes the levels and leaves into one buffer laid out as described by `Header` and `LevelHeader`.
+     */
+    void flatten(const std::vector<LevelData> &levels, const std::vector<Char> &leaves) {
+        const auto align = [](const size_t offset) {
+            return (offset + ARRAY_ALIGNMENT - 1) / ARRAY_ALIGNMENT * ARRAY_ALIGNMENT;
+        };
+
+        std::vector<LevelHeader> headers(levels.size());
+        size_t                   offset = sizeof(Header) + levels.size() * sizeof(LevelHeader);
+        for (size_t l = 0; l < levels.size(); l++) {
+            const LevelData &level = levels[l];
+            LevelHeader     &h     = headers[l];
+            h.block_length         = level.block_length;
+            h.num_blocks           = level.num_blocks;
+            h.target_bits          = level.target_bits;
+            h.prefix_suffix        = level.prefix_suffix;
+            h.internal_words       = level.internal.size();
+            h.internal_offset      = align(offset);
+            h.internal_rank_offset = align(h.internal_offset + h.internal_words * sizeof(uint64_t));
+            h.targets_words        = level.targets.size();
+            h.targets_offset       = align(h.internal_rank_offset + h.internal_words * sizeof(uint64_t));
+            h.prefix_suffix_bytes  = level.prefix_suffix_text.size() * sizeof(Char);
+            h.prefix_suffix_offset = align(h.targets_offset + h.targets_words * sizeof(size_t));
+            offset                 = h.prefix_suffix_offset + h.prefix_suffix_bytes;
+        }
+
+        Header header{
+            .magic         = INDEX_MAGIC,
+            .total_bytes   = 0,
+            .source_length = m_source_length,
+            .arity         = m_params.arity,
+            .root_arity    = m_params.root_arity,
+            .leaf_length   = m_params.leaf_length,
+            .prefix_suffix = m_params.prefix_suffix,
+            .num_levels    = levels.size(),
+            .leaves_offset = align(offset),
+            .leaves_bytes  = leaves.size() * sizeof(Char),
+        };
+        header.total_bytes = align(header.leaves_offset + header.leaves_bytes);
+
+        m_buffer.assign(header.total_bytes / sizeof(uint64_t), 0);
+        auto *base = reinterpret_cast<uint8_t *>(m_buffer.data());
+        std::memcpy(base, &header, sizeof(Header));
+        std::memcpy(base + sizeof(Header), headers.data(), headers.size() * sizeof(LevelHeader));
+        for (size_t l = 0; l < levels.size(); l++) {
+            const LevelData   &level = levels[l];
+            const LevelHeader &h     = headers[l];
+            std::memcpy(base + h.internal_offset, level.internal.data(), h.internal_words * sizeof(uint64_t));
+            std::memcpy(base + h.internal_rank_offset, level.internal_rank.data(), h.internal_words * sizeof(uint64_t));
+            std::memcpy(base + h.targets_offset, level.targets.data(), h.targets_words * sizeof(size_t));
+            std::memcpy(base + h.prefix_suffix_offset, level.prefix_suffix_text.data(), h.prefix_suffix_bytes);
+        }
+        std::memcpy(base + header.leaves_offset, leaves.data(), header.leaves_bytes);
+        attach(base);
+    }
+
+    /**
+     * @brief Points the levels and the leaves into a flat representation.
+     */
+    void attach(const uint8_t *base) {
+        Header header;
+        std::memcpy(&header, base, sizeof(Header));
+        m_source_length        = header.source_length;
+        m_params.arity         = header.arity;
+        m_params.root_arity    = header.root_arity;
+        m_params.leaf_length   = header.leaf_length;
+        m_params.prefix_suffix = header.prefix_suffix;
+        m_leaves               = reinterpret_cast<const Char *>(base + header.leaves_offset);
+
+        const auto *headers = reinterpret_cast<const LevelHeader *>(base + sizeof(Header));
+        m_levels.resize(header.num_levels);
+        for (size_t l = 0; l < m_levels.size(); l++) {
+            const LevelHeader &h     = headers[l];
+            Level             &level = m_levels[l];
+            level.block_length       = h.block_length;
+            level.num_blocks         = h.num_blocks;
+            level.internal           = reinterpret_cast<const uint64_t *>(base + h.internal_offset);
+            level.internal_rank      = reinterpret_cast<const uint64_t *>(base + h.internal_rank_offset);
+            level.targets            = reinterpret_cast<const size_t *>(base + h.targets_offset);
+            level.target_bits        = h.target_bits;
+            level.prefix_suffix      = h.prefix_suffix;
+            level.prefix_suffix_text = reinterpret_cast<const Char *>(base + h.prefix_suffix_offset);
+        }
+    }
+
+    /**
+     * @brief Checks that the arrays described by the headers of a flat representation lie inside of it, that their
+     * sizes match the number of blocks on each level and that the top level covers the text. The ranks and the targets
+     * of the back blocks are checked as well, so that no query reads outside of the representation.
+     */
+    static auto is_consistent(const uint8_t *base, const size_t size) -> bool {
+        Header header;
+        std::memcpy(&header, base, sizeof(Header));
+        if (header.total_bytes != size || header.num_levels > (size - sizeof(Header)) / sizeof(LevelHeader)) {
+            return false;
+        }
+        const auto inside = [size](const uint64_t offset, const uint64_t bytes) {
+            return offset % sizeof(uint64_t) == 0 && offset <= size && bytes <= size - offset;
+        };
+        // Only the empty text has no levels
+        if ((header.num_levels == 0) != (header.source_length == 0) || (header.num_levels > 0 && header.arity < 2)) {
+            return false;
+        }
+        const auto *headers = reinterpret_cast<const LevelHeader *>(base + sizeof(Header));
+        if (header.num_levels > 0) {
+            const LevelHeader &top = headers[0];
+            if (top.block_length == 0 ||
+                top.num_blocks != header.source_length / top.block_length +
+                                      (header.source_length % top.block_length != 0)) {
+                return false;
+            }
+        }
+        // The number of internal blocks on the previous level, whose children are the blocks of the current level
+        uint64_t num_internal = 0;
+        for (size_t l = 0; l < header.num_levels; l++) {
+            const LevelHeader &h = headers[l];
+            if (h.internal_words > size / sizeof(uint64_t) || h.targets_words > size / sizeof(size_t) ||
+                !inside(h.internal_offset, h.internal_words * sizeof(uint64_t)) ||
+                !inside(h.internal_rank_offset, h.internal_words * sizeof(uint64_t)) ||
+                !inside(h.targets_offset, h.targets_words * sizeof(size_t)) ||
+                !inside(h.prefix_suffix_offset, h.prefix_suffix_bytes)) {
+                return false;
+            }
+            if (h.num_blocks == 0 || h.internal_words != (h.num_blocks + 63) / 64 || h.block_length == 0 ||
+                h.prefix_suffix > h.block_length / 2 || h.prefix_suffix > size || h.target_bits == 0 ||
+                h.target_bits > 64) {
+                return false;
+            }
+            if (l > 0 && (h.num_blocks / header.arity != num_internal || h.num_blocks % header.arity != 0 ||
+                          h.block_length != headers[l - 1].block_length / header.arity)) {
+                return false;
+            }
+
+            // The bits after the last block must not be set, so the ranks count only existing blocks
+            const auto *internal      = reinterpret_cast<const uint64_t *>(base + h.internal_offset);
+            const auto *internal_rank = reinterpret_cast<const uint64_t *>(base + h.internal_rank_offset);
+            if (h.num_blocks % 64 != 0 && (internal[h.internal_words - 1] >> (h.num_blocks % 64)) != 0) {
+                return false;
+            }
+            num_internal = 0;
+            for (size_t w = 0; w < h.internal_words; w++) {
+                if (internal_rank[w] != num_internal) {
+                    return false;
+                }
+                num_internal += std::popcount(internal[w]);
+            }
+
+            const uint64_t num_back = h.num_blocks - num_internal;
+            if (h.targets_words != word_packing::num_packs_required<size_t>(num_back, h.target_bits) ||
+                h.prefix_suffix_bytes != num_back * 2 * h.prefix_suffix * sizeof(Char)) {
+                return false;
+            }
+
+            // The source of a back block must lie inside of the level
+            if (h.block_length > std::numeric_limits<uint64_t>::max() / h.num_blocks) {
+                return false;
+            }
+            const uint64_t level_length = h.num_blocks * h.block_length;
+            const auto    *packed       = reinterpret_cast<const size_t *>(base + h.targets_offset);
+            const auto     targets      = word_packing::accessor(packed, h.target_bits);
+            for (size_t k = 0; k < num_back; k++) {
+                if (targets[k] > level_length - h.block_length) {
+                    return false;
+                }
+            }
+        }
+
+        // The leaves are the text of the internal blocks on the last level
+        if (header.num_levels == 0) {
+            return header.leaves_bytes == 0 && inside(header.leaves_offset, 0);
+        }
+        const uint64_t leaf_length = headers[header.num_levels - 1].block_length;
+        return header.leaves_bytes % (leaf_length * sizeof(Char)) == 0 &&
+               header.leaves_bytes / (leaf_length * sizeof(Char)) == num_internal &&
+               inside(header.leaves_offset, header.leaves_bytes);
+    }
+
+    /**
+     * @brief Builds one level from the start positions of its blocks in the padded text.
+     *
+     * @return The level and whether each block is internal
+     */
+    static auto build_level(const std::vector<Char>     &text,
+                            const size_t                 block_length,
+                            const std::vector<uint64_t> &starts,
+                            const BlockTreeParams       &params,
+                            const size_t                 chunk_size) -> std::pair<LevelData, std::vector<bool>> {
+        constexpr size_t NONE       = SIZE_MAX;
+        const size_t     num_blocks = starts.size();
+
+        // Pairs of blocks which are adjacent in the text
+        std::vector<uint64_t> pair_starts;
+        std::vector<size_t>   pair_of(num_blocks, NONE);
+        for (size_t i = 0; i + 1 < num_blocks; i++) {
+            if (starts[i + 1] == starts[i] + block_length) {
+                pair_of[i] = pair_starts.size();
+                pair_starts.push_back(starts[i]);
+            }
+        }
+
+        const auto *data           = text.data();
+        const auto  block_leftmost = detail::leftmost_occurrences(data, block_length, starts, chunk_size);
+        const auto  pair_leftmost  = detail::leftmost_occurrences(data, 2 * block_length, pair_starts, chunk_size);
+
+        const auto is_leftmost_pair = [&](const size_t i) {
+            return pair_of[i] != NONE && pair_leftmost[pair_of[i]] == starts[i];
+        };
+
+        std::vector<bool> is_internal(num_blocks);
+        for (size_t i = 0; i < num_blocks; i++) {
+            is_internal[i] =
+                block_leftmost[i] == starts[i] || is_leftmost_pair(i) || (i > 0 && is_leftmost_pair(i - 1));
+        }
+
+        LevelData level;
+        level.block_length  = block_length;
+        level.num_blocks    = num_blocks;
+        level.prefix_suffix = std::min(params.prefix_suffix, block_length / 2);
+        level.internal.resize((num_blocks + 63) / 64);
+        level.internal_rank.resize(level.internal.size());
+        for (size_t i = 0; i < num_blocks; i++) {
+            level.internal[i / 64] |= (uint64_t) is_internal[i] << (i % 64);
+        }
+        size_t rank = 0;
+        for (size_t w = 0; w < level.internal.size(); w++) {
+            level.internal_rank[w] = rank;
+            rank += std::popcount(level.internal[w]);
+        }
+
+        const size_t num_back     = num_blocks - rank;
+        const size_t ps           = level.prefix_suffix;
+        level.target_bits         = std::max<size_t>(std::bit_width(num_blocks * block_length), 1);
+        level.targets.resize(word_packing::num_packs_required<size_t>(num_back, level.target_bits));
+        level.prefix_suffix_text.resize(num_back * 2 * ps);
+        auto   targets = word_packing::accessor(level.targets.data(), level.target_bits);
+        size_t back    = 0;
+        for (size_t i = 0; i < num_blocks; i++) {
+            if (is_internal[i]) {
+                continue;
+            }
+            const uint64_t source = block_leftmost[i];
+            const size_t   j      = std::upper_bound(starts.begin(), starts.end(), source) - starts.begin() - 1;
+            targets[back]         = j * block_length + (source - starts[j]);
+
+            Char *ps_text = level.prefix_suffix_text.data() + back * 2 * ps;
+            std::copy_n(text.data() + starts[i], ps, ps_text);
+            std::copy_n(text.data() + starts[i] + block_length - ps, ps, ps_text + ps);
+            back++;
+        }
+
+        return {std::move(level), std::move(is_internal)};
+    }
+
+    /**
+     * @brief A part of a block which still has to be written to the output.
+     */
+    struct ExtractTask {
+        size_t level;
+        size_t block;
+        size_t offset;
+        size_t len;
+    };
+
+    /**
+     * @brief Pushes the parts of consecutive blocks of a level which cover a range onto the stack, from right to left.
+     *
+     * @param first_block The index of the block the range is relative to
+     * @param length The length of the blocks on the level
+     * @param offset The start of the range relative to the start of `first_block`
+     */
+    static void push_children(std::vector<ExtractTask> &tasks,
+                              const size_t              level,
+                              const size_t              first_block,
+                              const size_t              length,
+                              const size_t              offset,
+                              const size_t              len) {
+        const size_t first = offset / length;
+        const size_t last  = (offset + len - 1) / length;
+        for (size_t i = last + 1; i-- > first;) {
+            const size_t from = std::max(offset, i * length) - i * length;
+            const size_t to   = std::min(offset + len, (i + 1) * length) - i * length;
+            tasks.push_back({level, first_block + i, from, to - from});
+        }
+    }
+
+    static inline auto copy_text(const Char *text, const size_t len, char *out) -> char * {
+        std::memcpy(out, text, len);
+        return out + len;
+    }
+
+  public:
+    BlockTree(BlockTree &&other) noexcept = default;
+
+    /**
+     * @brief Builds a block tree of a text.
+     *
+     * Each level is built from the one above it. The occurrences of the blocks of a level are searched for in
+     * parallel, split at the boundaries of the top level blocks.
+     */
+    template<PhaseObserver Phases = NoPhases>
+    static auto from_text(const Char *text, const size_t n, const BlockTreeParams &params, Phases &&phases = {})
+        -> BlockTree {
+        if (params.arity < 2 || params.root_arity < 1 || params.leaf_length < 1) {
+            throw std::invalid_argument("block trees need an arity of at least 2, a root arity of at least 1 and a "
+                                        "leaf length of at least 1");
+        }
+
+        BlockTree tree;
+        tree.m_source_length = n;
+        tree.m_params        = params;
+        std::vector<LevelData> levels;
+        std::vector<Char>      leaves;
+        if (n == 0) {
+            tree.flatten(levels, leaves);
+            return tree;
+        }
+
+        phases.phase("levels");
+        size_t top_length = params.leaf_length;
+        while ((n + top_length - 1) / top_length > params.root_arity) {
+            top_length *= params.arity;
+        }
+        const size_t num_top = (n + top_length - 1) / top_length;
+
+        // The text is padded to whole top level blocks. Positions after the text are never accessed.
+        std::vector<Char> padded(num_top * top_length);
+        std::copy_n(text, n, padded.begin());
+
+        std::vector<uint64_t> starts(num_top);
+        for (size_t i = 0; i < num_top; i++) {
+            starts[i] = i * top_length;
+        }
+
+        for (size_t block_length = top_length;; block_length /= params.arity) {
+            auto [level, is_internal] = build_level(padded, block_length, starts, params, top_length);
+            levels.push_back(std::move(level));
+
+            std::vector<uint64_t> next_starts;
+            if (block_length == params.leaf_length) {
+                phases.phase("leaves");
+                for (size_t i = 0; i < starts.size(); i++) {
+                    if (is_internal[i]) {
+                        const auto *block = padded.data() + starts[i];
+                        leaves.insert(leaves.end(), block, block + block_length);
+                    }
+                }
+                break;
+            }
+
+            const size_t child_length = block_length / params.arity;
+            for (size_t i = 0; i < starts.size(); i++) {
+                if (is_internal[i]) {
+                    for (size_t c = 0; c < params.arity; c++) {
+                        next_starts.push_back(starts[i] + c * child_length);
+                    }
+                }
+            }
+            starts = std::move(next_starts);
+        }
+
+        tree.flatten(levels, leaves);
+        return tree;
+    }
+
+    /**
+     * @brief Builds the block tree of the text in a file or loads it if the file is a saved block tree.
+     */
+    template<PhaseObserver Phases = NoPhases>
+    static auto from_file(const std::string &path, const BlockTreeParams &params = {}, Phases &&phases = {})
+        -> BlockTree {
+        if (is_index_file(path)) {
+            phases.phase("load");
+            return load(path);
+        }
+
+        phases.phase("read");
+        std::ifstream stream(path, std::ios::binary);
+        std::noskipws(stream);
+        std::vector<Char> input((std::istream_iterator<Char>(stream)), std::istream_iterator<Char>());
+        return from_text(input.data(), input.size(), params, std::forward<Phases>(phases));
+    }
+
+    [[nodiscard]] auto at(const size_t i) const -> char {
+        size_t level  = 0;
+        size_t length = m_levels[0].block_length;
+        size_t block  = i / length;
+        size_t offset = i % length;
+        while (true) {
+            const Level &lv = m_levels[level];
+            if (lv.is_internal(block)) {
+                const size_t rank = lv.internal_before(block);
+                if (level + 1 == m_levels.size()) {
+                    return (char) m_leaves[rank * length + offset];
+                }
+                length /= m_params.arity;
+                block = rank * m_params.arity + offset / length;
+                offset %= length;
+                level++;
+            } else {
+                const size_t back = block - lv.internal_before(block);
+                const size_t ps   = lv.prefix_suffix;
+                if (offset < ps) {
+                    return (char) lv.prefix_suffix_text[back * 2 * ps + offset];
+                }
+                if (offset >= length - ps) {
+                    return (char) lv.prefix_suffix_text[back * 2 * ps + ps + offset - (length - ps)];
+                }
+                // The source starts in an internal block and may continue in the next one
+                const size_t target = lv.target(back);
+                block               = target / length;
+                offset += target % length;
+                if (offset >= length) {
+                    block++;
+                    offset -= length;
+                }
+            }
+        }
+    }
+
+    /**
+     * @brief Writes the substring starting at `substr_start` with length `substr_len` (or until the end of the text)
+     * to the buffer.
+     *
+     * Instead of accessing each character from the top level, the substring is extracted block by block. The parts of
+     * blocks which are still to be extracted are kept on a stack with the leftmost part on top, so the output is
+     * written from left to right. The back pointer of a back block is resolved once for the whole part of the block in
+     * the substring, and the text of adjacent leaves is copied at once.
+     *
+     * @return A pointer to the character after the last one written
+     */
+    auto substr(char *buf, const size_t substr_start, const size_t substr_len) const -> char * {
+        const size_t substr_end = std::min(substr_start + substr_len, m_source_length);
+        if (substr_start >= substr_end) {
+            return buf;
+        }
+
+        thread_local std::vector<ExtractTask> tasks;
+        tasks.clear();
+        push_children(tasks, 0, 0, m_levels[0].block_length, substr_start, substr_end - substr_start);
+
+        const size_t leaf_level = m_levels.size() - 1;
+        char        *out        = buf;
+        while (!tasks.empty()) {
+            const auto [level, block, offset, len] = tasks.back();
+            tasks.pop_back();
+
+            const Level &lv     = m_levels[level];
+            const size_t length = lv.block_length;
+            if (lv.is_internal(block)) {
+                const size_t rank = lv.internal_before(block);
+                if (level == leaf_level) {
+                    out = copy_text(m_leaves + rank * length + offset, len, out);
+                    continue;
+                }
+
+                const size_t first_child = rank * m_params.arity;
+                if (level + 1 == leaf_level) {
+                    // If all leaves in the range are internal, their text is stored contiguously
+                    const Level &leaves     = m_levels[leaf_level];
+                    const size_t leaf_len   = leaves.block_length;
+                    const size_t first_leaf = first_child + offset / leaf_len;
+                    const size_t last_leaf  = first_child + (offset + len - 1) / leaf_len;
+                    const size_t leaf_rank  = leaves.internal_before(first_leaf);
+                    // The last leaf may be the last block of the level, so the rank after it is not looked up directly
+                    const size_t internal_leaves =
+                        leaves.internal_before(last_leaf) + leaves.is_internal(last_leaf) - leaf_rank;
+                    if (internal_leaves == last_leaf - first_leaf + 1) {
+                        const Char *text = m_leaves + leaf_rank * leaf_len + offset % leaf_len;
+                        out              = copy_text(text, len, out);
+                        continue;
+                    }
+                }
+                push_children(tasks, level + 1, first_child, length / m_params.arity, offset, len);
+                continue;
+            }
+
+            const size_t back    = block - lv.internal_before(block);
+            const size_t ps      = lv.prefix_suffix;
+            const Char  *ps_text = lv.prefix_suffix_text + back * 2 * ps;
+            if (offset + len <= ps) {
+                out = copy_text(ps_text + offset, len, out);
+                continue;
+            }
+            if (offset >= length - ps) {
+                out = copy_text(ps_text + ps + offset - (length - ps), len, out);
+                continue;
+            }
+
+            // The source starts in an internal block and may continue in the next one
+            const size_t target = lv.target(back);
+            push_children(tasks, level, target / length, length, target % length + offset, len);
+        }
+        return out;
+    }
+
+    [[nodiscard]] inline auto source_length() const -> size_t { return m_source_length; }
+
+    [[nodiscard]] inline auto params() const -> const BlockTreeParams & { return m_params; }
+
+    [[nodiscard]] inline auto num_levels() const -> size_t { return m_levels.size(); }
+
+    /**
+     * @brief Returns the size of the mapped file if the tree was loaded from one and 0 otherwise.
+     */
+    [[nodiscard]] inline auto mapped_bytes() const -> size_t { return m_mapping.size(); }
+
+    /**
+     * @brief Writes the flat representation of the block tree to a file, from which it can be loaded with `load`.
+     */
+    void save(const std::string &path) const {
+        const auto [data, size] = representation();
+        std::ofstream out(path, std::ios::binary);
+        out.write(reinterpret_cast<const char *>(data), (std::streamsize) size);
+        if (!out) {
+            throw std::runtime_error("could not write block tree to " + path);
+        }
+    }
+
+    /**
+     * @brief Loads a block tree written by `save`.
+     *
+     * The file is mapped into memory and queried in place, so loading takes constant time and the tree is only read
+     * from disk as far as queries touch it. Processes loading the same file share its pages in the page cache.
+     */
+    static auto load(const std::string &path) -> BlockTree {
+        MappedFile mapping = MappedFile::open(path);
+        if (mapping.size() < sizeof(Header)) {
+            throw std::runtime_error("block tree in " + path + " is truncated");
+        }
+        uint64_t magic;
+        std::memcpy(&magic, mapping.data(), sizeof(magic));
+        if (magic != INDEX_MAGIC) {
+            throw std::runtime_error("not a gracli block tree file");
+        }
+        if (!is_consistent(mapping.data(), mapping.size())) {
+            throw std::runtime_error("block tree in " + path + " is truncated or corrupt");
+        }
+        // Queries jump between levels, so reading ahead would mostly load pages that are never used
+        mapping.advise(MADV_RANDOM);
+
+        BlockTree tree;
+        tree.m_mapping = std::move(mapping);
+        tree.attach(tree.m_mapping.data());
+        return tree;
+    }
+
+    /**
+     * @brief Returns whether the file starts with the magic number of a saved block tree.
+     */
+    static auto is_index_file(const std::string &path) -> bool {
+        std::ifstream in(path, std::ios::binary);
+        return read_value<uint64_t>(in) == INDEX_MAGIC && in;
+    }
+};
+
+} // namespace gracli::bt
@@ -0,0 +1,367 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <iterator>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include <compressed_blocks/lz_block_codec.hpp>
+#include <concepts.hpp>
+#include <util/construction_phases.hpp>
+#include <util/serialization.hpp>
+
+namespace gracli::cb {
+
+/**
+ * @brief A cache of decoded blocks in which each block has a fixed slot (the block index modulo the number of slots).
+ *
+ * It also counts how many lookups were answered from it. It is not thread safe.
+ */
+class DecodedBlockCache {
+    size_t               m_block_size;
+    std::vector<uint8_t> m_text;
+    /**
+     * @brief For each slot the block stored in it or `SIZE_MAX` if the slot is empty
+     */
+    std::vector<size_t> m_block;
+
+    size_t m_hits;
+    size_t m_misses;
+
+  public:
+    /**
+     * @param block_size The size of a decoded block
+     * @param num_slots The number of blocks the cache can hold. At least one block is cached.
+     */
+    DecodedBlockCache(const size_t block_size, const size_t num_slots) :
+        m_block_size{block_size},
+        m_text(std::max<size_t>(num_slots, 1) * block_size),
+        m_block(std::max<size_t>(num_slots, 1), SIZE_MAX),
+        m_hits{0},
+        m_misses{0} {}
+
+    /**
+     * @brief Returns the slot of the given block and whether the block is already in it. If it is not, the caller must
+     * decode the block into the slot.
+     */
+    auto lookup(const size_t block) -> std::pair<uint8_t *, bool> {
+        const size_t slot = block % m_block.size();
+        uint8_t     *text = m_text.data() + slot * m_block_size;
+        if (m_block[slot] == block) {
+            m_hits++;
+            return {text, true};
+        }
+        m_misses++;
+        m_block[slot] = block;
+        return {text, false};
+    }
+
+    /**
+     * @brief Empties the slot of a block which could not be decoded into it.
+     */
+    void invalidate(const size_t block) {
+        if (m_block[block % m_block.size()] == block) {
+            m_block[block % m_block.size()] = SIZE_MAX;
+        }
+    }
+
+    /**
+     * @brief Resets the hit and miss counters but keeps the cached blocks.
+     */
+    void reset_counters() {
+        m_hits   = 0;
+        m_misses = 0;
+    }
+
+    [[nodiscard]] inline auto hits() const -> size_t { return m_hits; }
+
+    [[nodiscard]] inline auto misses() const -> size_t { return m_misses; }
+
+    /**
+     * @brief Returns the fraction of lookups answered from the cache or 0 if there were none.
+     */
+    [[nodiscard]] inline auto hit_rate() const -> double {
+        const size_t lookups = m_hits + m_misses;
+        return lookups == 0 ? 0.0 : (double) m_hits / (double) lookups;
+    }
+
+    [[nodiscard]] auto size_in_bytes() const -> size_t {
+        return m_text.capacity() + m_block.capacity() * sizeof(size_t);
+    }
+};
+
+/**
+ * @brief A text stored as independently compressed blocks of fixed size, like the output of a general purpose
+ * compressor with a seek table.
+ *
+ * Each block of `block_size` characters is compressed with `LzBlockCodec`, and a table holds the offset of each
+ * compressed block. A block which does not get smaller is stored uncompressed. Queries decode only the blocks they
+ * touch. Decoded blocks are kept in a small `DecodedBlockCache` if it is enabled. Otherwise each thread keeps the last
+ * block it decoded, so consecutive queries into the same block decode it only once, and the queries are thread safe.
+ */
+class CompressedBlocks {
+  public:
+    using Char = uint8_t;
+
+    /**
+     * @brief The magic number at the start of a saved file ("GRLCBLKS" in little endian)
+     */
+    static constexpr uint64_t INDEX_MAGIC = 0x534b'4c42'434c'5247;
+
+    static constexpr size_t DEFAULT_BLOCK_SIZE = 16 * 1024;
+
+  private:
+    size_t m_source_length;
+    size_t m_block_size;
+    /**
+     * @brief The start of each compressed block in `m_data` and the end of the last one
+     */
+    std::vector<uint64_t> m_offsets;
+    std::vector<Char>     m_data;
+    /**
+     * @brief The cache of decoded blocks or nullptr if caching is disabled (see `enable_cache`). Queries fill the
+     * cache, so it is mutable.
+     */
+    mutable std::unique_ptr<DecodedBlockCache> m_cache;
+    /**
+     * @brief Identifies this instance in the last decoded block of each thread (see `decoded`)
+     */
+    uint64_t m_id;
+
+    /**
+     * @brief The block a thread decoded last without a cache and the instance it belongs to
+     */
+    struct LastBlock {
+        uint64_t          owner = 0;
+        size_t            block = SIZE_MAX;
+        std::vector<Char> text;
+    };
+
+    static auto next_id() -> uint64_t {
+        static std::atomic<uint64_t> id{1};
+        return id.fetch_add(1, std::memory_order_relaxed);
+    }
+
+    CompressedBlocks() : m_source_length{0}, m_block_size{DEFAULT_BLOCK_SIZE}, m_id{next_id()} {}
+
+    [[nodiscard]] inline auto decoded_length(const size_t block) const -> size_t {
+        return std::min(m_block_size, m_source_length - block * m_block_size);
+    }
+
+    /**
+     * @brief Decodes a block into the given buffer, which must hold `decoded_length(block)` characters.
+     */
+    void decode(const size_t block, Char *out) const {
+        const size_t len        = decoded_length(block);
+        const size_t stored_len = m_offsets[block + 1] - m_offsets[block];
+        const Char  *stored     = m_data.data() + m_offsets[block];
+        if (stored_len == len) {
+            std::memcpy(out, stored, len);
+        } else {
+            LzBlockCodec::decompress(stored, stored_len, out, len);
+        }
+    }
+
+    /**
+     * @brief Returns a pointer to the decoded text of a block, decoding it if necessary.
+     */
+    auto decoded(const size_t block) const -> const Char * {
+        if (m_cache) {
+            const auto [text, cached] = m_cache->lookup(block);
+            if (!cached) {
+                try {
+                    decode(block, text);
+                } catch (...) {
+                    m_cache->invalidate(block);
+                    throw;
+                }
+            }
+            return text;
+        }
+        thread_local LastBlock last;
+        if (last.owner != m_id || last.block != block) {
+            last.text.resize(m_block_size);
+            // If decoding fails, the buffer holds no block
+            last.block = SIZE_MAX;
+            decode(block, last.text.data());
+            last.owner = m_id;
+            last.block = block;
+        }
+        return last.text.data();
+    }
+
+  public:
+    CompressedBlocks(CompressedBlocks &&other) noexcept = default;
+
+    /**
+     * @brief Compresses a text. The blocks are compressed in parallel.
+     *
+     * @param block_size The number of characters per block, at most `LzBlockCodec::MAX_BLOCK_SIZE`
+     */
+    static auto from_text(const Char *text, const size_t n, const size_t block_size = DEFAULT_BLOCK_SIZE)
+        -> CompressedBlocks {
+        if (block_size == 0 || block_size > LzBlockCodec::MAX_BLOCK_SIZE) {
+            throw std::invalid_argument("the block size must be between 1 and 65536");
+        }
+
+        CompressedBlocks cb;
+        cb.m_source_length = n;
+        cb.m_block_size    = block_size;
+
+        const size_t                      num_blocks = (n + block_size - 1) / block_size;
+        std::vector<std::vector<uint8_t>> compressed(num_blocks);
+#pragma omp parallel for schedule(dynamic, 16)
+        for (size_t b = 0; b < num_blocks; b++) {
+            const size_t len = cb.decoded_length(b);
+            LzBlockCodec::compress(text + b * block_size, len, compressed[b]);
+            if (compressed[b].size() >= len) {
+                compressed[b].assign(text + b * block_size, text + b * block_size + len);
+            }
+        }
+
+        cb.m_offsets.resize(num_blocks + 1);
+        for (size_t b = 0; b < num_blocks; b++) {
+            cb.m_offsets[b + 1] = cb.m_offsets[b] + compressed[b].size();
+        }
+        cb.m_data.resize(cb.m_offsets[num_blocks]);
+#pragma omp parallel for schedule(static)
+        for (size_t b = 0; b < num_blocks; b++) {
+            std::copy(compressed[b].begin(), compressed[b].end(), cb.m_data.begin() + cb.m_offsets[b]);
+        }
+        return cb;
+    }
+
+    /**
+     * @brief Compresses the text in a file or loads it if the file was written by `save`.
+     */
+    template<PhaseObserver Phases = NoPhases>
+    static auto from_file(const std::string &path, const size_t block_size = DEFAULT_BLOCK_SIZE, Phases &&phases = {})
+        -> CompressedBlocks {
+        if (is_index_file(path)) {
+            phases.phase("load");
+            return load(path);
+        }
+
+        phases.phase("read");
+        std::ifstream stream(path, std::ios::binary);
+        std::noskipws(stream);
+        std::vector<Char> input((std::istream_iterator<Char>(stream)), std::istream_iterator<Char>());
+        phases.phase("compress");
+        return from_text(input.data(), input.size(), block_size);
+    }
+
+    /**
+     * @brief Enables the cache of decoded blocks instead of keeping the last decoded block of each thread. While it is
+     * enabled, queries are not thread safe.
+     *
+     * @param num_blocks The number of decoded blocks the cache holds, or 0 to disable it
+     */
+    void enable_cache(const size_t num_blocks) {
+        if (num_blocks == 0) {
+            m_cache.reset();
+        } else {
+            m_cache = std::make_unique<DecodedBlockCache>(m_block_size, num_blocks);
+        }
+    }
+
+    [[nodiscard]] inline auto cache() const -> DecodedBlockCache * { return m_cache.get(); }
+
+    [[nodiscard]] auto at(const size_t i) const -> char {
+        return (char) decoded(i / m_block_size)[i % m_block_size];
+    }
+
+    /**
+     * @brief Writes the substring starting at `substr_start` with length `substr_len` (or until the end of the text)
+     * to the buffer. Blocks which are completely inside the substring are decoded directly into the buffer.
+     *
+     * @return A pointer to the character after the last one written
+     */
+    auto substr(char *buf, const size_t substr_start, const size_t substr_len) const -> char * {
+        const size_t substr_end = std::min(substr_start + substr_len, m_source_length);
+        char        *out        = buf;
+        for (size_t pos = substr_start; pos < substr_end;) {
+            const size_t block  = pos / m_block_size;
+            const size_t offset = pos % m_block_size;
+            const size_t len    = std::min(decoded_length(block) - offset, substr_end - pos);
+            if (offset == 0 && len == decoded_length(block) && !m_cache) {
+                decode(block, reinterpret_cast<Char *>(out));
+            } else {
+                std::memcpy(out, decoded(block) + offset, len);
+            }
+            out += len;
+            pos += len;
+        }
+        return out;
+    }
+
+    [[nodiscard]] inline auto source_length() const -> size_t { return m_source_length; }
+
+    [[nodiscard]] inline auto block_size() const -> size_t { return m_block_size; }
+
+    [[nodiscard]] inline auto num_blocks() const -> size_t { return m_offsets.size() - 1; }
+
+    /**
+     * @brief Returns the number of bytes of the compressed blocks.
+     */
+    [[nodiscard]] inline auto compressed_size() const -> size_t { return m_data.size(); }
+
+    /**
+     * @brief Writes the compressed blocks to a file, from which they can be loaded with `load`.
+     */
+    void save(const std::string &path) const {
+        std::ofstream out(path, std::ios::binary);
+        write_magic(out, INDEX_MAGIC);
+        write_value<uint64_t>(out, m_source_length);
+        write_value<uint64_t>(out, m_block_size);
+        write_vector(out, m_offsets);
+        write_vector(out, m_data);
+        if (!out) {
+            throw std::runtime_error("could not write compressed blocks to " + path);
+        }
+    }
+
+    /**
+     * @brief Loads compressed blocks written by `save`.
+     */
+    static auto load(const std::string &path) -> CompressedBlocks {
+        std::ifstream in(path, std::ios::binary);
+        expect_magic(in, INDEX_MAGIC, "gracli compressed blocks");
+
+        CompressedBlocks cb;
+        cb.m_source_length = read_value<uint64_t>(in);
+        cb.m_block_size    = read_value<uint64_t>(in);
+        read_vector(in, cb.m_offsets);
+        read_vector(in, cb.m_data);
+        if (!in || cb.m_block_size == 0 || cb.m_block_size > LzBlockCodec::MAX_BLOCK_SIZE ||
+            cb.m_offsets.size() != (cb.m_source_length + cb.m_block_size - 1) / cb.m_block_size + 1 ||
+            cb.m_offsets.front() != 0 || cb.m_offsets.back() != cb.m_data.size()) {
+            throw std::runtime_error("compressed blocks in " + path + " are truncated or corrupt");
+        }
+        // A block is never stored larger than its text, so each block lies inside of the data
+        for (size_t b = 0; b + 1 < cb.m_offsets.size(); b++) {
+            if (cb.m_offsets[b + 1] < cb.m_offsets[b] ||
+                cb.m_offsets[b + 1] - cb.m_offsets[b] > cb.decoded_length(b)) {
+                throw std::runtime_error("compressed blocks in " + path + " have invalid block offsets");
+            }
+        }
+        return cb;
+    }
+
+    /**
+     * @brief Returns whether the file starts with the magic number of saved compressed blocks.
+     */
+    static auto is_index_file(const std::string &path) -> bool {
+        std::ifstream in(path, std::ios::binary);
+        return read_value<uint64_t>(in) == INDEX_MAGIC && in;
+    }
+};
+
+} // namespace gracli::cb
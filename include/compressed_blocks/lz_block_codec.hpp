@@ -0,0 +1,174 @@
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <stdexcept>
+#include <vector>
+
+namespace gracli::cb {
+
+/**
+ * @brief A byte-oriented LZ77 codec for blocks of at most `MAX_BLOCK_SIZE` bytes in the style of LZ4.
+ *
+ * A block is encoded as a sequence of tokens. Each token is a byte whose high nibble is the number of literals and
+ * whose low nibble is the length of the following match minus `MIN_MATCH`. A nibble of 15 is continued by bytes which
+ * are added to it until a byte is less than 255. The token is followed by the literals and a 2 byte little endian
+ * offset of the match. The last token of a block has no match and no offset.
+ *
+ * Matches are found greedily with a hash table of the last position of each 4 byte string, so compression is fast and
+ * decompression only copies bytes.
+ */
+class LzBlockCodec {
+  public:
+    /**
+     * @brief The maximum size of a block, so that match offsets fit in 2 bytes
+     */
+    static constexpr size_t MAX_BLOCK_SIZE = 1 << 16;
+    static constexpr size_t MIN_MATCH      = 4;
+
+  private:
+    static constexpr size_t HASH_BITS = 14;
+    static constexpr size_t NIBBLE    = 15;
+
+    static inline auto hash(const uint8_t *p) -> uint32_t {
+        uint32_t v;
+        std::memcpy(&v, p, sizeof(v));
+        return (v * 2654435761U) >> (32 - HASH_BITS);
+    }
+
+    static void write_length(std::vector<uint8_t> &out, size_t len) {
+        for (; len >= 255; len -= 255) {
+            out.push_back(255);
+        }
+        out.push_back((uint8_t) len);
+    }
+
+    static void write_sequence(std::vector<uint8_t> &out,
+                               const uint8_t        *literals,
+                               const size_t          num_literals,
+                               const size_t          match_len,
+                               const size_t          offset) {
+        const size_t lit_nibble   = std::min(num_literals, NIBBLE);
+        const size_t match_nibble = match_len == 0 ? 0 : std::min(match_len - MIN_MATCH, NIBBLE);
+        out.push_back((uint8_t) (lit_nibble << 4 | match_nibble));
+        if (lit_nibble == NIBBLE) {
+            write_length(out, num_literals - NIBBLE);
+        }
+        out.insert(out.end(), literals, literals + num_literals);
+        if (match_len == 0) {
+            return;
+        }
+        out.push_back((uint8_t) offset);
+        out.push_back((uint8_t) (offset >> 8));
+        if (match_nibble == NIBBLE) {
+            write_length(out, match_len - MIN_MATCH - NIBBLE);
+        }
+    }
+
+    static inline auto read_length(const uint8_t *&in, const uint8_t *end, size_t len) -> size_t {
+        if (len != NIBBLE) {
+            return len;
+        }
+        uint8_t b;
+        do {
+            if (in >= end) {
+                throw std::runtime_error("compressed block is truncated");
+            }
+            b = *in++;
+            len += b;
+        } while (b == 255);
+        return len;
+    }
+
+  public:
+    /**
+     * @brief Appends the encoding of a block to `out`.
+     *
+     * @param in The block
+     * @param len The length of the block, which must be at most `MAX_BLOCK_SIZE`
+     */
+    static void compress(const uint8_t *in, const size_t len, std::vector<uint8_t> &out) {
+        if (len > MAX_BLOCK_SIZE) {
+            throw std::invalid_argument("blocks must have at most 65536 bytes");
+        }
+        // Positions are stored plus one, so that 0 means empty
+        std::vector<uint32_t> table(1 << HASH_BITS, 0);
+
+        size_t anchor = 0;
+        size_t pos    = 0;
+        while (pos + MIN_MATCH <= len) {
+            const uint32_t h         = hash(in + pos);
+            const size_t   candidate = table[h];
+            table[h]                 = (uint32_t) pos + 1;
+            if (candidate == 0 || pos - (candidate - 1) >= MAX_BLOCK_SIZE ||
+                std::memcmp(in + candidate - 1, in + pos, MIN_MATCH) != 0) {
+                pos++;
+                continue;
+            }
+
+            const size_t source    = candidate - 1;
+            size_t       match_len = MIN_MATCH;
+            while (pos + match_len < len && in[source + match_len] == in[pos + match_len]) {
+                match_len++;
+            }
+            write_sequence(out, in + anchor, pos - anchor, match_len, pos - source);
+            pos += match_len;
+            anchor = pos;
+        }
+        write_sequence(out, in + anchor, len - anchor, 0, 0);
+    }
+
+    /**
+     * @brief Decodes a block encoded by `compress`. Throws a `std::runtime_error` if the encoding is corrupt.
+     *
+     * @param in The encoding
+     * @param in_len The length of the encoding in bytes
+     * @param out The output of `out_len` bytes, the length of the decoded block
+     */
+    static void decompress(const uint8_t *in, const size_t in_len, uint8_t *out, const size_t out_len) {
+        const uint8_t *end     = in + in_len;
+        uint8_t       *op      = out;
+        uint8_t *const out_end = out + out_len;
+        while (in < end) {
+            const uint8_t token = *in++;
+
+            const size_t num_literals = read_length(in, end, token >> 4);
+            if (num_literals > (size_t) (end - in) || num_literals > (size_t) (out_end - op)) {
+                throw std::runtime_error("compressed block is corrupt");
+            }
+            std::memcpy(op, in, num_literals);
+            op += num_literals;
+            in += num_literals;
+            if (in == end) {
+                break;
+            }
+
+            if (end - in < 2) {
+                throw std::runtime_error("compressed block is truncated");
+            }
+            const size_t offset = in[0] | (size_t) in[1] << 8;
+            in += 2;
+            const size_t match_len = read_length(in, end, token & NIBBLE) + MIN_MATCH;
+            if (offset == 0 || offset > (size_t) (op - out) || match_len > (size_t) (out_end - op)) {
+                throw std::runtime_error("compressed block is corrupt");
+            }
+            // The source may overlap the output, so the match is copied byte by byte unless it is far enough away
+            const uint8_t *source = op - offset;
+            if (offset >= match_len) {
+                std::memcpy(op, source, match_len);
+            } else {
+                for (size_t i = 0; i < match_len; i++) {
+                    op[i] = source[i];
+                }
+            }
+            op += match_len;
+        }
+        if (op != out_end) {
+            throw std::runtime_error("compressed block has the wrong length");
+        }
+    }
+};
+
+} // namespace gracli::cb
@@ -2,7 +2,10 @@
 
 #include <concepts>
 #include <cstddef>
+#include <cstdint>
 #include <string>
+#include <string_view>
+#include <vector>
 
 namespace gracli {
 
@@ -27,4 +30,50 @@ concept SourceLength = requires(T ds) {
                        };
 template<typename T>
 concept RandomAccess = CharRandomAccess<T> && Substring<T> && SourceLength<T>;
+
+/**
+ * @brief A data structure whose queries are const, so one instance can be queried by several threads at once.
+ */
+template<typename T>
+concept ConcurrentQueries = requires(const T ds, char *ptr, size_t i) {
+                                { ds.at(i) } -> std::convertible_to<char>;
+                                { ds.substr(ptr, i, i) } -> std::convertible_to<char *>;
+                            };
+
+/**
+ * @brief A data structure which counts and locates the occurrences of a pattern in its text.
+ */
+template<typename T>
+concept PatternQueries = requires(const T ds, std::string_view pattern) {
+                             { ds.count(pattern) } -> std::convertible_to<size_t>;
+                             { ds.locate(pattern) } -> std::convertible_to<std::vector<size_t>>;
+                         };
+
+/**
+ * @brief A data structure which answers longest common extension queries, i.e. the length of the longest common prefix
+ * of the suffixes of its text starting at two positions.
+ */
+template<typename T>
+concept LongestCommonExtension = requires(const T ds, size_t i) {
+                                     { ds.lce(i, i) } -> std::convertible_to<size_t>;
+                                 };
+
+/**
+ * @brief A data structure which counts the occurrences of a character before a position (rank) and finds the position
+ * of the k-th occurrence of a character (select).
+ */
+template<typename T>
+concept CharRankSelect = requires(const T ds, uint8_t c, size_t i) {
+                             { ds.rank(c, i) } -> std::convertible_to<size_t>;
+                             { ds.select(c, i) } -> std::convertible_to<size_t>;
+                         };
+
+/**
+ * @brief An observer that is notified whenever a data structure enters a new phase of its construction.
+ * A phase lasts until the next phase starts or until the construction is finished.
+ */
+template<typename T>
+concept PhaseObserver = requires(T obs, const char *name) {
+                            { obs.phase(name) };
+                        };
 } // namespace gracli
@@ -0,0 +1,91 @@
+#pragma once
+
+#include <algorithm>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <stdexcept>
+#include <vector>
+
+#include <omp.h>
+
+#include <concepts.hpp>
+
+namespace gracli {
+
+/**
+ * @brief A query in a batch. It is a random access if `length` is 0 and a substring query otherwise.
+ */
+struct BatchRequest {
+    size_t position;
+    size_t length;
+};
+
+/**
+ * @brief Runs batches of queries on a data structure with a fixed number of queries in flight.
+ *
+ * Synchronous reads like `pread` keep only one request per thread outstanding, so a single thread leaves a fast device
+ * mostly idle. The batch is served by `queue_depth` threads instead, each of which takes the next request as soon as
+ * its previous one has finished. At most `queue_depth` reads are therefore outstanding at any time, like with an
+ * asynchronous submission queue of that depth. The latency of each request is measured from the start of its query to
+ * its completion.
+ *
+ * @tparam DS A data structure whose queries may be run by several threads at once
+ */
+template<ConcurrentQueries DS>
+class BatchReader {
+    const DS *m_ds;
+    size_t    m_queue_depth;
+
+  public:
+    /**
+     * @param ds The data structure to query. It must outlive the reader.
+     * @param queue_depth The maximum number of queries in flight
+     */
+    BatchReader(const DS &ds, const size_t queue_depth) : m_ds{&ds}, m_queue_depth{queue_depth} {
+        if (queue_depth == 0) {
+            throw std::invalid_argument("the queue depth must be at least 1");
+        }
+    }
+
+    [[nodiscard]] inline auto queue_depth() const -> size_t { return m_queue_depth; }
+
+    /**
+     * @brief Runs all requests of a batch and returns when all of them have completed.
+     *
+     * @param requests The requests in order of submission
+     * @param latencies Is resized to the number of requests and set to the latency of each request in nanoseconds
+     * @return The sum of the first character of each result, so the queries are not optimized away
+     */
+    auto run(const std::vector<BatchRequest> &requests, std::vector<double> &latencies) const -> size_t {
+        using Clock = std::chrono::steady_clock;
+
+        size_t max_length = 0;
+        for (const BatchRequest &request : requests) {
+            max_length = std::max(max_length, request.length);
+        }
+        latencies.resize(requests.size());
+
+        size_t c = 0;
+#pragma omp parallel num_threads(m_queue_depth) reduction(+ : c) if (m_queue_depth > 1)
+        {
+            std::vector<char> buf(max_length + 1);
+#pragma omp for schedule(dynamic, 1)
+            for (size_t r = 0; r < requests.size(); r++) {
+                const BatchRequest &request = requests[r];
+                const auto          begin   = Clock::now();
+                if (request.length == 0) {
+                    c += m_ds->at(request.position);
+                } else {
+                    m_ds->substr(buf.data(), request.position, request.length);
+                    c += buf[0];
+                }
+                latencies[r] = (double) std::chrono::duration_cast<std::chrono::nanoseconds>(Clock::now() - begin)
+                                   .count();
+            }
+        }
+        return c;
+    }
+};
+
+} // namespace gracli
@@ -1,38 +1,339 @@
 #pragma once
 
-#include <fcntl.h>
+#include <algorithm>
+#include <cerrno>
+#include <cstddef>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <memory>
+#include <mutex>
+#include <stdexcept>
 #include <string>
+#include <utility>
+#include <vector>
+
+#include <fcntl.h>
+#include <sys/mman.h>
 #include <unistd.h>
 
+#include <util/mapped_file.hpp>
+
 namespace gracli {
 
+/**
+ * @brief How `FileAccess` reads the file.
+ */
+enum class FileAccessMode : uint8_t {
+    /**
+     * @brief One pread syscall per query, served from the page cache
+     */
+    Pread,
+    /**
+     * @brief The file is memory-mapped and queries read the mapping
+     */
+    Mmap,
+    /**
+     * @brief The file is opened with O_DIRECT, bypassing the page cache. Aligned blocks are read into a cache owned by
+     * `FileAccess`.
+     */
+    Direct,
+};
+
+/**
+ * @brief The access pattern announced to the kernel for the file (see madvise(2) and posix_fadvise(2)). It is ignored in
+ * `FileAccessMode::Direct`, which bypasses the page cache.
+ */
+enum class FileAdvice : uint8_t {
+    Normal,
+    /**
+     * @brief No read-ahead (MADV_RANDOM)
+     */
+    Random,
+    /**
+     * @brief Aggressive read-ahead (MADV_SEQUENTIAL)
+     */
+    Sequential,
+    /**
+     * @brief Read the whole file into the page cache up front (MADV_WILLNEED)
+     */
+    WillNeed,
+};
+
+/**
+ * @brief Options for `FileAccess`.
+ */
+struct FileAccessOptions {
+    FileAccessMode mode   = FileAccessMode::Pread;
+    FileAdvice     advice = FileAdvice::Normal;
+    /**
+     * @brief The size of the block cache in KiB in `FileAccessMode::Direct`. At least one block is cached.
+     */
+    size_t direct_cache_kib = 0;
+
+    /**
+     * @brief Parses the command line values for the mode ("pread", "mmap" or "direct") and the advice ("normal",
+     * "random", "sequential" or "willneed").
+     *
+     * @return Whether both values were valid
+     */
+    auto parse(const std::string &mode_str, const std::string &advice_str) -> bool {
+        if (mode_str == "pread") {
+            mode = FileAccessMode::Pread;
+        } else if (mode_str == "mmap") {
+            mode = FileAccessMode::Mmap;
+        } else if (mode_str == "direct") {
+            mode = FileAccessMode::Direct;
+        } else {
+            return false;
+        }
+
+        if (advice_str == "normal") {
+            advice = FileAdvice::Normal;
+        } else if (advice_str == "random") {
+            advice = FileAdvice::Random;
+        } else if (advice_str == "sequential") {
+            advice = FileAdvice::Sequential;
+        } else if (advice_str == "willneed") {
+            advice = FileAdvice::WillNeed;
+        } else {
+            return false;
+        }
+        return true;
+    }
+
+    [[nodiscard]] auto mode_name() const -> std::string {
+        switch (mode) {
+            case FileAccessMode::Pread:
+                return "pread";
+            case FileAccessMode::Mmap:
+                return "mmap";
+            case FileAccessMode::Direct:
+                return "direct";
+        }
+        return "";
+    }
+
+    [[nodiscard]] auto advice_name() const -> std::string {
+        switch (advice) {
+            case FileAdvice::Normal:
+                return "normal";
+            case FileAdvice::Random:
+                return "random";
+            case FileAdvice::Sequential:
+                return "sequential";
+            case FileAdvice::WillNeed:
+                return "willneed";
+        }
+        return "";
+    }
+
+    [[nodiscard]] auto madvise_flag() const -> int {
+        switch (advice) {
+            case FileAdvice::Normal:
+                return MADV_NORMAL;
+            case FileAdvice::Random:
+                return MADV_RANDOM;
+            case FileAdvice::Sequential:
+                return MADV_SEQUENTIAL;
+            case FileAdvice::WillNeed:
+                return MADV_WILLNEED;
+        }
+        return MADV_NORMAL;
+    }
+
+    /**
+     * @brief The same advice for a file read with syscalls (see posix_fadvise(2)).
+     */
+    [[nodiscard]] auto fadvise_flag() const -> int {
+        switch (advice) {
+            case FileAdvice::Normal:
+                return POSIX_FADV_NORMAL;
+            case FileAdvice::Random:
+                return POSIX_FADV_RANDOM;
+            case FileAdvice::Sequential:
+                return POSIX_FADV_SEQUENTIAL;
+            case FileAdvice::WillNeed:
+                return POSIX_FADV_WILLNEED;
+        }
+        return POSIX_FADV_NORMAL;
+    }
+};
+
+/**
+ * @brief Random access on an uncompressed file on disk.
+ *
+ * This is the baseline for the compressed data structures. Depending on the mode, each query is a pread syscall, a
+ * read of a memory mapping or, with O_DIRECT, a read of an aligned block through a block cache which bypasses the page
+ * cache. The queries are thread safe in every mode.
+ */
 class FileAccess {
-    const std::string path;
-    const int         file;
-    const size_t      file_size;
+  public:
+    /**
+     * @brief The size and alignment of the blocks read in `FileAccessMode::Direct`. This is a multiple of the logical
+     * block size of common devices, as O_DIRECT requires.
+     */
+    static constexpr size_t DIRECT_BLOCK_SIZE = 4096;
+
+  private:
+    /**
+     * @brief The cache slots are divided among this many locks, so that threads reading different blocks rarely wait
+     */
+    static constexpr size_t CACHE_LOCKS = 64;
+
+    struct FreeDeleter {
+        void operator()(uint8_t *ptr) const { std::free(ptr); }
+    };
 
-    FileAccess(const std::string &path, int file, size_t file_size) : path{path}, file{file}, file_size{file_size} {}
+    /**
+     * @brief A direct-mapped cache of aligned blocks of the file
+     */
+    struct BlockCache {
+        std::unique_ptr<uint8_t[], FreeDeleter> blocks;
+        /**
+         * @brief The index of the block in each slot or `SIZE_MAX` if the slot is empty
+         */
+        std::vector<size_t> tags;
+        /**
+         * @brief The number of valid bytes of the block in each slot, which is less than the block size at the end of
+         * the file
+         */
+        std::vector<size_t>           lengths;
+        std::unique_ptr<std::mutex[]> locks;
+        size_t                        num_slots = 0;
+    };
+
+    int               m_file;
+    size_t            m_file_size;
+    FileAccessOptions m_options;
+    MappedFile        m_mapping;
+    /**
+     * @brief The block cache in `FileAccessMode::Direct`. Each slot is only modified while holding its lock.
+     */
+    mutable BlockCache m_cache;
+
+    FileAccess(const int file, const size_t file_size, const FileAccessOptions &options) :
+        m_file{file},
+        m_file_size{file_size},
+        m_options{options} {}
+
+    /**
+     * @brief Copies `len` bytes starting at `offset` in the given block to the buffer, reading the block into the cache
+     * if it is not cached.
+     */
+    void read_cached(const size_t block, const size_t offset, const size_t len, char *buf) const {
+        const size_t    slot = block % m_cache.num_slots;
+        std::lock_guard lock(m_cache.locks[slot % CACHE_LOCKS]);
+        uint8_t *const  data = m_cache.blocks.get() + slot * DIRECT_BLOCK_SIZE;
+        if (m_cache.tags[slot] != block) {
+            const ssize_t bytes_read = pread64(m_file, data, DIRECT_BLOCK_SIZE, block * DIRECT_BLOCK_SIZE);
+            if (bytes_read < 0) {
+                throw std::runtime_error(std::string("could not read file: ") + std::strerror(errno));
+            }
+            m_cache.tags[slot]    = block;
+            m_cache.lengths[slot] = (size_t) bytes_read;
+        }
+        const size_t valid = m_cache.lengths[slot];
+        std::memcpy(buf, data + offset, std::min(len, valid - std::min(offset, valid)));
+    }
 
   public:
-    ~FileAccess() { close(file); }
+    FileAccess(FileAccess &&other) noexcept :
+        m_file{std::exchange(other.m_file, -1)},
+        m_file_size{other.m_file_size},
+        m_options{other.m_options},
+        m_mapping{std::move(other.m_mapping)},
+        m_cache{std::move(other.m_cache)} {}
+
+    FileAccess(const FileAccess &)                     = delete;
+    auto operator=(const FileAccess &) -> FileAccess & = delete;
+    auto operator=(FileAccess &&) -> FileAccess &      = delete;
 
-    static inline auto from_file(const std::string &path) -> FileAccess {
-        const int    file      = open64(path.c_str(), O_RDONLY);
+    ~FileAccess() {
+        if (m_file >= 0) {
+            close(m_file);
+        }
+    }
+
+    static inline auto from_file(const std::string &path, const FileAccessOptions &options = {}) -> FileAccess {
+        const int flags = options.mode == FileAccessMode::Direct ? O_RDONLY | O_DIRECT : O_RDONLY;
+        const int file  = open64(path.c_str(), flags);
+        if (file < 0) {
+            throw std::runtime_error("could not open " + path + ": " + std::strerror(errno));
+        }
         const size_t file_size = lseek64(file, 0, SEEK_END);
         lseek64(file, 0, SEEK_SET);
-        return {path, file, file_size};
+
+        FileAccess access(file, file_size, options);
+        switch (options.mode) {
+            case FileAccessMode::Pread:
+                posix_fadvise(file, 0, 0, options.fadvise_flag());
+                break;
+            case FileAccessMode::Mmap:
+                access.m_mapping = MappedFile::open(path);
+                access.m_mapping.advise(options.madvise_flag());
+                break;
+            case FileAccessMode::Direct: {
+                BlockCache &cache = access.m_cache;
+                cache.num_slots   = std::max<size_t>(options.direct_cache_kib * 1024 / DIRECT_BLOCK_SIZE, 1);
+                cache.blocks.reset(
+                    static_cast<uint8_t *>(std::aligned_alloc(DIRECT_BLOCK_SIZE, cache.num_slots * DIRECT_BLOCK_SIZE)));
+                if (!cache.blocks) {
+                    throw std::bad_alloc();
+                }
+                cache.tags.assign(cache.num_slots, SIZE_MAX);
+                cache.lengths.assign(cache.num_slots, 0);
+                cache.locks = std::make_unique<std::mutex[]>(CACHE_LOCKS);
+                break;
+            }
+        }
+        return access;
     }
 
-    inline auto source_length() const -> size_t { return file_size; }
+    inline auto source_length() const -> size_t { return m_file_size; }
+
+    [[nodiscard]] inline auto options() const -> const FileAccessOptions & { return m_options; }
 
     inline auto at(size_t i) const -> char {
+        switch (m_options.mode) {
+            case FileAccessMode::Mmap:
+                return (char) m_mapping.data()[i];
+            case FileAccessMode::Direct: {
+                char c = 0;
+                read_cached(i / DIRECT_BLOCK_SIZE, i % DIRECT_BLOCK_SIZE, 1, &c);
+                return c;
+            }
+            case FileAccessMode::Pread:
+                break;
+        }
         char c;
-        pread64(file, &c, 1, i);
+        pread64(m_file, &c, 1, i);
         return c;
     }
 
     inline auto substr(char *buf, size_t i, size_t l) const -> char * {
-        const ssize_t bytes_read = pread64(file, buf, l, i);
+        if (i >= m_file_size) {
+            return buf;
+        }
+        l = std::min(l, m_file_size - i);
+
+        switch (m_options.mode) {
+            case FileAccessMode::Mmap:
+                std::memcpy(buf, m_mapping.data() + i, l);
+                return buf + l;
+            case FileAccessMode::Direct: {
+                for (size_t pos = i; pos < i + l;) {
+                    const size_t offset = pos % DIRECT_BLOCK_SIZE;
+                    const size_t len    = std::min(DIRECT_BLOCK_SIZE - offset, i + l - pos);
+                    read_cached(pos / DIRECT_BLOCK_SIZE, offset, len, buf + (pos - i));
+                    pos += len;
+                }
+                return buf + l;
+            }
+            case FileAccessMode::Pread:
+                break;
+        }
+        const ssize_t bytes_read = pread64(m_file, buf, l, i);
         if (bytes_read > 0) {
             return buf + bytes_read;
         } else {
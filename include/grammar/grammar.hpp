@@ -14,21 +14,20 @@
 
 #include <consts.hpp>
 #include <grammar/grammar_tuple_coder.hpp>
+#include <grammar/rule_arena.hpp>
 #include <util/util.hpp>
 
-#include <word_packing.hpp>
-
 namespace gracli {
 
 /**
- * @brief A representation of a Grammar as a map, with rule ids as keys and vectors of unsiged integers as symbol
- * containers
+ * @brief A representation of a Grammar as a map, with rule ids as keys and the right sides of the rules stored in a
+ * `RuleArena`
  */
 class Grammar {
 
   public:
     using Symbol = uint32_t;
-    using Rule   = word_packing::PackedIntVector<uint64_t>;
+    using Rule   = RuleArena::Rule;
 
   private:
     /**
@@ -41,9 +40,9 @@ class Grammar {
      * Therefore, if the value 274 is read from the symbols vector, it means that this is a nonterminal, since it is >=
      * 256. It is the nonterminal corresponding to the rule with id `274 - 256 = 18`.
      *
-     * Note, that this only applies to the symbols in the innner vector and not to the indexes of the outer vector.
+     * Note, that this only applies to the symbols in the rules and not to the rule ids.
      */
-    std::vector<Rule> m_rules;
+    RuleArena m_rules;
 
     /**
      * @brief The id of the start rule
@@ -51,14 +50,7 @@ class Grammar {
     size_t m_start_rule_id;
 
   public:
-    /**
-     * @brief Construct an empty Grammar with a start rule of 0 and with a given capacity.
-     *
-     * @param capacity The number of rules the underlying vector will be setup to hold
-     */
-    Grammar(Symbol capacity) : m_rules{std::vector<Rule>(capacity, Rule())}, m_start_rule_id{0} {}
-
-    Grammar(std::vector<Rule> &&rules, size_t start_rule_id) : m_rules{rules}, m_start_rule_id{start_rule_id} {}
+    Grammar(RuleArena &&rules, size_t start_rule_id) : m_rules{std::move(rules)}, m_start_rule_id{start_rule_id} {}
 
     /**
      * @brief Reads the grammar from a file.
@@ -73,37 +65,12 @@ class Grammar {
     }
 
     /**
-     * @brief Accesses the symbols vector for the rule of the given id
-     *
-     * @param id The rule id whose symbols vector to access
-     * @return Symbols& A reference to the rule's symbols vector
-     */
-    inline auto operator[](const size_t id) -> Rule & { return m_rules[id]; }
-
-    /**
-     * @brief Appends a terminal to the given rule's symbols vector
-     *
-     * @param id The id of the rule whose symbols vector should be appended to
-     * @param symbol The terminal symbol to append to the vector. Note that this value should be lesser than RULE_OFFSET
-     */
-    void append_terminal(const size_t id, size_t symbol) { m_rules[id].push_back(symbol); }
-
-    /**
-     * @brief Appends a non terminal to the given rule's vector
+     * @brief Accesses the symbols of the rule of the given id
      *
-     * @param id The id of the rule whose symbols vector should be appended to
-     * @param rule_id The id of the rule, whose non terminal should be appended to the vector. Note, that the parameter
-     * should not have RULE_OFFSET added to it when passing it in.
+     * @param id The rule id whose symbols to access
+     * @return Rule A view of the rule's symbols
      */
-    void append_nonterminal(const size_t id, size_t rule_id) { append_terminal(id, rule_id + RULE_OFFSET); }
-
-    /**
-     * Set the right side of a rule directly. Note that this will overwrite the previous mapping
-     *
-     * @param id The id of the rule whose right side to set
-     * @param symbols The container of the right side's symbols
-     */
-    void set_rule(const size_t id, Rule &&symbols) { m_rules[id] = symbols; }
+    inline auto operator[](const size_t id) const -> Rule { return m_rules[id]; }
 
   private:
     void renumber_internal(const size_t rule_id, size_t &count, std::vector<Symbol> &renumbering) {
@@ -145,6 +112,8 @@ class Grammar {
      * @brief Renumbers the rules in the grammar in such a way that rules with index i only depend on rules with indices
      * lesser than i.
      *
+     * The renumbered rules are copied into a new arena in their new order, so this needs one allocation in total
+     * instead of one per rule. Rules which are not reachable from the start rule are removed.
      */
     void dependency_renumber() {
         if (m_rules.size() == 0) {
@@ -158,21 +127,24 @@ class Grammar {
         // make count equal to the max. id
         count--;
 
-        // renumber the rules and the nonterminals therein
-        std::vector<Rule> new_rules(m_rules.size(), Rule());
+        // For each new id, the old id of the rule
+        std::vector<Symbol> old_ids(count + 1);
         for (size_t old_id = 0; old_id < m_rules.size(); old_id++) {
-            Rule &symbols = m_rules[old_id];
-            // Renumber all the nonterminals in the symbols vector
-            for (auto &symbol : symbols) {
-                if (is_terminal(symbol))
-                    continue;
-                symbol = (renumbering[symbol - RULE_OFFSET]) + RULE_OFFSET;
+            if (renumbering[old_id] != invalid<Symbol>()) {
+                old_ids[renumbering[old_id]] = old_id;
+            }
+        }
+
+        // Copy the rules in their new order and renumber the nonterminals therein
+        RuleArena::Builder new_rules(count + RULE_OFFSET, count + 1, m_rules.symbol_count());
+        for (const Symbol old_id : old_ids) {
+            for (const auto symbol : m_rules[old_id]) {
+                new_rules.push(is_terminal(symbol) ? symbol : renumbering[symbol - RULE_OFFSET] + RULE_OFFSET);
             }
-            // Put assign the rule to its new id
-            new_rules[renumbering[old_id]] = std::move(symbols);
+            new_rules.end_rule();
         }
 
-        m_rules         = std::move(new_rules);
+        m_rules         = std::move(new_rules).build();
         m_start_rule_id = count;
     }
 
@@ -183,7 +155,7 @@ class Grammar {
      */
     void print(std::ostream &out = std::cout) {
         for (size_t id = 0; id < m_rules.size(); id++) {
-            const Rule &symbols = m_rules[id];
+            const Rule symbols = m_rules[id];
             out << 'R' << id << " -> ";
             for (auto symbol : symbols) {
                 if (Grammar::is_terminal(symbol)) {
@@ -224,7 +196,7 @@ class Grammar {
 
   private:
     void expand(size_t rule_id, std::ostream &os) {
-        for (auto &symbol : m_rules[rule_id]) {
+        for (const auto symbol : m_rules[rule_id]) {
             if (is_terminal(symbol)) {
                 os << (char) symbol;
             } else {
@@ -309,11 +281,7 @@ class Grammar {
      * @return const size_t The size of the grammar
      */
     auto grammar_size() const -> const size_t {
-        auto count = 0;
-        for (size_t rule_id = 0; rule_id < m_rules.size(); rule_id++) {
-            count += m_rules[rule_id].size();
-        }
-        return count;
+        return m_rules.symbol_count();
     }
 
     /**
@@ -346,7 +314,7 @@ class Grammar {
 
         size_t count = 0;
 
-        for (auto &symbol : m_rules[id]) {
+        for (const auto symbol : m_rules[id]) {
             if (is_terminal(symbol)) {
                 count++;
             } else {
@@ -364,7 +332,7 @@ class Grammar {
 
         size_t depth = 0;
 
-        for (auto &symbol : m_rules[id]) {
+        for (const auto symbol : m_rules[id]) {
             if (is_terminal(symbol)) {
                 continue;
             } else {
@@ -429,17 +397,9 @@ class Grammar {
      */
     static inline auto is_non_terminal(size_t symbol) -> const bool { return !is_terminal(symbol); }
 
-    static inline auto consume(Grammar &&gr) -> std::vector<Rule> {
-        std::vector<Rule> new_vec(0);
-        std::swap(gr.m_rules, new_vec);
-        return new_vec;
-    }
-
-    auto begin() const { return m_rules.cbegin(); }
-
-    auto end() const { return m_rules.cend(); }
+    static inline auto consume(Grammar &&gr) -> RuleArena { return std::move(gr.m_rules); }
 
-    auto get_rule_const(size_t id) -> const Rule & { return m_rules[id]; }
+    auto get_rule_const(size_t id) const -> Rule { return m_rules[id]; }
 };
 
 } // namespace gracli
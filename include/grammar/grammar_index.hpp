@@ -0,0 +1,524 @@
+#pragma once
+
+#include <algorithm>
+#include <bit>
+#include <cstddef>
+#include <cstdint>
+#include <numeric>
+#include <ranges>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include <concepts.hpp>
+#include <consts.hpp>
+#include <grammar/grammar.hpp>
+#include <grammar/sampled_scan_query_grammar.hpp>
+#include <util/construction_phases.hpp>
+#include <util/karp_rabin.hpp>
+#include <util/wavelet_matrix.hpp>
+
+namespace gracli {
+
+/**
+ * @brief A self-index on a grammar, which counts and locates the occurrences of patterns without decompressing the
+ * text. Random access and substring queries are answered by the `SampledScanQueryGrammar` it is built on.
+ *
+ * An occurrence of a pattern is primary in the rule whose expansion is the smallest one in the parse tree that
+ * contains it, and it starts inside the symbol before the first boundary between two symbols of that rule which it
+ * crosses. Each occurrence of a pattern P of length m > 1 is therefore found exactly once by splitting P into
+ * P[0..k) and P[k..m) for each 0 < k < m: the left part is a suffix of the expansion of the symbol before a boundary
+ * and the right part is a prefix of the expansion of the rest of the rule after it. The boundaries are sorted by the
+ * reversed expansions of the symbols before them and by the expansions after them, so both conditions select a range
+ * of boundaries, which is found by binary search. The boundaries in both ranges are reported by a wavelet matrix over
+ * the grid of both orders. Expansions are compared to the pattern with the Karp-Rabin fingerprints of the rules stored
+ * by the grammar (see `SampledScanQueryGrammar::rule_fingerprint`), so a nonterminal that matches is skipped instead of
+ * being expanded.
+ *
+ * The occurrences in the text are found from the primary ones through the occurrences of their rules in other rules,
+ * and counted with the number of times each rule occurs in the parse tree. A pattern of one character only occurs in
+ * terminals, whose positions are stored per character.
+ *
+ * Since fingerprints are compared instead of characters, a pattern may be reported at a position where it does not
+ * occur with a probability of at most m / 2^61 per comparison.
+ *
+ * @tparam sampling The sampling of the grammar used for random access and substring queries
+ */
+template<size_t sampling = 6400>
+class GrammarIndex {
+    using Symbol = uint64_t;
+
+    /**
+     * @brief A position inside the expansion of a rule
+     */
+    struct Occurrence {
+        uint32_t rule;
+        uint32_t offset;
+    };
+
+    /**
+     * @brief The boundary before the symbol `index` in the right side of `rule`, which starts at `offset` in the
+     * expansion of the rule
+     */
+    struct Boundary {
+        uint32_t rule;
+        uint32_t index;
+        uint32_t offset;
+    };
+
+    /**
+     * @brief Reads the symbols of an expansion one after another, forward or from the back. Nonterminals are only
+     * expanded on request, so matching nonterminals can be skipped as a whole.
+     */
+    template<bool reverse>
+    class Cursor {
+        struct Frame {
+            uint32_t rule;
+            uint32_t next;
+            uint32_t remaining;
+        };
+
+        const SampledScanQueryGrammar<sampling> *m_grammar;
+        /**
+         * @brief The symbols after the current one that have not been read yet
+         */
+        std::vector<Frame> m_stack;
+        Symbol             m_symbol;
+        bool               m_valid;
+
+      public:
+        explicit Cursor(const SampledScanQueryGrammar<sampling> &grammar) :
+            m_grammar{&grammar},
+            m_symbol{0},
+            m_valid{false} {}
+
+        /**
+         * @brief Starts reading the expansion of a single symbol.
+         */
+        void reset(const Symbol symbol) {
+            m_stack.clear();
+            m_symbol = symbol;
+            m_valid  = true;
+        }
+
+        /**
+         * @brief Starts reading the expansion of the symbols `first` to the end of a rule, or to its start if reading
+         * in reverse.
+         */
+        void reset(const uint32_t rule, const uint32_t first) {
+            const uint32_t count = reverse ? first + 1 : (*m_grammar)[rule].size() - first;
+            m_stack.clear();
+            m_stack.push_back({rule, first, count});
+            m_valid = true;
+            pop();
+        }
+
+        [[nodiscard]] inline auto empty() const -> bool { return !m_valid; }
+
+        [[nodiscard]] inline auto symbol() const -> Symbol { return m_symbol; }
+
+        /**
+         * @brief Moves on to the symbol after the current one.
+         */
+        void pop() {
+            while (!m_stack.empty() && m_stack.back().remaining == 0) {
+                m_stack.pop_back();
+            }
+            if (m_stack.empty()) {
+                m_valid = false;
+                return;
+            }
+            Frame &frame = m_stack.back();
+            m_symbol     = (*m_grammar)[frame.rule][frame.next];
+            frame.next   = reverse ? frame.next - 1 : frame.next + 1;
+            frame.remaining--;
+        }
+
+        /**
+         * @brief Replaces the current symbol, which must be a nonterminal, by the symbols of its rule.
+         */
+        void expand() {
+            const uint32_t rule = m_symbol - RULE_OFFSET;
+            const uint32_t size = (*m_grammar)[rule].size();
+            m_stack.push_back({rule, reverse ? size - 1 : 0, size});
+            pop();
+        }
+    };
+
+    /**
+     * @brief The fingerprints of the prefixes of a pattern, from which the fingerprint of every substring of the
+     * pattern is computed in constant time
+     */
+    class PatternFingerprints {
+        std::string_view      m_pattern;
+        std::vector<uint64_t> m_prefixes;
+        std::vector<uint64_t> m_powers;
+
+      public:
+        PatternFingerprints(const KarpRabin &kr, const std::string_view pattern) :
+            m_pattern{pattern},
+            m_prefixes(pattern.size() + 1, 0),
+            m_powers(pattern.size() + 1, 1) {
+            for (size_t i = 0; i < pattern.size(); i++) {
+                m_prefixes[i + 1] = kr.append(m_prefixes[i], (uint8_t) pattern[i]);
+                m_powers[i + 1]   = KarpRabin::mul(m_powers[i], kr.base());
+            }
+        }
+
+        [[nodiscard]] inline auto at(const size_t i) const -> Symbol { return (uint8_t) m_pattern[i]; }
+
+        /**
+         * @brief Returns the fingerprint of the characters `begin` to `end - 1` of the pattern.
+         */
+        [[nodiscard]] inline auto fingerprint(const size_t begin, const size_t end) const -> uint64_t {
+            return KarpRabin::sub(m_prefixes[end], KarpRabin::mul(m_prefixes[begin], m_powers[end - begin]));
+        }
+    };
+
+    SampledScanQueryGrammar<sampling> m_grammar;
+    /**
+     * @brief The number of times each rule occurs in the parse tree of the text
+     */
+    std::vector<uint32_t> m_occurrences;
+    /**
+     * @brief The occurrences of each rule in the right sides of other rules. Those of rule i are the entries
+     * `m_parent_begin[i]` to `m_parent_begin[i + 1] - 1`.
+     */
+    std::vector<uint32_t>   m_parent_begin;
+    std::vector<Occurrence> m_parents;
+    /**
+     * @brief The terminals in the right sides of the rules, grouped by character. Those of character c are the entries
+     * `m_terminal_begin[c]` to `m_terminal_begin[c + 1] - 1`.
+     */
+    std::vector<uint32_t>   m_terminal_begin;
+    std::vector<Occurrence> m_terminals;
+    /**
+     * @brief The number of occurrences of each character in the text
+     */
+    std::vector<uint64_t> m_character_counts;
+    /**
+     * @brief The symbol before each boundary, with the boundaries sorted by the reversed expansion of this symbol
+     */
+    std::vector<uint32_t> m_left_symbols;
+    /**
+     * @brief The boundaries sorted by the expansion of the rest of their rule
+     */
+    std::vector<Boundary> m_boundaries;
+    /**
+     * @brief Maps the rank of each boundary in the order of `m_left_symbols` to its rank in the order of `m_boundaries`
+     */
+    WaveletMatrix m_grid;
+
+    [[nodiscard]] inline auto symbol_length(const Symbol symbol) const -> size_t {
+        return Grammar::is_terminal(symbol) ? 1 : m_grammar.rule_length(symbol - RULE_OFFSET);
+    }
+
+    [[nodiscard]] inline auto symbol_fingerprint(const Symbol symbol) const -> uint64_t {
+        return Grammar::is_terminal(symbol) ? symbol : m_grammar.rule_fingerprint(symbol - RULE_OFFSET);
+    }
+
+    /**
+     * @brief Counts the occurrences of the rules in the parse tree and collects the occurrences of the rules and
+     * terminals in the right sides.
+     */
+    void calculate_occurrences() {
+        const size_t rule_count = m_grammar.rule_count();
+        m_occurrences.assign(rule_count, 0);
+        m_parent_begin.assign(rule_count + 1, 0);
+        m_terminal_begin.assign(257, 0);
+        m_character_counts.assign(256, 0);
+
+        // Children have smaller ids than their parents and the start rule has the largest id
+        m_occurrences[m_grammar.start_rule_id()] = 1;
+        for (size_t id = rule_count; id-- > 0;) {
+            for (const Symbol symbol : m_grammar[id]) {
+                if (Grammar::is_terminal(symbol)) {
+                    m_terminal_begin[symbol + 1]++;
+                    m_character_counts[symbol] += m_occurrences[id];
+                } else {
+                    m_occurrences[symbol - RULE_OFFSET] += m_occurrences[id];
+                    m_parent_begin[symbol - RULE_OFFSET + 1]++;
+                }
+            }
+        }
+        std::partial_sum(m_parent_begin.begin(), m_parent_begin.end(), m_parent_begin.begin());
+        std::partial_sum(m_terminal_begin.begin(), m_terminal_begin.end(), m_terminal_begin.begin());
+
+        m_parents.resize(m_parent_begin.back());
+        m_terminals.resize(m_terminal_begin.back());
+        std::vector<uint32_t> next_parent(m_parent_begin.begin(), m_parent_begin.end() - 1);
+        std::vector<uint32_t> next_terminal(m_terminal_begin.begin(), m_terminal_begin.end() - 1);
+        for (size_t id = 0; id < rule_count; id++) {
+            uint32_t offset = 0;
+            for (const Symbol symbol : m_grammar[id]) {
+                const Occurrence occurrence{(uint32_t) id, offset};
+                if (Grammar::is_terminal(symbol)) {
+                    m_terminals[next_terminal[symbol]++] = occurrence;
+                } else {
+                    m_parents[next_parent[symbol - RULE_OFFSET]++] = occurrence;
+                }
+                offset += symbol_length(symbol);
+            }
+        }
+    }
+
+    /**
+     * @brief Compares the expansions read by two cursors lexicographically.
+     *
+     * @return A negative value, 0 or a positive value if the first expansion is smaller than, equal to or greater than
+     * the second one
+     */
+    template<bool reverse>
+    auto compare(Cursor<reverse> &a, Cursor<reverse> &b) const -> int {
+        while (!a.empty() && !b.empty()) {
+            const Symbol sa = a.symbol();
+            const Symbol sb = b.symbol();
+            if (sa == sb ||
+                (symbol_length(sa) == symbol_length(sb) && symbol_fingerprint(sa) == symbol_fingerprint(sb))) {
+                a.pop();
+                b.pop();
+                continue;
+            }
+            if (Grammar::is_terminal(sa) && Grammar::is_terminal(sb)) {
+                return sa < sb ? -1 : 1;
+            }
+            // Expand the longer symbol, so that both get closer to being aligned
+            if (Grammar::is_terminal(sb) || (Grammar::is_non_terminal(sa) && symbol_length(sa) >= symbol_length(sb))) {
+                a.expand();
+            } else {
+                b.expand();
+            }
+        }
+        if (a.empty()) {
+            return b.empty() ? 0 : -1;
+        }
+        return 1;
+    }
+
+    /**
+     * @brief Compares an expansion to the part `begin` to `end - 1` of a pattern, read from the back if `reverse` is
+     * true.
+     *
+     * @return 0 if the part of the pattern is a prefix of the expansion and otherwise a negative or positive value if
+     * the expansion is smaller or greater than the part of the pattern
+     */
+    template<bool reverse>
+    auto compare(Cursor<reverse> &key, const PatternFingerprints &pattern, const size_t begin, const size_t end) const
+        -> int {
+        const size_t len     = end - begin;
+        size_t       matched = 0;
+        while (matched < len) {
+            if (key.empty()) {
+                return -1;
+            }
+            const Symbol symbol = key.symbol();
+            if (Grammar::is_terminal(symbol)) {
+                const Symbol c = pattern.at(reverse ? end - 1 - matched : begin + matched);
+                if (symbol != c) {
+                    return symbol < c ? -1 : 1;
+                }
+                matched++;
+                key.pop();
+                continue;
+            }
+            const size_t symbol_len = symbol_length(symbol);
+            if (symbol_len <= len - matched) {
+                const size_t   from        = reverse ? end - matched - symbol_len : begin + matched;
+                const uint64_t fingerprint = pattern.fingerprint(from, from + symbol_len);
+                if (fingerprint == m_grammar.rule_fingerprint(symbol - RULE_OFFSET)) {
+                    matched += symbol_len;
+                    key.pop();
+                    continue;
+                }
+            }
+            key.expand();
+        }
+        return 0;
+    }
+
+    /**
+     * @brief Sorts the boundaries between adjacent symbols in the right sides of the rules and builds the grid.
+     */
+    void sort_boundaries() {
+        std::vector<Boundary> boundaries;
+        for (size_t id = 0; id < m_grammar.rule_count(); id++) {
+            const auto symbols = m_grammar[id];
+            if (symbols.size() == 0) {
+                continue;
+            }
+            uint32_t offset = symbol_length(symbols[0]);
+            for (size_t i = 1; i < symbols.size(); i++) {
+                boundaries.push_back({(uint32_t) id, (uint32_t) i, offset});
+                offset += symbol_length(symbols[i]);
+            }
+        }
+
+        std::vector<uint32_t> by_left(boundaries.size());
+        std::vector<uint32_t> by_right(boundaries.size());
+        std::iota(by_left.begin(), by_left.end(), 0);
+        std::iota(by_right.begin(), by_right.end(), 0);
+
+        Cursor<true> left_a(m_grammar);
+        Cursor<true> left_b(m_grammar);
+        std::stable_sort(by_left.begin(), by_left.end(), [&](const uint32_t a, const uint32_t b) {
+            left_a.reset(m_grammar[boundaries[a].rule][boundaries[a].index - 1]);
+            left_b.reset(m_grammar[boundaries[b].rule][boundaries[b].index - 1]);
+            return compare(left_a, left_b) < 0;
+        });
+
+        Cursor<false> right_a(m_grammar);
+        Cursor<false> right_b(m_grammar);
+        std::stable_sort(by_right.begin(), by_right.end(), [&](const uint32_t a, const uint32_t b) {
+            right_a.reset(boundaries[a].rule, boundaries[a].index);
+            right_b.reset(boundaries[b].rule, boundaries[b].index);
+            return compare(right_a, right_b) < 0;
+        });
+
+        std::vector<uint32_t> right_rank(boundaries.size());
+        m_boundaries.resize(boundaries.size());
+        for (size_t y = 0; y < by_right.size(); y++) {
+            right_rank[by_right[y]] = y;
+            m_boundaries[y]         = boundaries[by_right[y]];
+        }
+
+        std::vector<uint32_t> grid(boundaries.size());
+        m_left_symbols.resize(boundaries.size());
+        for (size_t x = 0; x < by_left.size(); x++) {
+            const Boundary &boundary = boundaries[by_left[x]];
+            grid[x]                  = right_rank[by_left[x]];
+            m_left_symbols[x]        = m_grammar[boundary.rule][boundary.index - 1];
+        }
+        m_grid = WaveletMatrix(std::move(grid), std::bit_width(boundaries.size()));
+    }
+
+    /**
+     * @brief Calls `f(rule, offset)` for each primary occurrence of the pattern.
+     */
+    template<typename F>
+    void for_each_primary(const std::string_view pattern, F &&f) const {
+        const size_t m = pattern.size();
+        if (m == 0) {
+            return;
+        }
+        if (m == 1) {
+            const auto c = (uint8_t) pattern[0];
+            for (size_t i = m_terminal_begin[c]; i < m_terminal_begin[c + 1]; i++) {
+                f(m_terminals[i].rule, m_terminals[i].offset);
+            }
+            return;
+        }
+
+        const PatternFingerprints fingerprints(m_grammar.karp_rabin(), pattern);
+        const auto                xs = std::views::iota(size_t{0}, m_left_symbols.size());
+        Cursor<true>              left(m_grammar);
+        Cursor<false>             right(m_grammar);
+        for (size_t k = 1; k < m; k++) {
+            // The boundaries whose symbol before them ends with pattern[0..k)
+            const auto left_cmp = [&](const size_t x) {
+                left.reset(m_left_symbols[x]);
+                return compare(left, fingerprints, 0, k);
+            };
+            const size_t x_begin = *std::ranges::partition_point(xs, [&](const size_t x) { return left_cmp(x) < 0; });
+            const size_t x_end   = *std::ranges::partition_point(xs, [&](const size_t x) { return left_cmp(x) <= 0; });
+            if (x_begin == x_end) {
+                continue;
+            }
+
+            // The boundaries whose rest of the rule starts with pattern[k..m)
+            const auto right_cmp = [&](const size_t y) {
+                right.reset(m_boundaries[y].rule, m_boundaries[y].index);
+                return compare(right, fingerprints, k, m);
+            };
+            const size_t y_begin = *std::ranges::partition_point(xs, [&](const size_t y) { return right_cmp(y) < 0; });
+            const size_t y_end   = *std::ranges::partition_point(xs, [&](const size_t y) { return right_cmp(y) <= 0; });
+
+            m_grid.report(x_begin, x_end, y_begin, y_end, [&](const uint64_t y, size_t) {
+                f(m_boundaries[y].rule, m_boundaries[y].offset - k);
+            });
+        }
+    }
+
+  public:
+    /**
+     * @brief Builds the index from a grammar, consuming it.
+     *
+     * @param other The grammar to build the index from
+     * @param phases An observer which is notified of each construction phase
+     */
+    template<PhaseObserver Phases = NoPhases>
+    GrammarIndex(Grammar &&other, Phases &&phases = {}) : m_grammar(std::move(other), phases) {
+        phases.phase("occurrences");
+        calculate_occurrences();
+        phases.phase("boundaries");
+        sort_boundaries();
+    }
+
+    static inline auto from_file(const std::string &path) -> GrammarIndex<sampling> {
+        return {Grammar::from_file(path)};
+    }
+
+    /**
+     * @brief Returns the grammar the index is built on.
+     */
+    [[nodiscard]] inline auto grammar() const -> const SampledScanQueryGrammar<sampling> & { return m_grammar; }
+
+    [[nodiscard]] inline auto source_length() const -> size_t { return m_grammar.source_length(); }
+
+    [[nodiscard]] inline auto at(const size_t i) const -> char { return m_grammar.at(i); }
+
+    inline auto substr(char *buf, const size_t substr_start, const size_t substr_len) const -> char * {
+        return m_grammar.substr(buf, substr_start, substr_len);
+    }
+
+    [[nodiscard]] inline auto lce(const size_t i, const size_t j) const -> size_t { return m_grammar.lce(i, j); }
+
+    /**
+     * @brief Returns the number of occurrences of the pattern in the text. The empty pattern has no occurrences.
+     */
+    [[nodiscard]] auto count(const std::string_view pattern) const -> size_t {
+        if (pattern.size() == 1) {
+            return m_character_counts[(uint8_t) pattern[0]];
+        }
+        size_t count = 0;
+        for_each_primary(pattern, [&](const uint32_t rule, uint32_t) { count += m_occurrences[rule]; });
+        return count;
+    }
+
+    /**
+     * @brief Returns the start positions of the occurrences of the pattern in the text in no particular order. The
+     * empty pattern has no occurrences.
+     */
+    [[nodiscard]] auto locate(const std::string_view pattern) const -> std::vector<size_t> {
+        std::vector<size_t>     positions;
+        std::vector<Occurrence> stack;
+        for_each_primary(pattern, [&](const uint32_t rule, const uint32_t offset) {
+            stack.push_back({rule, offset});
+            // Move the occurrence up through all occurrences of its rule until it reaches the start rule
+            while (!stack.empty()) {
+                const Occurrence occurrence = stack.back();
+                stack.pop_back();
+                if (occurrence.rule == m_grammar.start_rule_id()) {
+                    positions.push_back(occurrence.offset);
+                    continue;
+                }
+                for (size_t i = m_parent_begin[occurrence.rule]; i < m_parent_begin[occurrence.rule + 1]; i++) {
+                    stack.push_back({m_parents[i].rule, m_parents[i].offset + occurrence.offset});
+                }
+            }
+        });
+        return positions;
+    }
+
+    /**
+     * @brief Returns the number of bytes of the index in addition to the grammar.
+     */
+    [[nodiscard]] auto index_size_in_bytes() const -> size_t {
+        return m_occurrences.capacity() * sizeof(uint32_t) +
+               (m_parent_begin.capacity() + m_terminal_begin.capacity()) * sizeof(uint32_t) +
+               (m_parents.capacity() + m_terminals.capacity()) * sizeof(Occurrence) +
+               m_character_counts.capacity() * sizeof(uint64_t) + m_left_symbols.capacity() * sizeof(uint32_t) +
+               m_boundaries.capacity() * sizeof(Boundary) + m_grid.size_in_bytes();
+    }
+};
+
+} // namespace gracli
@@ -1,20 +1,26 @@
 #pragma once
 
-#include <algorithm>
-#include <cmath>
 #include <cstdint>
+#include <fstream>
 #include <iostream>
-#include <vector>
 
 #include <consts.hpp>
+#include <grammar/rule_arena.hpp>
 #include <util/bit_input_stream.hpp>
 
-#include <word_packing.hpp>
-
 namespace gracli {
 struct GrammarTupleCoder {
 
-    static auto decode(std::string file_path) -> std::vector<word_packing::PackedIntVector<uint64_t>> {
+    /**
+     * @brief Reads the rules of a grammar from a file.
+     *
+     * The rules are appended directly to an arena, so decoding does not allocate anything per rule. Since nonterminals
+     * can only refer to rules in the file, the bit width of the symbols is known from the rule count up front.
+     *
+     * @param file_path The input file
+     * @return The rules of the grammar
+     */
+    static auto decode(std::string file_path) -> RuleArena {
         std::ifstream in(file_path, std::ios::binary);
         BitIStream    br(std::move(in));
 
@@ -22,15 +28,12 @@ struct GrammarTupleCoder {
         uint32_t min_rule_len = br.read_int<uint32_t>(32);
         uint32_t max_rule_len = br.read_int<uint32_t>(32);
 
-        std::vector<word_packing::PackedIntVector<uint64_t>> rules;
-        rules.reserve(rule_count);
+        const uint64_t     max_symbol = rule_count == 0 ? RULE_OFFSET - 1 : rule_count - 1 + RULE_OFFSET;
+        RuleArena::Builder rules(max_symbol, rule_count);
 
         for (uint32_t i = 0; i < rule_count; i++) {
             uint32_t rule_len = br.read_int<uint32_t>(32) + min_rule_len;
 
-            word_packing::PackedIntVector<uint64_t> rule(0, 32);
-            rule.reserve(rule_len);
-            uint32_t max_symbol = 0;
             for (uint32_t j = 0; j < rule_len; j++) {
                 bool is_nonterminal = br.read_bit();
 
@@ -40,16 +43,12 @@ struct GrammarTupleCoder {
                 } else {
                     symbol = br.read_int<uint32_t>(8);
                 }
-                max_symbol = std::max(symbol, max_symbol);
-                rule.push_back(symbol);
+                rules.push(symbol);
             }
-            rule.resize(rule.size(), std::ceil(std::log2(max_symbol) + 1));
-
-            rules.emplace_back(std::move(rule));
+            rules.end_rule();
         }
-        rules.shrink_to_fit();
 
-        return rules;
+        return std::move(rules).build();
     }
 };
 } // namespace gracli
@@ -7,7 +7,11 @@
 #include <iterator>
 #include <vector>
 
+#include <concepts.hpp>
 #include <grammar/grammar.hpp>
+#include <grammar/rule_arena.hpp>
+#include <util/construction_phases.hpp>
+#include <util/memory_policy.hpp>
 #include <word_packing/packed_int_vector.hpp>
 
 namespace gracli {
@@ -16,22 +20,22 @@ class NaiveQueryGrammar {
     using Pack = uint64_t;
 
   public:
-    using Symbols = word_packing::PackedIntVector<Pack>;
+    using Symbols = RuleArena::Rule;
 
   private:
     /**
-     * @brief The vector keeping the grammar's rules.
+     * @brief The arena keeping the grammar's rules.
      *
-     * This vector maps from the rule's id to the sequence of symbols in its right side.
+     * This arena maps from the rule's id to the sequence of symbols in its right side.
      * The symbols are either the code of the character, if the symbol is a literal, or the
      * id of the rule the nonterminal belongs to offset by 256, if the symbol is a nonterminal.
      *
      * Therefore, if the value 274 is read from the symbols vector, it means that this is a nonterminal, since it is >=
      * 256. It is the nonterminal corresponding to the rule with id `274 - 256 = 18`.
      *
-     * Note, that this only applies to the symbols in the innner vector and not to the indexes of the outer vector.
+     * Note, that this only applies to the symbols in the rules and not to the rule ids.
      */
-    std::vector<Symbols> m_rules;
+    RuleArena m_rules;
 
     /**
      * @brief The id of the start rule
@@ -48,8 +52,8 @@ class NaiveQueryGrammar {
         size_t max_len = 0;
 
         for (size_t i = 0; i < m_rules.size(); i++) {
-            auto &symbols   = m_rules[i];
-            full_lengths[i] = 0;
+            const auto symbols = m_rules[i];
+            full_lengths[i]    = 0;
             for (auto symbol : symbols) {
                 if (Grammar::is_terminal(symbol)) {
                     full_lengths[i] = full_lengths[i] + 1;
@@ -73,32 +77,47 @@ class NaiveQueryGrammar {
         return {start_rule_full_length, full_lengths};
     }
 
+    /**
+     * @brief Applies the global memory policy to the large arrays
+     */
+    void advise_memory_policy() const {
+        const MemoryPolicy &policy = MemoryPolicy::global();
+        policy.advise(m_full_lengths.data(),
+                      word_packing::num_packs_required<Pack>(m_full_lengths.size(), m_full_lengths.width()) *
+                          sizeof(Pack));
+    }
+
   public:
     /**
-     * @brief Construct an empty Grammar with a start rule of 0 and with a given capacity.
+     * @brief Builds the query structure from a grammar, consuming it.
      *
-     * @param capacity The number of rules the underlying vector will be setup to hold
+     * @param other The grammar to build the query structure from
+     * @param phases An observer which is notified of each construction phase
      */
-    NaiveQueryGrammar(Grammar &&other) {
+    template<PhaseObserver Phases = NoPhases>
+    NaiveQueryGrammar(Grammar &&other, Phases &&phases = {}) {
+        phases.phase("renumber");
         other.dependency_renumber();
 
         m_start_rule_id = other.start_rule_id();
         m_rules         = Grammar::consume(std::move(other));
 
+        phases.phase("full_lengths");
         auto [start_rule_full_length, full_lengths] = calculate_full_lengths();
         m_start_rule_full_length                    = start_rule_full_length;
         m_full_lengths                              = std::move(full_lengths);
+        advise_memory_policy();
     }
 
     static auto from_file(const std::string &path) -> NaiveQueryGrammar { return {Grammar::from_file(path)}; }
 
     /**
-     * @brief Accesses the symbols vector for the rule of the given id
+     * @brief Accesses the symbols of the rule of the given id
      *
-     * @param id The rule id whose symbols vector to access
-     * @return Symbols& A reference to the rule's symbols vector
+     * @param id The rule id whose symbols to access
+     * @return Symbols A view of the rule's symbols
      */
-    inline auto operator[](const size_t id) const -> const Symbols & { return m_rules[id]; }
+    inline auto operator[](const size_t id) const -> Symbols { return m_rules[id]; }
 
     /**
      * @brief Prints the grammar to an output stream.
@@ -107,7 +126,7 @@ class NaiveQueryGrammar {
      */
     void print(std::ostream &out = std::cout) const {
         for (size_t id = 0; id < m_rules.size(); id++) {
-            const Symbols &symbols = m_rules[id];
+            const Symbols symbols = m_rules[id];
             out << 'R' << id << " -> ";
             for (auto symbol : symbols) {
                 if (Grammar::is_terminal(symbol)) {
@@ -216,11 +235,7 @@ class NaiveQueryGrammar {
      * @return const size_t The size of the grammar
      */
     auto grammar_size() const -> const size_t {
-        auto count = 0;
-        for (size_t rule_id = 0; rule_id < m_rules.size(); rule_id++) {
-            count += m_rules[rule_id].size();
-        }
-        return count;
+        return m_rules.symbol_count();
     }
 
     /**
@@ -247,10 +262,6 @@ class NaiveQueryGrammar {
      */
     inline auto empty() const -> const bool { return rule_count() == 0; }
 
-    inline auto begin() const { return m_rules.cbegin(); }
-
-    inline auto end() const { return m_rules.cend(); }
-
     /**
      * @brief Returns the length of the source string.
      *
@@ -286,8 +297,8 @@ class NaiveQueryGrammar {
 
   private:
     void write(size_t id, size_t start, size_t &len, std::ostringstream &oss) const {
-        const Symbols &symbols = m_rules[id];
-        size_t         index   = 0;
+        const Symbols symbols = m_rules[id];
+        size_t        index   = 0;
         {
             // Find symbol start index in this rule
             size_t symbol_len;
@@ -0,0 +1,222 @@
+#pragma once
+
+#include <algorithm>
+#include <bit>
+#include <cstddef>
+#include <cstdint>
+#include <iterator>
+#include <vector>
+
+#include <util/memory_policy.hpp>
+
+#include <word_packing.hpp>
+
+namespace gracli {
+
+/**
+ * @brief Stores the right sides of all rules of a grammar contiguously in a single packed vector.
+ *
+ * Storing every rule in its own vector means one heap allocation per rule, which for grammars with millions of rules
+ * dominates both the time to load them and the memory they need. An arena instead stores all symbols back to back with
+ * a common bit width, and the start of each rule in a second packed vector. Rules are accessed through lightweight
+ * `Rule` views.
+ *
+ * Arenas are immutable. They are created using a `RuleArena::Builder`, which appends rules one after another.
+ */
+class RuleArena {
+  public:
+    using Pack = uint64_t;
+
+    /**
+     * @brief A view of the right side of a single rule in an arena.
+     */
+    class Rule {
+        const RuleArena *m_arena;
+        size_t           m_begin;
+        size_t           m_size;
+
+      public:
+        class Iterator {
+            const RuleArena *m_arena;
+            size_t           m_pos;
+
+          public:
+            using iterator_category = std::forward_iterator_tag;
+            using value_type        = uint64_t;
+            using difference_type   = std::ptrdiff_t;
+            using pointer           = void;
+            using reference         = uint64_t;
+
+            Iterator() : m_arena{nullptr}, m_pos{0} {}
+            Iterator(const RuleArena *arena, const size_t pos) : m_arena{arena}, m_pos{pos} {}
+
+            inline auto operator*() const -> uint64_t { return m_arena->symbol(m_pos); }
+
+            inline auto operator++() -> Iterator & {
+                m_pos++;
+                return *this;
+            }
+
+            inline auto operator++(int) -> Iterator {
+                Iterator it = *this;
+                m_pos++;
+                return it;
+            }
+
+            inline auto operator==(const Iterator &other) const -> bool { return m_pos == other.m_pos; }
+        };
+
+        Rule(const RuleArena *arena, const size_t begin, const size_t size) :
+            m_arena{arena},
+            m_begin{begin},
+            m_size{size} {}
+
+        inline auto operator[](const size_t i) const -> uint64_t { return m_arena->symbol(m_begin + i); }
+
+        [[nodiscard]] inline auto size() const -> size_t { return m_size; }
+
+        [[nodiscard]] inline auto empty() const -> bool { return m_size == 0; }
+
+        inline auto begin() const -> Iterator { return {m_arena, m_begin}; }
+
+        inline auto end() const -> Iterator { return {m_arena, m_begin + m_size}; }
+    };
+
+    class Builder;
+
+  private:
+    /**
+     * @brief The symbols of all rules, packed with a width of `m_symbol_width` bits.
+     */
+    std::vector<Pack, PolicyAllocator<Pack>> m_symbols;
+    /**
+     * @brief For each rule the index of its first symbol in `m_symbols`, plus the number of symbols at the end.
+     * Packed with a width of `m_start_width` bits.
+     */
+    std::vector<Pack, PolicyAllocator<Pack>> m_starts;
+
+    size_t  m_num_rules;
+    size_t  m_num_symbols;
+    uint8_t m_symbol_width;
+    uint8_t m_start_width;
+
+    [[nodiscard]] inline auto start(const size_t id) const -> size_t {
+        return word_packing::accessor(const_cast<const Pack *>(m_starts.data()), m_start_width)[id];
+    }
+
+  public:
+    RuleArena() : m_symbols{}, m_starts{}, m_num_rules{0}, m_num_symbols{0}, m_symbol_width{1}, m_start_width{1} {}
+
+    RuleArena(RuleArena &&other) noexcept = default;
+
+    auto operator=(RuleArena &&other) noexcept -> RuleArena & = default;
+
+    /**
+     * @brief Returns the symbol at the given position in the concatenation of all rules.
+     */
+    [[nodiscard]] inline auto symbol(const size_t pos) const -> uint64_t {
+        return word_packing::accessor(const_cast<const Pack *>(m_symbols.data()), m_symbol_width)[pos];
+    }
+
+    /**
+     * @brief Returns a view of the right side of the rule with the given id.
+     */
+    inline auto operator[](const size_t id) const -> Rule {
+        const size_t begin = start(id);
+        return {this, begin, start(id + 1) - begin};
+    }
+
+    /**
+     * @brief Returns the number of rules in the arena.
+     */
+    [[nodiscard]] inline auto size() const -> size_t { return m_num_rules; }
+
+    [[nodiscard]] inline auto empty() const -> bool { return m_num_rules == 0; }
+
+    /**
+     * @brief Returns the total number of symbols in all rules.
+     */
+    [[nodiscard]] inline auto symbol_count() const -> size_t { return m_num_symbols; }
+
+    /**
+     * @brief Returns the bit width with which the symbols are stored.
+     */
+    [[nodiscard]] inline auto symbol_width() const -> size_t { return m_symbol_width; }
+
+    /**
+     * @brief Returns the number of bytes allocated by this arena.
+     */
+    [[nodiscard]] inline auto size_in_bytes() const -> size_t {
+        return (m_symbols.capacity() + m_starts.capacity()) * sizeof(Pack);
+    }
+
+    /**
+     * @brief Returns the number of bits needed to store all values up to and including the given value.
+     */
+    static inline auto bits_required(const uint64_t max_value) -> uint8_t {
+        return std::max<uint8_t>(std::bit_width(max_value), 1);
+    }
+};
+
+/**
+ * @brief Creates a `RuleArena` by appending symbols to the last rule and starting new rules, like a bump allocator.
+ */
+class RuleArena::Builder {
+    RuleArena           m_arena;
+    std::vector<size_t> m_starts;
+
+  public:
+    /**
+     * @brief Creates a builder for an arena.
+     *
+     * @param max_symbol The largest symbol that will be pushed to the arena. This determines the bit width of the
+     * symbols.
+     * @param num_rules The expected number of rules
+     * @param num_symbols The expected number of symbols in all rules. If this is unknown, 0 can be passed, and the
+     * symbol buffer grows like a vector.
+     */
+    Builder(const uint64_t max_symbol, const size_t num_rules, const size_t num_symbols = 0) {
+        m_arena.m_symbol_width = bits_required(max_symbol);
+        m_arena.m_symbols.reserve(word_packing::num_packs_required<Pack>(num_symbols, m_arena.m_symbol_width));
+        m_starts.reserve(num_rules + 1);
+        m_starts.push_back(0);
+    }
+
+    /**
+     * @brief Appends a symbol to the current rule.
+     */
+    inline void push(const uint64_t symbol) {
+        const size_t i = m_arena.m_num_symbols++;
+        if (m_arena.m_symbols.size() < word_packing::num_packs_required<Pack>(i + 1, m_arena.m_symbol_width)) {
+            m_arena.m_symbols.push_back(0);
+        }
+        word_packing::accessor(m_arena.m_symbols.data(), m_arena.m_symbol_width)[i] = symbol;
+    }
+
+    /**
+     * @brief Ends the current rule. The following symbols belong to the next rule.
+     */
+    inline void end_rule() {
+        m_starts.push_back(m_arena.m_num_symbols);
+        m_arena.m_num_rules++;
+    }
+
+    /**
+     * @brief Finishes the arena. This releases all excess capacity and packs the rule starts.
+     */
+    auto build() && -> RuleArena {
+        m_arena.m_symbols.shrink_to_fit();
+
+        m_arena.m_start_width = bits_required(m_arena.m_num_symbols);
+        m_arena.m_starts.resize(word_packing::num_packs_required<Pack>(m_starts.size(), m_arena.m_start_width));
+        auto starts = word_packing::accessor(m_arena.m_starts.data(), m_arena.m_start_width);
+        for (size_t i = 0; i < m_starts.size(); i++) {
+            starts[i] = m_starts[i];
+        }
+        std::vector<size_t>().swap(m_starts);
+
+        return std::move(m_arena);
+    }
+};
+
+} // namespace gracli
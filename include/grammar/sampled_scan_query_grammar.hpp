@@ -1,13 +1,23 @@
 #pragma once
 
+#include <algorithm>
+#include <array>
+#include <bit>
 #include <cmath>
 #include <cstddef>
 #include <cstdint>
 #include <queue>
 #include <ranges>
 #include <sstream>
+#include <stdexcept>
+#include <vector>
 
+#include <concepts.hpp>
 #include <grammar/grammar.hpp>
+#include <grammar/rule_arena.hpp>
+#include <util/construction_phases.hpp>
+#include <util/karp_rabin.hpp>
+#include <util/memory_policy.hpp>
 #include <word_packing.hpp>
 
 namespace gracli {
@@ -18,22 +28,22 @@ class SampledScanQueryGrammar {
     using Pack = uint64_t;
 
   public:
-    using Symbols = word_packing::PackedIntVector<Pack>;
+    using Symbols = RuleArena::Rule;
 
   private:
     /**
-     * @brief The vector keeping the grammar's rules.
+     * @brief The arena keeping the grammar's rules.
      *
-     * This vector maps from the rule's id to the sequence of symbols in its right side.
+     * This arena maps from the rule's id to the sequence of symbols in its right side.
      * The symbols are either the code of the character, if the symbol is a literal, or the
      * id of the rule the nonterminal belongs to offset by 256, if the symbol is a nonterminal.
      *
      * Therefore, if the value 274 is read from the symbols vector, it means that this is a nonterminal, since it is >=
      * 256. It is the nonterminal corresponding to the rule with id `274 - 256 = 18`.
      *
-     * Note, that this only applies to the symbols in the innner vector and not to the indexes of the outer vector.
+     * Note, that this only applies to the symbols in the rules and not to the rule ids.
      */
-    std::vector<Symbols> m_rules;
+    RuleArena m_rules;
 
     /**
      * @brief The id of the start rule
@@ -44,6 +54,13 @@ class SampledScanQueryGrammar {
 
     word_packing::PackedIntVector<Pack> m_full_lengths;
 
+    KarpRabin m_kr;
+
+    /**
+     * @brief The Karp-Rabin fingerprint of the expansion of each rule, including the start rule
+     */
+    std::vector<uint64_t, PolicyAllocator<uint64_t>> m_fingerprints;
+
     struct QuerySample {
 
         /**
@@ -72,14 +89,42 @@ class SampledScanQueryGrammar {
             relative_index_in_block{relative_index} {}
     };
 
-    std::vector<QuerySample> m_samples;
+    std::vector<QuerySample, PolicyAllocator<QuerySample>> m_samples;
+
+    /**
+     * @brief For each block, the fingerprint of the text before the anchor of the block (see `anchor`)
+     */
+    std::vector<uint64_t, PolicyAllocator<uint64_t>> m_sample_fingerprints;
+
+    /**
+     * @brief The characters supported by `rank` and `select` in increasing order. Empty until `enable_rank_select` is
+     * called.
+     */
+    std::vector<uint8_t> m_rank_alphabet;
+
+    /**
+     * @brief The number of occurrences of each supported character in the expansion of each rule except the start rule.
+     * The count of the character `m_rank_alphabet[c]` in rule i is at index `i * m_rank_alphabet.size() + c`.
+     */
+    word_packing::PackedIntVector<Pack> m_rule_counts;
+
+    /**
+     * @brief The number of occurrences of each supported character before the anchor of each block (see `anchor`),
+     * indexed like `m_rule_counts`.
+     */
+    word_packing::PackedIntVector<Pack> m_block_counts;
+
+    /**
+     * @brief The number of occurrences of each supported character in the source string
+     */
+    std::vector<uint64_t> m_character_totals;
 
     void calculate_samples() {
         // Start index, rule_id
         std::queue<std::pair<size_t, size_t>> rule_queue;
 
         auto sample_count = (m_start_rule_full_length + sampling - 1) / sampling;
-        m_samples         = std::vector<QuerySample>(sample_count);
+        m_samples         = std::vector<QuerySample, PolicyAllocator<QuerySample>>(sample_count);
 
         // Whether the sample of the corresponding index has been changed and the internal indexes need to be updated
         std::vector<bool> dirty_samples(sample_count);
@@ -110,7 +155,7 @@ class SampledScanQueryGrammar {
             auto idx_in_source = start_index;
             auto internal_idx  = 0;
 
-            Symbols &symbols = m_rules[rule_id];
+            Symbols symbols = m_rules[rule_id];
             for (auto symbol : symbols) {
                 // If we modified our sample before, we need to update which rule is the first that starts inside it
                 auto         sample_idx = idx_in_source / sampling;
@@ -139,8 +184,8 @@ class SampledScanQueryGrammar {
         size_t max_len = 0;
 
         for (size_t i = 0; i < m_rules.size(); i++) {
-            auto &symbols   = m_rules[i];
-            full_lengths[i] = 0;
+            const auto symbols = m_rules[i];
+            full_lengths[i]    = 0;
             for (auto symbol : symbols) {
                 if (Grammar::is_terminal(symbol)) {
                     full_lengths[i] = full_lengths[i] + 1;
@@ -164,22 +209,347 @@ class SampledScanQueryGrammar {
         return {start_rule_full_length, full_lengths};
     }
 
+    /**
+     * @brief Returns the fingerprint of a string extended by the expansion of a symbol of the given length.
+     */
+    [[nodiscard]] inline auto append_symbol(const uint64_t fingerprint, const uint64_t symbol, const size_t len) const
+        -> uint64_t {
+        if (Grammar::is_terminal(symbol)) {
+            return m_kr.append(fingerprint, symbol);
+        }
+        return KarpRabin::add(KarpRabin::mul(fingerprint, m_kr.pow(len)), m_fingerprints[symbol - RULE_OFFSET]);
+    }
+
+    void calculate_fingerprints() {
+        m_fingerprints.resize(m_rules.size());
+        // Children have smaller ids than their parents, so their fingerprints are known
+        for (size_t id = 0; id < m_rules.size(); id++) {
+            const auto symbols     = m_rules[id];
+            uint64_t   fingerprint = 0;
+            for (size_t i = 0; i < symbols.size(); i++) {
+                fingerprint = append_symbol(fingerprint, symbols[i], symbol_length(id, i));
+            }
+            m_fingerprints[id] = fingerprint;
+        }
+    }
+
+    /**
+     * @brief Returns the index in the rule `lowest_interval_containing_block` of the sample and the position in the
+     * source string of the anchor of a block. This is the symbol in the rule which contains the first character of the
+     * block.
+     */
+    [[nodiscard]] inline auto anchor(const size_t sample_idx) const -> std::pair<size_t, size_t> {
+        const QuerySample &sample       = m_samples[sample_idx];
+        const size_t       source_index = sample_idx * sampling + sample.relative_index_in_block;
+        if (sample.relative_index_in_block == 0) {
+            return {sample.internal_index_of_first_in_block, source_index};
+        }
+        const size_t internal_index = sample.internal_index_of_first_in_block - 1;
+        return {internal_index,
+                source_index - symbol_length(sample.lowest_interval_containing_block, internal_index)};
+    }
+
+    /**
+     * @brief The symbol at `index` in the right side of `rule`
+     */
+    struct ScanFrame {
+        size_t rule;
+        size_t index;
+    };
+
+    /**
+     * @brief What `scan_from_anchor` does with the symbol it visits.
+     */
+    enum class ScanStep : uint8_t {
+        /**
+         * @brief Continue with the next symbol in the same rule
+         */
+        Skip,
+        /**
+         * @brief Continue with the first symbol in the rule of this nonterminal
+         */
+        Descend,
+        Stop,
+    };
+
+    /**
+     * @brief Scans the symbols of the grammar from the anchor of a block (see `anchor`) until `visit` stops the scan.
+     *
+     * `visit` is called with the rule and the index of each symbol, the symbol, its length and the position of its
+     * start in the source string, and returns a `ScanStep`. Only nonterminals may be descended into, and the scan must
+     * stop before the end of the rule `lowest_interval_containing_block` of the block.
+     *
+     * @return The position in the source string of the symbol at which the scan stopped
+     */
+    template<typename Visit>
+    auto scan_from_anchor(const size_t sample_idx, Visit &&visit) const -> size_t {
+        auto [internal_index, source_index] = anchor(sample_idx);
+        size_t rule                         = m_samples[sample_idx].lowest_interval_containing_block;
+        while (true) {
+            const auto   symbol     = m_rules[rule][internal_index];
+            const size_t symbol_len = symbol_length(rule, internal_index);
+            switch (visit(rule, internal_index, symbol, symbol_len, source_index)) {
+                case ScanStep::Skip: {
+                    source_index += symbol_len;
+                    internal_index++;
+                    break;
+                }
+                case ScanStep::Descend: {
+                    rule           = symbol - RULE_OFFSET;
+                    internal_index = 0;
+                    break;
+                }
+                case ScanStep::Stop: {
+                    return source_index;
+                }
+            }
+        }
+    }
+
+    /**
+     * @brief Scans from the anchor of the block containing i down to the symbol which starts at i, which must be inside
+     * of the source string.
+     *
+     * @param skipped Called with each symbol and its length which ends before i and is skipped as a whole
+     * @param descended Called with the rule and the index of each symbol which contains i and is descended into
+     * @return The rule and the index of the symbol which starts at i
+     */
+    template<typename Skipped, typename Descended>
+    auto scan_to(const size_t i, Skipped &&skipped, Descended &&descended) const -> ScanFrame {
+        ScanFrame found{};
+        scan_from_anchor(i / sampling, [&](const size_t rule, const size_t index, const auto symbol, const size_t len,
+                                           const size_t source_index) {
+            if (source_index == i) {
+                found = {rule, index};
+                return ScanStep::Stop;
+            }
+            if (source_index + len <= i) {
+                skipped(symbol, len);
+                return ScanStep::Skip;
+            }
+            descended(rule, index);
+            return ScanStep::Descend;
+        });
+        return found;
+    }
+
+    /**
+     * @brief Scans the expansion of a rule and calls `reached` with each block whose anchor is reached and the state of
+     * the text before the anchor. `append` extends the state by a symbol and its length. Only symbols which contain an
+     * anchor are descended into.
+     *
+     * @param rule_id The rule to scan
+     * @param source_index The start of the expansion of the rule in the source string
+     * @param state The state of the text before the rule
+     * @param anchors The positions of the anchors and their blocks, sorted by position (see `sorted_anchors`)
+     * @param next The index of the next anchor in `anchors` which has not been reached yet
+     */
+    template<typename State, typename Reached, typename Append>
+    void visit_anchors(const size_t                                  rule_id,
+                       size_t                                        source_index,
+                       State                                         state,
+                       const std::vector<std::pair<size_t, size_t>> &anchors,
+                       size_t                                       &next,
+                       Reached                                      &reached,
+                       Append                                       &append) const {
+        const auto symbols = m_rules[rule_id];
+        for (size_t i = 0; i < symbols.size() && next < anchors.size(); i++) {
+            const auto   symbol     = symbols[i];
+            const size_t symbol_len = symbol_length(rule_id, i);
+            while (next < anchors.size() && anchors[next].first == source_index) {
+                reached(anchors[next++].second, state);
+            }
+            if (Grammar::is_non_terminal(symbol) && next < anchors.size() &&
+                anchors[next].first < source_index + symbol_len) {
+                visit_anchors(symbol - RULE_OFFSET, source_index, state, anchors, next, reached, append);
+            }
+            append(state, symbol, symbol_len);
+            source_index += symbol_len;
+        }
+    }
+
+    /**
+     * @brief Calls `reached` with each block and the state of the text before its anchor (see `visit_anchors`),
+     * starting with the given state of the empty text.
+     */
+    template<typename State, typename Reached, typename Append>
+    void visit_anchors(State empty, Reached &&reached, Append &&append) const {
+        const auto anchors = sorted_anchors();
+        size_t     next    = 0;
+        visit_anchors(m_start_rule_id, 0, std::move(empty), anchors, next, reached, append);
+    }
+
+    /**
+     * @brief Returns the positions of the anchors of all blocks in the source string together with their blocks,
+     * sorted by position. Several blocks may share an anchor.
+     */
+    [[nodiscard]] auto sorted_anchors() const -> std::vector<std::pair<size_t, size_t>> {
+        std::vector<std::pair<size_t, size_t>> anchors(m_samples.size());
+        for (size_t i = 0; i < m_samples.size(); i++) {
+            anchors[i] = {anchor(i).second, i};
+        }
+        std::sort(anchors.begin(), anchors.end());
+        return anchors;
+    }
+
+    /**
+     * @brief Writes the fingerprint of the text before the anchor of each block to `m_sample_fingerprints`.
+     */
+    void calculate_sample_fingerprints() {
+        m_sample_fingerprints.resize(m_samples.size());
+        visit_anchors(
+            (uint64_t) 0,
+            [&](const size_t block, const uint64_t fingerprint) { m_sample_fingerprints[block] = fingerprint; },
+            [&](uint64_t &fingerprint, const auto symbol, const size_t len) {
+                fingerprint = append_symbol(fingerprint, symbol, len);
+            });
+    }
+
+    /**
+     * @brief Returns the fingerprint of the first i characters of the source string. The fingerprints of the symbols
+     * between the anchor of the block containing i and i are appended to the fingerprint sampled for the block.
+     */
+    [[nodiscard]] auto prefix_fingerprint(const size_t i) const -> uint64_t {
+        if (i >= m_start_rule_full_length) {
+            return m_fingerprints[m_start_rule_id];
+        }
+        uint64_t fingerprint = m_sample_fingerprints[i / sampling];
+        scan_to(
+            i,
+            [&](const auto symbol, const size_t len) { fingerprint = append_symbol(fingerprint, symbol, len); },
+            [](const size_t, const size_t) {});
+        return fingerprint;
+    }
+
+    /**
+     * @brief Fills the stack with the path from the anchor of the block containing i (see `anchor`) down to the
+     * symbol which starts at i. The top of the stack is that symbol.
+     */
+    void seek(std::vector<ScanFrame> &stack, const size_t i) const {
+        stack.clear();
+        const ScanFrame found = scan_to(
+            i,
+            [](const auto, const size_t) {},
+            [&](const size_t rule, const size_t index) { stack.push_back({rule, index}); });
+        stack.push_back(found);
+    }
+
+    /**
+     * @brief Moves the top of the stack to the symbol after it. Frames whose rule has been scanned completely are
+     * removed, so the stack is empty once the rule at its bottom ends.
+     */
+    void advance(std::vector<ScanFrame> &stack) const {
+        stack.back().index++;
+        while (!stack.empty() && stack.back().index == m_rules[stack.back().rule].size()) {
+            stack.pop_back();
+            if (!stack.empty()) {
+                stack.back().index++;
+            }
+        }
+    }
+
+    /**
+     * @brief Returns the index of the character in `m_rank_alphabet` or the size of the alphabet if it is not
+     * supported by `rank` and `select`.
+     */
+    [[nodiscard]] inline auto find_rank_slot(const uint64_t c) const -> size_t {
+        const auto it = std::lower_bound(m_rank_alphabet.begin(), m_rank_alphabet.end(), c);
+        return it != m_rank_alphabet.end() && *it == c ? it - m_rank_alphabet.begin() : m_rank_alphabet.size();
+    }
+
+    /**
+     * @brief Returns the index of the character in `m_rank_alphabet` or throws if it is not supported.
+     */
+    [[nodiscard]] auto rank_slot(const uint8_t c) const -> size_t {
+        const size_t slot = find_rank_slot(c);
+        if (slot == m_rank_alphabet.size()) {
+            throw std::invalid_argument("character " + std::to_string(c) + " is not supported by rank and select");
+        }
+        return slot;
+    }
+
+    /**
+     * @brief Returns the number of occurrences of the supported character `c` with index `slot` in the expansion of a
+     * symbol, which must not be the start rule.
+     */
+    [[nodiscard]] inline auto symbol_count(const uint64_t symbol, const uint8_t c, const size_t slot) const -> size_t {
+        if (Grammar::is_terminal(symbol)) {
+            return symbol == c;
+        }
+        return m_rule_counts[(symbol - RULE_OFFSET) * m_rank_alphabet.size() + slot];
+    }
+
+    /**
+     * @brief Adds the number of occurrences of each supported character in the expansion of a symbol to the counts.
+     */
+    void add_counts(std::vector<uint64_t> &counts, const uint64_t symbol) const {
+        if (Grammar::is_terminal(symbol)) {
+            if (const size_t slot = find_rank_slot(symbol); slot < counts.size()) {
+                counts[slot]++;
+            }
+            return;
+        }
+        const size_t row = (symbol - RULE_OFFSET) * counts.size();
+        for (size_t slot = 0; slot < counts.size(); slot++) {
+            counts[slot] += m_rule_counts[row + slot];
+        }
+    }
+
+    /**
+     * @brief Writes the counts of the supported characters before the anchor of each block to `m_block_counts`.
+     */
+    void calculate_block_counts() {
+        const size_t sigma = m_rank_alphabet.size();
+        visit_anchors(
+            std::vector<uint64_t>(sigma),
+            [&](const size_t block, const std::vector<uint64_t> &counts) {
+                for (size_t slot = 0; slot < sigma; slot++) {
+                    m_block_counts[block * sigma + slot] = counts[slot];
+                }
+            },
+            [&](std::vector<uint64_t> &counts, const auto symbol, const size_t) { add_counts(counts, symbol); });
+    }
+
+    /**
+     * @brief Applies the global memory policy to the arrays that are not allocated by a `PolicyAllocator`
+     */
+    void advise_memory_policy() const {
+        const MemoryPolicy &policy = MemoryPolicy::global();
+        for (const auto *packed : {&m_full_lengths, &m_rule_counts, &m_block_counts}) {
+            if (packed->size() > 0) {
+                policy.advise(packed->data(),
+                              word_packing::num_packs_required<Pack>(packed->size(), packed->width()) * sizeof(Pack));
+            }
+        }
+    }
+
   public:
     /**
-     * @brief Construct an empty Grammar with a start rule of 0 and with a given capacity.
+     * @brief Builds the query structure from a grammar, consuming it.
      *
-     * @param capacity The number of rules the underlying vector will be setup to hold
+     * @param other The grammar to build the query structure from
+     * @param phases An observer which is notified of each construction phase
      */
-    SampledScanQueryGrammar(Grammar &&other) {
+    template<PhaseObserver Phases = NoPhases>
+    SampledScanQueryGrammar(Grammar &&other, Phases &&phases = {}) {
+        phases.phase("renumber");
         other.dependency_renumber();
 
         m_start_rule_id = other.start_rule_id();
         m_rules         = Grammar::consume(std::move(other));
 
+        phases.phase("full_lengths");
         auto [start_rule_full_length, full_lengths] = calculate_full_lengths();
         m_start_rule_full_length                    = start_rule_full_length;
         m_full_lengths                              = std::move(full_lengths);
+
+        phases.phase("fingerprints");
+        calculate_fingerprints();
+
+        phases.phase("sampling");
         calculate_samples();
+        calculate_sample_fingerprints();
+        advise_memory_policy();
     }
 
     static inline auto from_file(const std::string &path) -> SampledScanQueryGrammar<sampling> {
@@ -187,12 +557,12 @@ class SampledScanQueryGrammar {
     }
 
     /**
-     * @brief Accesses the symbols vector for the rule of the given id
+     * @brief Accesses the symbols of the rule of the given id
      *
-     * @param id The rule id whose symbols vector to access
-     * @return Symbols& A reference to the rule's symbols vector
+     * @param id The rule id whose symbols to access
+     * @return Symbols A view of the rule's symbols
      */
-    inline auto operator[](const size_t id) const -> const Symbols & { return m_rules[id]; }
+    inline auto operator[](const size_t id) const -> Symbols { return m_rules[id]; }
 
     /**
      * @brief Prints the grammar to an output stream.
@@ -201,7 +571,7 @@ class SampledScanQueryGrammar {
      */
     void print(std::ostream &out = std::cout) const {
         for (size_t id = 0; id < m_rules.size(); id++) {
-            const Symbols &symbols = m_rules[id];
+            const Symbols symbols = m_rules[id];
             out << 'R' << id << " -> ";
             for (auto symbol : symbols) {
                 if (Grammar::is_terminal(symbol)) {
@@ -303,7 +673,7 @@ class SampledScanQueryGrammar {
     }
 
     auto expansion(size_t rule_id) const -> std::string {
-        auto &symbols = m_rules[rule_id];
+        const auto symbols = m_rules[rule_id];
 
         std::ostringstream oss;
         for (auto symbol : symbols) {
@@ -329,6 +699,240 @@ class SampledScanQueryGrammar {
         return rule_id != m_start_rule_id ? (size_t) m_full_lengths[rule_id] : m_start_rule_full_length;
     }
 
+    /**
+     * @brief Returns the Karp-Rabin fingerprint of the expansion of the rule with the given id.
+     */
+    [[nodiscard]] inline auto rule_fingerprint(const size_t rule_id) const -> uint64_t {
+        return m_fingerprints[rule_id];
+    }
+
+    /**
+     * @brief Returns the Karp-Rabin fingerprinting used for the fingerprints of this grammar.
+     */
+    [[nodiscard]] inline auto karp_rabin() const -> const KarpRabin & { return m_kr; }
+
+    /**
+     * @brief Returns the Karp-Rabin fingerprint (see `KarpRabin`) of the substring starting at `start` with length
+     * `len`, or until the end of the source string.
+     *
+     * Both ends of the substring are found by a scan from the sampled fingerprint of their block which appends the
+     * fingerprints of whole symbols, so the time does not depend on the length of the substring.
+     */
+    [[nodiscard]] auto fingerprint(const size_t start, const size_t len) const -> uint64_t {
+        const size_t end = std::min(start + len, (size_t) m_start_rule_full_length);
+        if (start >= end) {
+            return 0;
+        }
+        return KarpRabin::sub(prefix_fingerprint(end),
+                              KarpRabin::mul(prefix_fingerprint(start), m_kr.pow(end - start)));
+    }
+
+    /**
+     * @brief Returns whether the substrings of length `len` starting at i and j are equal by comparing their
+     * fingerprints. Substrings which do not lie inside the source string are not equal. Different substrings are
+     * equal with a probability of at most len / 2^61.
+     */
+    [[nodiscard]] auto equal(const size_t i, const size_t j, const size_t len) const -> bool {
+        if (std::max(i, j) + len > m_start_rule_full_length) {
+            return false;
+        }
+        return i == j || fingerprint(i, len) == fingerprint(j, len);
+    }
+
+    /**
+     * @brief Returns the length of the longest common prefix of the suffixes of the source string starting at i and j.
+     *
+     * Both positions are followed through the symbols of the grammar, starting at their samples. If the symbols at both
+     * positions are equal or have the same length and fingerprint, they are skipped as a whole. Otherwise the longer
+     * one is expanded, until two differing terminals are found. Like `equal`, this may report a longer extension with
+     * a probability of at most n / 2^61 per skipped pair of differing symbols.
+     */
+    [[nodiscard]] auto lce(const size_t i, const size_t j) const -> size_t {
+        const size_t n = m_start_rule_full_length;
+        if (i >= n || j >= n) {
+            return 0;
+        }
+        if (i == j) {
+            return n - i;
+        }
+
+        thread_local std::vector<ScanFrame> first;
+        thread_local std::vector<ScanFrame> second;
+        seek(first, i);
+        seek(second, j);
+
+        size_t len = 0;
+        while (std::max(i, j) + len < n) {
+            // Once the rule a position was sampled in ends, continue from the sample of its current block
+            if (first.empty()) {
+                seek(first, i + len);
+            }
+            if (second.empty()) {
+                seek(second, j + len);
+            }
+            const ScanFrame &a  = first.back();
+            const ScanFrame &b  = second.back();
+            const auto       sa = m_rules[a.rule][a.index];
+            const auto       sb = m_rules[b.rule][b.index];
+            if (Grammar::is_terminal(sa) && Grammar::is_terminal(sb)) {
+                if (sa != sb) {
+                    break;
+                }
+                len++;
+                advance(first);
+                advance(second);
+                continue;
+            }
+
+            const size_t len_a = symbol_length(a.rule, a.index);
+            const size_t len_b = symbol_length(b.rule, b.index);
+            const auto   fp_a  = Grammar::is_terminal(sa) ? sa : m_fingerprints[sa - RULE_OFFSET];
+            const auto   fp_b  = Grammar::is_terminal(sb) ? sb : m_fingerprints[sb - RULE_OFFSET];
+            if (sa == sb || (len_a == len_b && fp_a == fp_b)) {
+                len += len_a;
+                advance(first);
+                advance(second);
+            } else if (len_a > len_b || (len_a == len_b && Grammar::is_non_terminal(sa))) {
+                first.push_back({sa - RULE_OFFSET, 0});
+            } else {
+                second.push_back({sb - RULE_OFFSET, 0});
+            }
+        }
+        return len;
+    }
+
+    /**
+     * @brief Builds the support for `rank` and `select` queries of the given characters, replacing any previous one.
+     *
+     * The number of occurrences of each character is stored for the expansion of each rule and for the text before the
+     * anchor of each block, bit-packed with as many bits as the longest rule and the source string need respectively.
+     * This takes `(rules + blocks) * σ` counts for an alphabet of σ characters, so supporting only the characters that
+     * are queried saves space.
+     *
+     * @param alphabet The characters to support or an empty vector for all characters that occur in the source string
+     */
+    void enable_rank_select(std::vector<uint8_t> alphabet = {}) {
+        if (alphabet.empty()) {
+            std::array<bool, 256> occurs{};
+            for (size_t id = 0; id < m_rules.size(); id++) {
+                for (const auto symbol : m_rules[id]) {
+                    if (Grammar::is_terminal(symbol)) {
+                        occurs[symbol] = true;
+                    }
+                }
+            }
+            for (size_t c = 0; c < occurs.size(); c++) {
+                if (occurs[c]) {
+                    alphabet.push_back(c);
+                }
+            }
+        }
+        std::sort(alphabet.begin(), alphabet.end());
+        alphabet.erase(std::unique(alphabet.begin(), alphabet.end()), alphabet.end());
+        m_rank_alphabet    = std::move(alphabet);
+        const size_t sigma = m_rank_alphabet.size();
+
+        // A rule contains each character at most as often as it is long
+        size_t max_len = 0;
+        for (size_t id = 0; id < m_rules.size(); id++) {
+            if (id != m_start_rule_id) {
+                max_len = std::max(max_len, rule_length(id));
+            }
+        }
+        const size_t count_bits = std::max<size_t>(std::bit_width(max_len), 1);
+        m_rule_counts           = word_packing::PackedIntVector<Pack>(m_rules.size() * sigma, count_bits);
+        std::vector<uint64_t> counts(sigma);
+        // Children have smaller ids than their parents, so their counts are known
+        for (size_t id = 0; id < m_rules.size(); id++) {
+            std::fill(counts.begin(), counts.end(), 0);
+            for (const auto symbol : m_rules[id]) {
+                add_counts(counts, symbol);
+            }
+            if (id == m_start_rule_id) {
+                m_character_totals = counts;
+                continue;
+            }
+            for (size_t slot = 0; slot < sigma; slot++) {
+                m_rule_counts[id * sigma + slot] = counts[slot];
+            }
+        }
+        for (size_t slot = 0; slot < sigma; slot++) {
+            m_rule_counts[m_start_rule_id * sigma + slot] = 0;
+        }
+
+        const size_t total_bits = std::max<size_t>(std::bit_width((size_t) m_start_rule_full_length), 1);
+        m_block_counts          = word_packing::PackedIntVector<Pack>(m_samples.size() * sigma, total_bits);
+        calculate_block_counts();
+        advise_memory_policy();
+    }
+
+    /**
+     * @brief Returns the characters supported by `rank` and `select` in increasing order.
+     */
+    [[nodiscard]] inline auto rank_alphabet() const -> const std::vector<uint8_t> & { return m_rank_alphabet; }
+
+    /**
+     * @brief Returns the number of occurrences of the character c before position i in the source string. The counts of
+     * the symbols between the anchor of the block containing i and i are added to the count sampled for the block.
+     *
+     * @throws std::invalid_argument If c is not supported (see `enable_rank_select`)
+     */
+    [[nodiscard]] auto rank(const uint8_t c, const size_t i) const -> size_t {
+        const size_t slot = rank_slot(c);
+        if (i >= m_start_rule_full_length) {
+            return m_character_totals[slot];
+        }
+        size_t count = m_block_counts[i / sampling * m_rank_alphabet.size() + slot];
+        scan_to(
+            i,
+            [&](const auto symbol, const size_t) { count += symbol_count(symbol, c, slot); },
+            [](const size_t, const size_t) {});
+        return count;
+    }
+
+    /**
+     * @brief Returns the position of the k-th occurrence of the character c in the source string, counting from 1.
+     *
+     * The block is found by binary search over the sampled counts. From its anchor, symbols are skipped by their
+     * counts until the symbol containing the occurrence, which is descended into.
+     *
+     * @return The position or the length of the source string if c occurs less than k times or k is 0
+     * @throws std::invalid_argument If c is not supported (see `enable_rank_select`)
+     */
+    [[nodiscard]] auto select(const uint8_t c, const size_t k) const -> size_t {
+        const size_t slot  = rank_slot(c);
+        const size_t sigma = m_rank_alphabet.size();
+        if (k == 0 || k > m_character_totals[slot]) {
+            return m_start_rule_full_length;
+        }
+        // The last block which has less than k occurrences before its anchor. The first one has none.
+        const size_t sample_idx =
+            *std::ranges::partition_point(std::views::iota((size_t) 0, m_samples.size()),
+                                          [&](const size_t b) { return m_block_counts[b * sigma + slot] < k; }) -
+            1;
+        size_t count = m_block_counts[sample_idx * sigma + slot];
+        return scan_from_anchor(sample_idx,
+                                [&](const size_t, const size_t, const auto symbol, const size_t, const size_t) {
+                                    const size_t occurrences = symbol_count(symbol, c, slot);
+                                    if (count + occurrences < k) {
+                                        count += occurrences;
+                                        return ScanStep::Skip;
+                                    }
+                                    return Grammar::is_terminal(symbol) ? ScanStep::Stop : ScanStep::Descend;
+                                });
+    }
+
+    /**
+     * @brief Returns the number of bytes used by the support for `rank` and `select`.
+     */
+    [[nodiscard]] auto rank_select_size_in_bytes() const -> size_t {
+        const auto packed_bytes = [](const word_packing::PackedIntVector<Pack> &packed) {
+            return word_packing::num_packs_required<Pack>(packed.size(), packed.width()) * sizeof(Pack);
+        };
+        return m_rank_alphabet.capacity() + packed_bytes(m_rule_counts) + packed_bytes(m_block_counts) +
+               m_character_totals.capacity() * sizeof(uint64_t);
+    }
+
     /**
      * @brief Calculates the size of the grammar
      *
@@ -337,11 +941,7 @@ class SampledScanQueryGrammar {
      * @return const size_t The size of the grammar
      */
     inline auto grammar_size() const -> const size_t {
-        auto count = 0;
-        for (size_t rule_id = 0; rule_id < m_rules.size(); rule_id++) {
-            count += m_rules[rule_id].size();
-        }
-        return count;
+        return m_rules.symbol_count();
     }
 
     /**
@@ -368,16 +968,12 @@ class SampledScanQueryGrammar {
      */
     inline auto empty() const -> const bool { return rule_count() == 0; }
 
-    inline auto begin() const { return m_rules.cbegin(); }
-
-    inline auto end() const { return m_rules.cend(); }
-
     /**
      * @brief Gets the sampled queries.
      *
      * @return
      */
-    inline auto samples() const -> const std::vector<QuerySample> & { return m_samples; }
+    inline auto samples() const -> const std::vector<QuerySample, PolicyAllocator<QuerySample>> & { return m_samples; }
 
     /**
      * @brief Returns the length of the source string.
@@ -457,7 +1053,7 @@ class SampledScanQueryGrammar {
                                  const size_t       substr_start,
                                  const size_t       substr_end,
                                  std::vector<char> &char_stack) const {
-        auto &symbols = m_rules[id];
+        const auto symbols = m_rules[id];
 
         for (int i = symbols.size() - 1; i >= 0; i--) {
             auto symbol = symbols[i];
@@ -545,7 +1141,7 @@ class SampledScanQueryGrammar {
                          const size_t        substr_start,
                          const size_t        substr_end,
                          std::ostringstream &oss) const {
-        auto &symbols = m_rules[id];
+        const auto symbols = m_rules[id];
         for (auto symbol : symbols) {
             if (Grammar::is_terminal(symbol)) {
                 // If this terminal is not inside our range we don't write it
@@ -677,7 +1273,7 @@ class SampledScanQueryGrammar {
                                  size_t      &source_index,
                                  const size_t substr_start,
                                  const size_t substr_end) const -> char * {
-        auto &symbols = m_rules[id];
+        const auto symbols = m_rules[id];
 
         for (int i = symbols.size() - 1; i >= 0; i--) {
             auto symbol = symbols[i];
@@ -770,7 +1366,7 @@ class SampledScanQueryGrammar {
                          size_t      &source_index,
                          const size_t substr_start,
                          const size_t substr_end) const -> char * {
-        auto &symbols = m_rules[id];
+        const auto symbols = m_rules[id];
         for (auto symbol : symbols) {
             if (Grammar::is_terminal(symbol)) {
                 // If this terminal is not inside our range we don't write it
@@ -0,0 +1,222 @@
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <unordered_map>
+#include <vector>
+
+namespace gracli::lz {
+
+/**
+ * @brief A bounded cache of decoded text, organized as blocks of `BLOCK_SIZE` consecutive text positions which are
+ * evicted in least recently used order.
+ *
+ * Blocks do not need to be complete. Each block has a bit mask of the positions whose characters are known, so
+ * single characters can be added as they are decoded. When a new block does not fit, the least recently used block is
+ * replaced.
+ *
+ * The cache also counts how many lookups were answered from it. It is not thread safe.
+ *
+ * @tparam Char The character type
+ */
+template<typename Char>
+class BlockCache {
+  public:
+    /**
+     * @brief The number of text positions in a block. One bit of a word marks each position as known.
+     */
+    static constexpr size_t BLOCK_SIZE = 64;
+
+  private:
+    static constexpr uint32_t NONE = UINT32_MAX;
+
+    /**
+     * @brief The approximate number of bytes needed per block, including its entry in the hash map.
+     */
+    static constexpr size_t SLOT_BYTES =
+        BLOCK_SIZE * sizeof(Char) + 2 * sizeof(uint64_t) + 2 * sizeof(uint32_t) + 4 * sizeof(void *);
+
+    /**
+     * @brief The text of each slot. Slot s holds the positions `BLOCK_SIZE * m_block[s]` and following.
+     */
+    std::vector<Char> m_text;
+    /**
+     * @brief For each slot a mask of the positions whose characters are known
+     */
+    std::vector<uint64_t> m_known;
+    /**
+     * @brief For each slot the block stored in it
+     */
+    std::vector<uint64_t> m_block;
+    /**
+     * @brief The slots as a doubly linked list from the most to the least recently used one
+     */
+    std::vector<uint32_t> m_prev;
+    std::vector<uint32_t> m_next;
+    uint32_t              m_head;
+    uint32_t              m_tail;
+    /**
+     * @brief The number of slots in use. Slots are used in order until all are in use.
+     */
+    uint32_t m_used;
+
+    std::unordered_map<uint64_t, uint32_t> m_slots;
+
+    size_t m_hits;
+    size_t m_misses;
+
+    void unlink(const uint32_t slot) {
+        (m_prev[slot] == NONE ? m_head : m_next[m_prev[slot]]) = m_next[slot];
+        (m_next[slot] == NONE ? m_tail : m_prev[m_next[slot]]) = m_prev[slot];
+    }
+
+    void push_front(const uint32_t slot) {
+        m_prev[slot] = NONE;
+        m_next[slot] = m_head;
+        (m_head == NONE ? m_tail : m_prev[m_head]) = slot;
+        m_head                                     = slot;
+    }
+
+    void touch(const uint32_t slot) {
+        if (slot != m_head) {
+            unlink(slot);
+            push_front(slot);
+        }
+    }
+
+    /**
+     * @brief Returns the slot of the given block or `NONE` if it is not cached. A found slot becomes the most recently
+     * used one.
+     */
+    auto slot_of(const uint64_t block) -> uint32_t {
+        const auto it = m_slots.find(block);
+        if (it == m_slots.end()) {
+            return NONE;
+        }
+        touch(it->second);
+        return it->second;
+    }
+
+  public:
+    /**
+     * @brief Creates an empty cache.
+     *
+     * @param capacity_bytes The approximate maximum number of bytes the cache may use. At least one block is cached.
+     */
+    explicit BlockCache(const size_t capacity_bytes) : m_head{NONE}, m_tail{NONE}, m_used{0}, m_hits{0}, m_misses{0} {
+        const size_t slots = std::clamp<size_t>(capacity_bytes / SLOT_BYTES, 1, NONE - 1);
+        m_text.resize(slots * BLOCK_SIZE);
+        m_known.resize(slots);
+        m_block.resize(slots);
+        m_prev.resize(slots);
+        m_next.resize(slots);
+        m_slots.reserve(slots);
+    }
+
+    /**
+     * @brief Returns a pointer to the cached character at the given text position or nullptr if it is not cached.
+     */
+    auto find(const size_t pos) -> const Char * {
+        const uint32_t slot   = slot_of(pos / BLOCK_SIZE);
+        const size_t   offset = pos % BLOCK_SIZE;
+        if (slot == NONE || !((m_known[slot] >> offset) & 1)) {
+            return nullptr;
+        }
+        return m_text.data() + slot * BLOCK_SIZE + offset;
+    }
+
+    /**
+     * @brief Returns a pointer to the cached text starting at the given position if all `len` characters are cached in
+     * the same block, otherwise nullptr.
+     */
+    auto find_range(const size_t pos, const size_t len) -> const Char * {
+        const size_t offset = pos % BLOCK_SIZE;
+        if (len == 0 || offset + len > BLOCK_SIZE) {
+            return nullptr;
+        }
+        const uint32_t slot = slot_of(pos / BLOCK_SIZE);
+        const uint64_t mask = len == BLOCK_SIZE ? ~0ULL : ((1ULL << len) - 1) << offset;
+        if (slot == NONE || (m_known[slot] & mask) != mask) {
+            return nullptr;
+        }
+        return m_text.data() + slot * BLOCK_SIZE + offset;
+    }
+
+    /**
+     * @brief Stores the character at the given text position. If its block is not cached, the least recently used
+     * block is replaced.
+     */
+    void put(const size_t pos, const Char c) {
+        const uint64_t block = pos / BLOCK_SIZE;
+        uint32_t       slot  = slot_of(block);
+        if (slot == NONE) {
+            if (m_used < m_known.size()) {
+                slot = m_used++;
+            } else {
+                slot = m_tail;
+                unlink(slot);
+                m_slots.erase(m_block[slot]);
+            }
+            m_block[slot] = block;
+            m_known[slot] = 0;
+            m_slots.emplace(block, slot);
+            push_front(slot);
+        }
+        const size_t offset                = pos % BLOCK_SIZE;
+        m_text[slot * BLOCK_SIZE + offset] = c;
+        m_known[slot] |= 1ULL << offset;
+    }
+
+    /**
+     * @brief Stores the characters at the text positions `pos` to `pos + len - 1`.
+     */
+    void put_range(size_t pos, const Char *text, size_t len) {
+        while (len > 0) {
+            const size_t offset = pos % BLOCK_SIZE;
+            const size_t count  = std::min(len, BLOCK_SIZE - offset);
+            put(pos, text[0]);
+            const uint32_t slot = m_head;
+            std::copy_n(text, count, m_text.data() + slot * BLOCK_SIZE + offset);
+            m_known[slot] |= (count == BLOCK_SIZE ? ~0ULL : ((1ULL << count) - 1)) << offset;
+            pos += count;
+            text += count;
+            len -= count;
+        }
+    }
+
+    inline void record_hit() { m_hits++; }
+
+    inline void record_miss() { m_misses++; }
+
+    /**
+     * @brief Resets the hit and miss counters but keeps the cached text.
+     */
+    void reset_counters() {
+        m_hits   = 0;
+        m_misses = 0;
+    }
+
+    [[nodiscard]] inline auto hits() const -> size_t { return m_hits; }
+
+    [[nodiscard]] inline auto misses() const -> size_t { return m_misses; }
+
+    /**
+     * @brief Returns the fraction of lookups answered from the cache or 0 if there were none.
+     */
+    [[nodiscard]] inline auto hit_rate() const -> double {
+        const size_t lookups = m_hits + m_misses;
+        return lookups == 0 ? 0.0 : (double) m_hits / (double) lookups;
+    }
+
+    /**
+     * @brief Returns the number of bytes allocated by the cache, estimating the hash map from its size.
+     */
+    [[nodiscard]] auto size_in_bytes() const -> size_t {
+        return m_text.capacity() * sizeof(Char) + (m_known.capacity() + m_block.capacity()) * sizeof(uint64_t) +
+               (m_prev.capacity() + m_next.capacity()) * sizeof(uint32_t) + m_slots.bucket_count() * sizeof(void *) +
+               m_slots.size() * (sizeof(std::pair<const uint64_t, uint32_t>) + sizeof(void *));
+    }
+};
+
+} // namespace gracli::lz
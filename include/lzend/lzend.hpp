@@ -1,12 +1,29 @@
 #pragma once
 
+#include <algorithm>
+#include <array>
+#include <bit>
+#include <climits>
+#include <cmath>
 #include <cstdint>
 #include <fstream>
 #include <iostream>
+#include <iterator>
+#include <memory>
 #include <numeric>
+#include <parallel/algorithm>
+#include <sstream>
+#include <stdexcept>
 
 #include <compute_lzend.hpp>
+#include <concepts.hpp>
+#include <lzend/block_cache.hpp>
+#include <lzend/phrase_locator.hpp>
 #include <sdsl/sd_vector.hpp>
+#include <util/construction_phases.hpp>
+#include <util/memory_policy.hpp>
+#include <util/serialization.hpp>
+#include <word_packing.hpp>
 
 namespace gracli::lz {
 /**
@@ -14,13 +31,25 @@ namespace gracli::lz {
  * Navarro.
  *
  * The paper can be found at https://arxiv.org/abs/1101.4065
+ *
+ * @tparam PhraseLocator Finds the phrase containing a text position. `SdPhraseLocator` is the space efficient
+ * implementation from the paper, `SampledPhraseLocator` trades space for faster queries.
  */
-class LzEnd {
+template<typename PhraseLocator = SdPhraseLocator>
+class BasicLzEnd {
   public:
     using Char       = uint8_t;
     using TextOffset = uint64_t;
-    using Phrase     = lzend_phrase<Char, TextOffset, TextOffset>;
-    using Parsing    = space_efficient_vector<Phrase>;
+
+    /**
+     * @brief A parsing whose links and lengths are stored with the given integer type. Texts and chunks shorter than
+     * 2^32 characters can be parsed and decoded with 32-bit offsets, which halves the memory of the parsing.
+     */
+    template<typename Offset>
+    using BasicParsing = space_efficient_vector<lzend_phrase<Char, Offset, Offset>>;
+
+    using Phrase  = lzend_phrase<Char, TextOffset, TextOffset>;
+    using Parsing = BasicParsing<TextOffset>;
 
     using BitVec = sdsl::sd_vector<sdsl::bit_vector>;
     using Rank   = sdsl::rank_support_sd<1, sdsl::bit_vector>;
@@ -31,15 +60,13 @@ class LzEnd {
      * @brief Stores the last character of each phrase contiguously.
      * In the original paper, this is L.
      */
-    std::vector<Char> m_last;
+    std::vector<Char, PolicyAllocator<Char>> m_last;
 
     /**
-     * @brief For each text position, stores a 1 if the position is the last character of a phrase.
+     * @brief Finds the phrase containing a text position and the boundaries of phrases.
      * In the original paper, this is B.
      */
-    BitVec m_last_pos;
-    Rank   m_last_pos_r;
-    Select m_last_pos_s;
+    PhraseLocator m_phrases;
 
     /**
      * @brief For each text position respectively contains a 1 for each source starting at this position, followed by a
@@ -63,22 +90,48 @@ class LzEnd {
      *
      * In the original paper, this is P.
      */
-    std::vector<size_t> m_source_map;
+    std::vector<size_t, PolicyAllocator<size_t>> m_source_map;
+
+    /**
+     * @brief For each phrase, a 1 if its text is stored explicitly in `m_literal_text`, packed into words.
+     * Empty if no phrase is stored explicitly.
+     *
+     * Phrases are stored explicitly if resolving a position inside them would take more than the number of jumps given
+     * to `bound_hops`.
+     */
+    std::vector<uint64_t> m_literal_bits;
+    /**
+     * @brief For each word of `m_literal_bits`, the number of ones in the words before it.
+     */
+    std::vector<uint64_t> m_literal_rank;
+    /**
+     * @brief For each explicitly stored phrase in order, the index of its first character in `m_literal_text`.
+     */
+    std::vector<uint64_t> m_literal_start;
+    /**
+     * @brief The concatenated text of all explicitly stored phrases.
+     */
+    std::vector<Char, PolicyAllocator<Char>> m_literal_text;
+
+    /**
+     * @brief Caches decoded text of frequently accessed regions or nullptr if caching is disabled (see
+     * `enable_cache`). Queries fill the cache, so it is mutable.
+     */
+    mutable std::unique_ptr<BlockCache<Char>> m_cache;
 
     size_t m_source_length;
     size_t m_index_bits{};
     size_t m_phrase_bits{};
 
   public:
-    [[nodiscard]] inline auto num_phrases() const -> size_t { return m_last.size(); }
-
-  private:
     /**
-     * @brief Inclusive rank on the `m_last_pos` bit vector.
-     * @return The number of ones up to and including i
+     * @brief The magic number at the start of a serialized index (see `save`). These are the bytes "GRLZEIDX".
      */
-    [[nodiscard]] inline auto rank1_last_pos(const size_t i) const -> size_t { return m_last_pos_r.rank(i + 1); }
+    static constexpr uint64_t INDEX_MAGIC = 0x5844'4945'5a4c'5247;
+
+    [[nodiscard]] inline auto num_phrases() const -> size_t { return m_last.size(); }
 
+  private:
     /**
      * @brief Inclusive rank on the `m_source_begin` bit vector.
      * @return The number of ones up to and including i
@@ -87,12 +140,6 @@ class LzEnd {
         return m_source_begin_r.rank(i + 1);
     }
 
-    /**
-     * @brief Select on the `m_last_pos` bit vector.
-     * @return The index of the ith one.
-     */
-    [[nodiscard]] inline auto select1_last_pos(const size_t i) const -> size_t { return m_last_pos_s.select(i); }
-
     /**
      * @brief Select on the `m_source_begin` bit vector.
      * @return The index of the ith one.
@@ -105,83 +152,134 @@ class LzEnd {
         return word_packing::accessor(const_cast<const size_t *>(m_source_map.data()), m_phrase_bits);
     }
 
-    void build_aux_ds(Parsing &&parsing) {
+    /**
+     * @brief Returns the text position at which the source of the given phrase starts.
+     */
+    [[nodiscard]] inline auto source_start(const size_t phrase_id) const -> size_t {
+        const size_t source = source_map_accessor()[phrase_id];
+        return select1_source_begin(source + 1) - source - 1;
+    }
+
+    /**
+     * @brief Checks whether the text of the given phrase is stored explicitly.
+     */
+    [[nodiscard]] inline auto is_literal(const size_t phrase_id) const -> bool {
+        return !m_literal_bits.empty() && (m_literal_bits[phrase_id / 64] >> (phrase_id % 64)) & 1;
+    }
+
+    /**
+     * @brief Returns the explicitly stored text of the given phrase. The phrase must be stored explicitly.
+     */
+    [[nodiscard]] inline auto literal_text(const size_t phrase_id) const -> const Char * {
+        const size_t word = phrase_id / 64;
+        const size_t mask = (1ULL << (phrase_id % 64)) - 1;
+        const size_t rank = m_literal_rank[word] + std::popcount(m_literal_bits[word] & mask);
+        return m_literal_text.data() + m_literal_start[rank];
+    }
+
+    /**
+     * @brief Fills a packed vector in parallel.
+     *
+     * The entries are handed out to the threads in groups of 64, so every group starts at a word boundary and no two
+     * threads ever write to the same word.
+     *
+     * @param data The packed vector. Must be large enough for `count` entries of the given width.
+     * @param count The number of entries
+     * @param bits The bit width of the entries
+     * @param value A function that returns the value of the entry with the given index
+     */
+    template<typename Pack, typename ValueFn>
+    static void parallel_pack(Pack *data, const size_t count, const size_t bits, ValueFn &&value) {
+        auto         acc      = word_packing::accessor(data, bits);
+        const size_t n_groups = (count + 63) / 64;
+#pragma omp parallel for schedule(static)
+        for (size_t g = 0; g < n_groups; g++) {
+            const size_t end = std::min(count, (g + 1) * 64);
+            for (size_t i = g * 64; i < end; i++) {
+                acc[i] = value(i);
+            }
+        }
+    }
+
+    /**
+     * @brief Builds the auxiliary data structures from the parsing.
+     *
+     * The scratch arrays only need to hold positions in S, which has n + n_phrases bits, so they are 32-bit arrays
+     * whenever possible.
+     */
+    template<typename Offset, PhaseObserver Phases>
+    void build_aux_ds(BasicParsing<Offset> &&parsing, Phases &&phases) {
+        if (m_source_length + parsing.size() <= UINT32_MAX) {
+            build_aux_ds_internal<uint32_t>(std::move(parsing), std::forward<Phases>(phases));
+        } else {
+            build_aux_ds_internal<uint64_t>(std::move(parsing), std::forward<Phases>(phases));
+        }
+    }
+
+    /**
+     * @brief Builds the auxiliary data structures using scratch arrays of the given index type.
+     */
+    template<typename Index, typename Offset, PhaseObserver Phases>
+    void build_aux_ds_internal(BasicParsing<Offset> &&parsing, Phases &&phases) {
         size_t n_phrases = parsing.size();
         size_t n         = m_source_length;
         // The number of bits required to index the input
         m_index_bits  = ceil(log2((double) n));
         m_phrase_bits = ceil(log2((double) n_phrases));
 
+        phases.phase("last_pos");
         m_last.reserve(n_phrases + 1);
+        m_last.resize(n_phrases);
 
-        size_t current_index = 0;
-
-        sdsl::sd_vector_builder svb(n, n_phrases);
-
-        // Calculate all end positions of phrase_source_start and store them
+#pragma omp parallel for schedule(static)
         for (size_t i = 0; i < n_phrases; i++) {
-            Phrase &f = parsing[i];
-            m_last.push_back(f.m_char);
-            current_index += f.m_len;
-            svb.set(current_index - 1);
+            m_last[i] = parsing[i].m_char;
         }
 
-        m_last_pos   = sdsl::sd_vector(svb);
-        m_last_pos_r = Rank(&m_last_pos);
-        m_last_pos_s = Select(&m_last_pos);
+        // Calculate all end positions of the phrases and store them
+        size_t current_index = 0;
+        m_phrases            = PhraseLocator(n, n_phrases, [&](const size_t i) {
+            current_index += parsing[i].m_len;
+            return current_index - 1;
+        });
 
         // Calculate the start indices of their phrase_source_start' sources
-        std::vector<size_t> phrase_buffer;
-        phrase_buffer.resize(word_packing::num_packs_required<size_t>(n_phrases, m_index_bits));
-        auto phrase_source_start = word_packing::accessor(phrase_buffer.data(), m_index_bits);
-
-        for (size_t i = 0; i < n_phrases; i++) {
-            Phrase &f = parsing[i];
+        phases.phase("source_start");
+        std::vector<size_t> phrase_buffer(word_packing::num_packs_required<size_t>(n_phrases, m_index_bits));
+        parallel_pack(phrase_buffer.data(), n_phrases, m_index_bits, [&](const size_t i) -> size_t {
+            const auto &f = parsing[i];
             if (f.m_len == 1) {
-                phrase_source_start[i] = 0;
-                continue;
+                return 0;
             }
-
-            size_t src_end         = select1_last_pos(f.m_link + 1);
-            size_t src_start       = src_end - f.m_len + 2;
-            phrase_source_start[i] = src_start + 1;
-        }
+            size_t src_end   = m_phrases.phrase_end(f.m_link);
+            size_t src_start = src_end - f.m_len + 2;
+            return src_start + 1;
+        });
+        auto phrase_source_start =
+            word_packing::accessor(const_cast<const size_t *>(phrase_buffer.data()), m_index_bits);
 
         // Drop the parsing. It is not needed anymore
         { auto drop = std::move(parsing); }
 
-        // for now this is used as a buffer to keep track of the sources
-        // sorted ascending by their source's start index in the text
-        m_source_map.resize(n_phrases);
-        std::iota(m_source_map.begin(), m_source_map.end(), 0);
+        phases.phase("sort");
+        // The phrases sorted stably by the start index of their source in the text
+        std::vector<Index> sorted(n_phrases);
+#pragma omp parallel for schedule(static)
+        for (size_t i = 0; i < n_phrases; i++) {
+            sorted[i] = i;
+        }
 
-        std::stable_sort(m_source_map.begin(), m_source_map.end(), [&](const int &l, const int &r) {
-            auto lhs = phrase_source_start[l];
-            auto rhs = phrase_source_start[r];
-            return lhs < rhs;
+        __gnu_parallel::stable_sort(sorted.begin(), sorted.end(), [&](const Index l, const Index r) {
+            return phrase_source_start[l] < phrase_source_start[r];
         });
 
         // Calculate the amount of sources starting at each index
-
-        // The index we are currently modifying
-        size_t bit_index = 0;
-        // The phrase we are currently handling
-        size_t phrase_index = 0;
-        // The start index of the current phrase's source
-        size_t start = phrase_source_start[m_source_map[phrase_index]];
-
-        svb = sdsl::sd_vector_builder(n + n_phrases, n_phrases);
-        // We iterate through the phrase_source_start in order of their source's appearance in the text
-        // For every phrase that starts at a certain index, we place a 1, then we place a 0 (with a no-op) and repeat
-        for (size_t i = 0; i < n; i++) {
-            while (i == start && phrase_index < n_phrases) {
-                svb.set(bit_index++);
-                phrase_index++;
-                if (phrase_index < n_phrases) {
-                    start = phrase_source_start[m_source_map[phrase_index]];
-                }
-            }
-            bit_index++;
+        phases.phase("source_begin");
+        // For every index, S contains a 1 for each source starting there, followed by a 0. So the j-th source in sorted
+        // order is preceded by j ones and one zero for each index before its start.
+        sdsl::sd_vector_builder svb(n + n_phrases, n_phrases);
+        for (size_t j = 0; j < n_phrases; j++) {
+            svb.set(j + phrase_source_start[sorted[j]]);
         }
 
         m_source_begin   = sdsl::sd_vector(svb);
@@ -189,93 +287,203 @@ class LzEnd {
         m_source_begin_s = Select(&m_source_begin);
 
         // Calculate the actual source mapping
-        // We first count how many sources start at each index in the text
-        std::vector<TextOffset> current_source_count(n + 1);
-        for (size_t i = 0; i < n_phrases; i++) {
-            size_t src_start = phrase_source_start[i];
-            current_source_count[src_start + 1]++;
-        }
-        // Prefix sum. This is basically equivalent to a prefix sum over S
-        for (size_t i = 2; i < n + 1; ++i) {
-            current_source_count[i] += current_source_count[i - 1] + 1;
-            current_source_count[i - 1]++;
+        phases.phase("source_map");
+        // The source of a phrase is the 1 in S with the phrase's rank in the sorted order, so P is the inverse of the
+        // sorted order
+        std::vector<Index> inverse(n_phrases);
+#pragma omp parallel for schedule(static)
+        for (size_t j = 0; j < n_phrases; j++) {
+            inverse[sorted[j]] = j;
         }
+        { auto drop = std::move(sorted); }
 
-        // We map the phrase_source_start in B to 1s in S
-        size_t id = 0;
-        for (size_t i = 0; i < n_phrases; i++) {
-            size_t src_start = phrase_source_start[i];
-            // For every index in the source text, there is a string 1^k0 in S, such that the number of 1s denotes the
-            // number of sources starting at that index This is the index in S at which this 1^k0 is situated
-            m_source_map[id++] = rank1_source_begin(current_source_count[src_start]++) - 1;
-        }
-
-        auto source_map_acc = word_packing::accessor(m_source_map.data(), m_phrase_bits);
-        for (int k = 0; k < n_phrases; ++k) {
-            source_map_acc[k] = m_source_map[k];
-        }
         m_source_map.resize(word_packing::num_packs_required<size_t>(n_phrases, m_phrase_bits));
+        parallel_pack(m_source_map.data(), n_phrases, m_phrase_bits, [&](const size_t k) { return inverse[k]; });
+
+        advise_memory_policy();
+    }
+
+    /**
+     * @brief Applies the global memory policy to the bit vectors, which are not allocated by a `PolicyAllocator`
+     */
+    void advise_memory_policy() const {
+        const MemoryPolicy &policy = MemoryPolicy::global();
+        m_phrases.advise(policy);
+        policy.advise(m_source_begin.low.data(), m_source_begin.low.bit_size() / CHAR_BIT);
+        policy.advise(m_source_begin.high.data(), m_source_begin.high.bit_size() / CHAR_BIT);
     }
 
-    LzEnd() :
+    BasicLzEnd() :
         m_last{},
-        m_last_pos{},
+        m_phrases{},
         m_source_begin{},
         m_source_map{},
+        m_literal_bits{},
+        m_literal_rank{},
+        m_literal_start{},
+        m_literal_text{},
+        m_cache{},
         m_source_length{0},
         m_index_bits{0},
         m_phrase_bits{0} {}
 
   public:
-    LzEnd(LzEnd &&other) noexcept :
+    BasicLzEnd(BasicLzEnd &&other) noexcept :
         m_last{std::move(other.m_last)},
-        m_last_pos{std::move(other.m_last_pos)},
+        m_phrases{std::move(other.m_phrases)},
         m_source_begin{std::move(other.m_source_begin)},
-        m_source_map{std::move(other.m_source_map)},
-        m_source_length{other.m_source_length},
-        m_last_pos_r{&m_last_pos},
-        m_last_pos_s{&m_last_pos},
         m_source_begin_r{&m_source_begin},
         m_source_begin_s{&m_source_begin},
+        m_source_map{std::move(other.m_source_map)},
+        m_literal_bits{std::move(other.m_literal_bits)},
+        m_literal_rank{std::move(other.m_literal_rank)},
+        m_literal_start{std::move(other.m_literal_start)},
+        m_literal_text{std::move(other.m_literal_text)},
+        m_cache{std::move(other.m_cache)},
+        m_source_length{other.m_source_length},
         m_index_bits{other.m_index_bits},
         m_phrase_bits{other.m_phrase_bits} {
-        other.m_last_pos_r     = Rank(nullptr);
-        other.m_last_pos_s     = Select(nullptr);
         other.m_source_begin_r = Rank(nullptr);
         other.m_source_begin_s = Select(nullptr);
     }
 
-    static LzEnd from_file(const std::string &file);
+    /**
+     * @brief Loads an index written by `save`, or builds the index from a file containing an LzEnd parsing.
+     */
+    static BasicLzEnd from_file(const std::string &file);
 
-    static LzEnd from_string(const std::string &str) {
+    static BasicLzEnd from_string(const std::string &str) {
         std::istringstream in(str);
         return from_stream(in);
     }
 
-    static LzEnd from_stream(std::istream &stream) {
+    static BasicLzEnd from_stream(std::istream &stream) {
         std::noskipws(stream);
         std::vector<Char> input((std::istream_iterator<Char>(stream)), std::istream_iterator<Char>());
 
+        if (input.size() <= UINT32_MAX) {
+            BasicParsing<uint32_t> parsing;
+            compute_lzend<Char, uint32_t>(input.data(), input.size(), &parsing);
+            return from_parsing(std::move(parsing), input.size());
+        }
         Parsing parsing;
         compute_lzend<Char, TextOffset>(input.data(), input.size(), &parsing);
         return from_parsing(std::move(parsing), input.size());
     }
 
-    static LzEnd from_parsing(Parsing &&parsing, size_t source_length) {
-        LzEnd instance;
+    template<typename Offset, PhaseObserver Phases = NoPhases>
+    static BasicLzEnd from_parsing(BasicParsing<Offset> &&parsing, size_t source_length, Phases &&phases = {}) {
+        BasicLzEnd instance;
         instance.m_source_length = source_length;
-        instance.build_aux_ds(std::move(parsing));
+        instance.build_aux_ds(std::move(parsing), std::forward<Phases>(phases));
         return instance;
     }
 
+    /**
+     * @brief Writes the index to a file, from which it can be loaded without reparsing or rebuilding anything.
+     *
+     * The file consists of a header with the magic number `INDEX_MAGIC`, the id of the phrase locator and the sizes,
+     * followed by the arrays of the index. The bit vectors are written using sdsl's serialization.
+     */
+    void save(const std::string &path) const {
+        std::ofstream out(path, std::ios::binary);
+        write_magic(out, INDEX_MAGIC);
+        write_value<uint64_t>(out, PhraseLocator::SERIAL_ID);
+        write_value<uint64_t>(out, m_source_length);
+        write_value<uint64_t>(out, m_index_bits);
+        write_value<uint64_t>(out, m_phrase_bits);
+
+        write_vector(out, m_last);
+        m_phrases.serialize(out);
+        m_source_begin.serialize(out);
+        write_vector(out, m_source_map);
+
+        write_vector(out, m_literal_bits);
+        write_vector(out, m_literal_rank);
+        write_vector(out, m_literal_start);
+        write_vector(out, m_literal_text);
+    }
+
+    /**
+     * @brief Loads an index written by `save`. Every array is read in one piece.
+     *
+     * Throws a `std::runtime_error` if the file is not an index or was saved with a different phrase locator.
+     */
+    static auto load(const std::string &path) -> BasicLzEnd {
+        std::ifstream in(path, std::ios::binary);
+        expect_magic(in, INDEX_MAGIC, "LzEnd index");
+        if (read_value<uint64_t>(in) != PhraseLocator::SERIAL_ID) {
+            throw std::runtime_error("the LzEnd index " + path + " was saved with a different phrase locator");
+        }
+
+        BasicLzEnd instance;
+        instance.m_source_length = read_value<uint64_t>(in);
+        instance.m_index_bits    = read_value<uint64_t>(in);
+        instance.m_phrase_bits   = read_value<uint64_t>(in);
+
+        read_vector(in, instance.m_last);
+        instance.m_phrases.load(in);
+        instance.m_source_begin.load(in);
+        instance.m_source_begin_r = Rank(&instance.m_source_begin);
+        instance.m_source_begin_s = Select(&instance.m_source_begin);
+        read_vector(in, instance.m_source_map);
+
+        read_vector(in, instance.m_literal_bits);
+        read_vector(in, instance.m_literal_rank);
+        read_vector(in, instance.m_literal_start);
+        read_vector(in, instance.m_literal_text);
+
+        if (!in) {
+            throw std::runtime_error("the LzEnd index " + path + " is truncated");
+        }
+        instance.advise_memory_policy();
+        return instance;
+    }
+
+    /**
+     * @brief Checks whether the given file starts with the magic number of a serialized index.
+     */
+    static auto is_index_file(const std::string &path) -> bool {
+        std::ifstream in(path, std::ios::binary);
+        return read_value<uint64_t>(in) == INDEX_MAGIC && in;
+    }
+
+    /**
+     * @brief Enables a cache of decoded text which is consulted before following a source pointer.
+     *
+     * Since many phrases refer to the same popular sources, the same parts of the text are decoded again and again.
+     * With a cache, an access stores the decoded character for every position it visited on the way, and substring
+     * queries store the text of short sources. The cache evicts the least recently used blocks of text.
+     *
+     * The cache is modified by the queries, so an instance with a cache must not be queried concurrently.
+     *
+     * @param capacity_bytes The approximate maximum size of the cache or 0 to disable it
+     */
+    void enable_cache(const size_t capacity_bytes) {
+        m_cache = capacity_bytes > 0 ? std::make_unique<BlockCache<Char>>(capacity_bytes) : nullptr;
+    }
+
+    /**
+     * @brief Returns the cache or nullptr if caching is disabled.
+     */
+    [[nodiscard]] inline auto cache() const -> BlockCache<Char> * { return m_cache.get(); }
+
     [[nodiscard]] auto at(size_t i) const -> char {
-        size_t phrase_id  = m_last_pos_r.rank(i);
+        if (m_cache) {
+            return cached_at(i);
+        }
+
+        size_t phrase_id  = m_phrases.phrase_of(i);
         auto   source_map = source_map_accessor();
 
-        while (!m_last_pos[i]) {
+        while (i != m_phrases.phrase_end(phrase_id)) {
+            if (is_literal(phrase_id)) {
+                return (char) literal_text(phrase_id)[i - m_phrases.phrase_start(phrase_id)];
+            }
+
             // Find the source_phrase of this phrase
             size_t source_phrase = source_map[phrase_id];
-            size_t phrase_start  = phrase_id > 0 ? select1_last_pos(phrase_id) + 1 : 0;
+            size_t phrase_start  = m_phrases.phrase_start(phrase_id);
 
             // We move to the source since this is where we need to read from
             size_t new_i = select1_source_begin(source_phrase + 1) - source_phrase - 1;
@@ -284,81 +492,336 @@ class LzEnd {
 
             i = new_i;
             // Find the new i's phrase
-            phrase_id = m_last_pos_r.rank(i);
+            phrase_id = m_phrases.phrase_of(i);
         }
         return (char) m_last[phrase_id];
     }
 
+    /**
+     * @brief Returns the number of jumps from phrase to source that an access to position i takes, not counting the
+     * cache. After `bound_hops`, this is at most its bound.
+     */
+    [[nodiscard]] auto hops(size_t i) const -> size_t {
+        size_t phrase_id = m_phrases.phrase_of(i);
+        size_t jumps     = 0;
+        while (i != m_phrases.phrase_end(phrase_id) && !is_literal(phrase_id)) {
+            i         = source_start(phrase_id) + (i - m_phrases.phrase_start(phrase_id));
+            phrase_id = m_phrases.phrase_of(i);
+            jumps++;
+        }
+        return jumps;
+    }
+
   private:
+    /**
+     * @brief The maximum number of positions visited by a single access that are stored in the cache.
+     */
+    static constexpr size_t CACHE_MAX_VISITED = 64;
+
+    /**
+     * @brief Random access which checks the cache before every jump to a source. All positions visited on the way
+     * contain the same character, so they are stored in the cache afterwards.
+     */
+    [[nodiscard]] auto cached_at(size_t i) const -> char {
+        std::array<size_t, CACHE_MAX_VISITED> visited;
+        size_t                                num_visited = 0;
+
+        size_t phrase_id = m_phrases.phrase_of(i);
+
+        Char c;
+        while (true) {
+            if (const Char *cached = m_cache->find(i)) {
+                c = *cached;
+                m_cache->record_hit();
+                break;
+            }
+            if (num_visited < visited.size()) {
+                visited[num_visited++] = i;
+            }
+            if (i == m_phrases.phrase_end(phrase_id)) {
+                c = m_last[phrase_id];
+                m_cache->record_miss();
+                break;
+            }
+            if (is_literal(phrase_id)) {
+                c = literal_text(phrase_id)[i - m_phrases.phrase_start(phrase_id)];
+                m_cache->record_miss();
+                break;
+            }
+
+            i         = source_start(phrase_id) + (i - m_phrases.phrase_start(phrase_id));
+            phrase_id = m_phrases.phrase_of(i);
+        }
+
+        for (size_t k = 0; k < num_visited; k++) {
+            m_cache->put(visited[k], c);
+        }
+        return (char) c;
+    }
+
+    /**
+     * @brief A part of the text which still has to be written to the output.
+     */
+    struct ExtractTask {
+        static constexpr size_t NO_FILL = SIZE_MAX;
+
+        size_t start;
+        size_t len;
+        /**
+         * @brief If this is not `NO_FILL`, this task does not extract anything. Instead, the text at positions `start`
+         * to `start + len - 1`, which has been written to the output at this offset, is stored in the cache.
+         */
+        size_t fill_from = NO_FILL;
+    };
+
+    /**
+     * @brief Extracts a substring left to right into the buffer.
+     *
+     * Instead of recursing into the sources of each phrase, the parts of the text which are still to be extracted are
+     * kept on a stack. Since the part on top of the stack is always the next one in the output, the output is written
+     * strictly from left to right and always contains a prefix of the substring. If a source lies in that prefix, it is
+     * copied from the output directly, like in an LZ decompressor.
+     *
+     * @param buf The output buffer. Must be able to hold `substr_len` characters.
+     * @return A pointer behind the last written character
+     */
     [[nodiscard("internal substring method should adjust buffer pointer")]] auto
     substr_internal(char *buf, const size_t substr_start, const size_t substr_len) const -> char * {
-        if (substr_len == 0) {
-            return buf;
+        thread_local std::vector<ExtractTask> tasks;
+        tasks.clear();
+        tasks.push_back({substr_start, substr_len});
+
+        using Cache = BlockCache<Char>;
+
+        char *out = buf;
+        while (!tasks.empty()) {
+            const auto [start, len, fill_from] = tasks.back();
+            tasks.pop_back();
+
+            if (fill_from != ExtractTask::NO_FILL) {
+                m_cache->put_range(start, reinterpret_cast<const Char *>(buf + fill_from), len);
+                continue;
+            }
+
+            // The output contains the text from substr_start up to out
+            if (start >= substr_start && start + len <= substr_start + (out - buf)) {
+                out = std::copy_n(buf + (start - substr_start), len, out);
+                continue;
+            }
+
+            // Only tasks inside a single block can be answered by the cache
+            if (m_cache && start % Cache::BLOCK_SIZE + len <= Cache::BLOCK_SIZE) {
+                if (const Char *cached = m_cache->find_range(start, len)) {
+                    m_cache->record_hit();
+                    out = std::copy_n(reinterpret_cast<const char *>(cached), len, out);
+                    continue;
+                }
+                m_cache->record_miss();
+            }
+
+            const size_t phrase_id    = m_phrases.phrase_of(start);
+            const size_t phrase_start = m_phrases.phrase_start(phrase_id);
+            const size_t phrase_end   = m_phrases.phrase_end(phrase_id);
+            // The part of the task inside this phrase
+            const size_t piece_len = std::min(start + len - 1, phrase_end) - start + 1;
+
+            if (piece_len < len) {
+                tasks.push_back({start + piece_len, len - piece_len});
+            }
+
+            if (is_literal(phrase_id)) {
+                const Char *text = literal_text(phrase_id) + (start - phrase_start);
+                out              = std::copy_n(text, piece_len, out);
+                continue;
+            }
+
+            if (start == phrase_end) {
+                *out++ = (char) m_last[phrase_id];
+                continue;
+            }
+
+            // Everything but the last character of the phrase is read from its source
+            size_t source_len = piece_len;
+            if (start + piece_len - 1 == phrase_end) {
+                tasks.push_back({phrase_end, 1});
+                source_len--;
+            }
+            const size_t source = source_start(phrase_id) + (start - phrase_start);
+            if (m_cache && source_len <= Cache::BLOCK_SIZE) {
+                // The source is written to the output next. Once it is, store it in the cache
+                tasks.push_back({source, source_len, (size_t) (out - buf)});
+            }
+            tasks.push_back({source, source_len});
         }
+        return out;
+    }
+
+    /**
+     * @brief A comparison of the texts of length `len` starting at `first` and `second`, of which the first `matched`
+     * characters are known to be equal.
+     */
+    struct LceTask {
+        size_t first;
+        size_t second;
+        size_t len;
+        size_t matched;
+    };
 
-        const size_t end_incl     = substr_start + substr_len - 1;
-        size_t       start_phrase = m_last_pos_r.rank(substr_start);
-        size_t       end_phrase   = m_last_pos_r.rank(end_incl);
-
-        auto source_map = source_map_accessor();
-
-        if (start_phrase == end_phrase) {
-            // Find the source of this phrase
-            size_t source       = source_map[start_phrase];
-            size_t start        = select1_source_begin(source + 1) - source - 1;
-            size_t phrase_start = start_phrase > 0 ? select1_last_pos(start_phrase) + 1 : 0;
-            size_t phrase_end   = select1_last_pos(start_phrase + 1);
-
-            // If the pattern doesn't start at the beginning of a phrase we need to add the offset to it
-            start += substr_start - phrase_start;
-
-            // If the substring ends before the phrase then we need to extract the entire thing from the sources alone
-            if (substr_start + substr_len - 1 < phrase_end) {
-                buf = substr_internal(buf, start, substr_len);
-            } else {
-                // In the other case, we can extract the last character directly and only have to get the rest from the
-                // sources
-                buf    = substr_internal(buf, start, substr_len - 1);
-                *buf++ = *reinterpret_cast<const char *>(&m_last[start_phrase]);
+  public:
+    /**
+     * @brief Returns the length of the longest common prefix of the suffixes of the text starting at i and j.
+     *
+     * All characters of a phrase but the last one are a copy of its source. So while the later of both positions lies
+     * inside a phrase, it is replaced by the corresponding position in the source, and a comparison of the rest of the
+     * phrase is pushed onto a stack. Once both positions are equal, the rest of the comparison matches as a whole,
+     * which skips phrases that are copied from the other position. Only the last characters of phrases and the
+     * characters of explicitly stored phrases are compared one at a time.
+     */
+    [[nodiscard]] auto lce(const size_t i, const size_t j) const -> size_t {
+        if (std::max(i, j) >= m_source_length) {
+            return 0;
+        }
+        thread_local std::vector<LceTask> tasks;
+        tasks.clear();
+        tasks.push_back({i, j, m_source_length - std::max(i, j), 0});
+
+        while (true) {
+            LceTask     &task   = tasks.back();
+            const size_t first  = task.first + task.matched;
+            const size_t second = task.second + task.matched;
+            if (task.matched == task.len || first == second) {
+                // The rest of this comparison matches, so the task that pushed it continues behind it
+                const size_t len = task.len;
+                tasks.pop_back();
+                if (tasks.empty()) {
+                    return len;
+                }
+                tasks.back().matched += len;
+                continue;
             }
-            return buf;
+
+            const size_t later        = std::max(first, second);
+            const size_t earlier      = std::min(first, second);
+            const size_t phrase_id    = m_phrases.phrase_of(later);
+            const size_t phrase_start = m_phrases.phrase_start(phrase_id);
+            const size_t phrase_end   = m_phrases.phrase_end(phrase_id);
+            if (later == phrase_end || is_literal(phrase_id)) {
+                const Char c = later == phrase_end ? m_last[phrase_id] : literal_text(phrase_id)[later - phrase_start];
+                if ((Char) at(earlier) != c) {
+                    // Every task on the stack ends at this mismatch
+                    size_t len = 0;
+                    for (const LceTask &t : tasks) {
+                        len += t.matched;
+                    }
+                    return len;
+                }
+                task.matched++;
+                continue;
+            }
+
+            const size_t len = std::min(phrase_end - later, task.len - task.matched);
+            tasks.push_back({earlier, source_start(phrase_id) + (later - phrase_start), len, 0});
+        }
+    }
+
+    /**
+     * @brief Bounds the number of jumps from phrase to source needed to access any text position.
+     *
+     * Phrases whose positions would need more jumps are stored explicitly. This needs extra space equal to the length
+     * of those phrases, so smaller bounds trade space for faster queries. Calling this again replaces the previous
+     * bound.
+     *
+     * @param max_hops The maximum number of jumps per access or 0 for no bound
+     * @return The number of explicitly stored phrases
+     */
+    auto bound_hops(const size_t max_hops) -> size_t {
+        m_literal_bits.clear();
+        m_literal_rank.clear();
+        m_literal_start.clear();
+        m_literal_text.clear();
+        const size_t n_phrases = num_phrases();
+        if (max_hops == 0 || n_phrases == 0) {
+            return 0;
         }
 
-        for (size_t i = start_phrase; i <= end_phrase; ++i) {
-            size_t start, len, phrase_start, phrase_end;
-            phrase_start = i > 0 ? select1_last_pos(i) + 1 : 0;
-            phrase_end   = select1_last_pos(i + 1);
-
-            // We find the start index of the source in the text
-            start = select1_source_begin(source_map[i] + 1) - source_map[i] - 1;
-
-            // We calculate the amount of characters we need to read from the source
-            if (i == start_phrase) {
-                // If this is the start phrase it might be that the substring starts inside a phrase.
-                // In that case, we need to add the offset inside the phrase to our source start position
-                start += substr_start - phrase_start;
-                len = select1_last_pos(start_phrase + 1) - substr_start + 1;
-            } else if (i == end_phrase) {
-                len = end_incl - select1_last_pos(end_phrase);
-            } else {
-                len = select1_last_pos(i + 1) - select1_last_pos(i);
+        // The maximum number of jumps for the positions of each phrase, in a segment tree for range maximum queries.
+        // Sources always lie before their phrase, so the depth of a phrase only depends on the depths of previous ones.
+        const size_t          leaves = std::bit_ceil(n_phrases);
+        std::vector<uint32_t> depth(2 * leaves, 0);
+        const auto            max_depth = [&](size_t l, size_t r) {
+            uint32_t max = 0;
+            for (l += leaves, r += leaves + 1; l < r; l /= 2, r /= 2) {
+                if (l & 1) {
+                    max = std::max(max, depth[l++]);
+                }
+                if (r & 1) {
+                    max = std::max(max, depth[--r]);
+                }
+            }
+            return max;
+        };
+
+        std::vector<size_t> literals;
+        for (size_t p = 0; p < n_phrases; p++) {
+            const size_t len = m_phrases.phrase_end(p) - m_phrases.phrase_start(p) + 1;
+            if (len == 1) {
+                continue;
             }
+            // The source covers all but the last character of the phrase
+            const size_t start = source_start(p);
+            const size_t end   = start + len - 2;
+            const size_t first = m_phrases.phrase_of(start);
+            const size_t last  = m_phrases.phrase_of(end);
+
+            // The last character of the first phrase needs no further jumps
+            uint32_t d = start < m_phrases.phrase_end(first) ? depth[leaves + first] : 0;
+            if (last > first) {
+                d = std::max(d, max_depth(first + 1, last));
+            }
+            d++;
 
-            // If this is the end phrase and the substring ends before the end of the phrase
-            // we need to extract the entire thing from sources alone
-            if (i == end_phrase && phrase_start + len - 1 < phrase_end) {
-                buf = substr_internal(buf, start, len);
-            } else {
-                // Otherwise we can get the last character of the phrase from the array and only the rest from the
-                // sources
-                buf    = substr_internal(buf, start, len - 1);
-                *buf++ = *reinterpret_cast<const char *>(&m_last[i]);
+            if (d > max_hops) {
+                literals.push_back(p);
+                d = 0;
+            }
+            for (size_t node = leaves + p; node > 0; node /= 2) {
+                depth[node] = std::max(depth[node], d);
             }
         }
-        return buf;
+        { auto drop = std::move(depth); }
+
+        if (literals.empty()) {
+            return 0;
+        }
+        m_literal_bits.resize(n_phrases / 64 + 1);
+        m_literal_rank.resize(m_literal_bits.size());
+        m_literal_start.reserve(literals.size());
+        size_t text_len = 0;
+        for (const size_t p : literals) {
+            m_literal_bits[p / 64] |= 1ULL << (p % 64);
+            m_literal_start.push_back(text_len);
+            text_len += m_phrases.phrase_end(p) - m_phrases.phrase_start(p) + 1;
+        }
+        for (size_t w = 1; w < m_literal_bits.size(); w++) {
+            m_literal_rank[w] = m_literal_rank[w - 1] + std::popcount(m_literal_bits[w - 1]);
+        }
+
+        // Extract the text of the phrases in order. Their sources lie before them, so every access only uses phrases
+        // which are either not explicit or already extracted.
+        m_literal_text.resize(text_len);
+        for (size_t r = 0; r < literals.size(); r++) {
+            const size_t p     = literals[r];
+            const size_t len   = m_phrases.phrase_end(p) - m_phrases.phrase_start(p) + 1;
+            const size_t start = source_start(p);
+            Char        *text  = m_literal_text.data() + m_literal_start[r];
+            for (size_t j = 0; j < len - 1; j++) {
+                text[j] = at(start + j);
+            }
+            text[len - 1] = m_last[p];
+        }
+        return literals.size();
     }
 
-  public:
     inline auto substr(char *buf, const size_t substr_start, const size_t substr_len) const -> char * {
         return substr_internal(buf, substr_start, std::min(substr_len, source_length() - substr_start));
     }
@@ -366,6 +829,16 @@ class LzEnd {
     [[nodiscard]] inline auto source_length() const -> size_t { return m_source_length; }
 };
 
+/**
+ * @brief The space efficient LzEnd implementation from the paper.
+ */
+using LzEnd = BasicLzEnd<SdPhraseLocator>;
+
+/**
+ * @brief An LzEnd implementation which uses more space to find phrases faster.
+ */
+using SampledLzEnd = BasicLzEnd<SampledPhraseLocator<>>;
+
 } // namespace gracli::lz
 
 #include "lzend_coder.hpp"
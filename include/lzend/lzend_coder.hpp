@@ -1,55 +1,372 @@
 #pragma once
 
+#include <algorithm>
+#include <bit>
+#include <climits>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <istream>
+#include <limits>
+#include <optional>
+#include <stdexcept>
 #include <string>
 #include <utility>
+#include <vector>
 
 #include <lzend/lzend.hpp>
-#include <util/bit_input_stream.hpp>
 
 namespace gracli::lz {
 
-auto decode(const std::string &file_path) -> std::pair<LzEnd::Parsing, size_t> {
+/**
+ * @brief The number of phrases read from the file at once by `decode`.
+ */
+constexpr size_t DECODE_BLOCK_PHRASES = 1 << 16;
+
+/**
+ * @brief Loads an integer of the given number of bits, stored least significant bit first starting at the given bit
+ * offset of a buffer. At least 9 bytes must be readable starting at the byte containing the first bit, so a full word
+ * can be loaded, shifted and masked.
+ */
+inline auto load_bits(const uint8_t *data, const size_t bit_offset, const size_t bits) -> uint64_t {
+    const uint8_t *bytes = data + bit_offset / CHAR_BIT;
+    const size_t   shift = bit_offset % CHAR_BIT;
+
+    uint64_t value;
+    std::memcpy(&value, bytes, sizeof(value));
+    if constexpr (std::endian::native == std::endian::big) {
+        value = __builtin_bswap64(value);
+    }
+    value >>= shift;
+    // The integer spans 9 bytes
+    if (shift + bits > sizeof(value) * CHAR_BIT) {
+        value |= (uint64_t) bytes[sizeof(value)] << (sizeof(value) * CHAR_BIT - shift);
+    }
+    return bits >= sizeof(value) * CHAR_BIT ? value : value & ((1ULL << bits) - 1);
+}
+
+/**
+ * @brief Reserves space in a container if it supports it. The toolkit's `space_efficient_vector` grows in blocks
+ * instead.
+ */
+template<typename Container>
+void reserve_if_supported(Container &container, const size_t size) {
+    if constexpr (requires { container.reserve(size); }) {
+        container.reserve(size);
+    }
+}
+
+/**
+ * @brief The size of the header of a parsing file in bytes.
+ */
+constexpr size_t PARSING_HEADER_BYTES = 8;
+
+/**
+ * @brief The widths of the fields of a parsing file and its number of phrases, as read by `read_parsing_header`.
+ */
+struct ParsingHeader {
+    size_t char_bits;
+    size_t int_bits;
+    size_t num_phrases;
+};
+
+/**
+ * @brief Reads the header of a parsing file (see `try_decode`) and derives the number of phrases from its size.
+ */
+inline auto read_parsing_header(const std::string &file_path) -> ParsingHeader {
     std::ifstream in(file_path, std::ios::binary);
-    BitIStream    br(std::move(in));
 
-    const auto char_width = br.read_int<uint8_t>() + 1;
-    const auto int_width  = br.read_int<uint8_t>() + 1;
-    const auto int_bytes  = int_width / CHAR_BIT;
+    uint8_t header[PARSING_HEADER_BYTES] = {};
+    in.read(reinterpret_cast<char *>(header), sizeof(header));
+
+    const size_t char_bits = header[0] + 1;
+    const size_t int_bits  = header[1] + 1;
+    if (int_bits > sizeof(LzEnd::TextOffset) * CHAR_BIT) {
+        throw std::runtime_error("integers of " + std::to_string(int_bits) + " bits in " + file_path +
+                                 " are too wide");
+    }
 
-    // We want to skip the next 6 bytes since they are still part of the header but don't contain any information
-    br.read_int<uint64_t>(6 * CHAR_BIT);
+    // The padding at the end of the file is shorter than a phrase
+    const size_t file_size = std::filesystem::file_size(file_path);
+    return {char_bits,
+            int_bits,
+            (file_size - std::min(file_size, sizeof(header))) * CHAR_BIT / (char_bits + 2 * int_bits)};
+}
 
-    size_t source_len = 0;
+/**
+ * @brief Reads an LzEnd parsing from a file as written by LZ-End Toolkit or `ParsingWriter`.
+ *
+ * The file starts with a header of 8 bytes containing the bit widths of characters and integers minus one. Each phrase
+ * is then stored as its last character followed by its link and its length. The fields are packed into a stream of
+ * bits without padding, each least significant bit first, and the stream is padded to whole bytes at its end. With
+ * widths which are multiples of 8, as written by the toolkit, the integers are plain little endian integers. The
+ * phrases are read in blocks of `DECODE_BLOCK_PHRASES`, and each field is a single unaligned load.
+ *
+ * @tparam Offset The integer type of the links and lengths in the parsing
+ * @return The parsing and the length of the text, or nothing if a link or length does not fit into `Offset`
+ */
+template<typename Offset>
+auto try_decode(const std::string &file_path) -> std::optional<std::pair<LzEnd::BasicParsing<Offset>, size_t>> {
+    const auto [char_bits, int_bits, num_phrases] = read_parsing_header(file_path);
+    const size_t record_bits                       = char_bits + 2 * int_bits;
+    if (num_phrases > std::numeric_limits<Offset>::max()) {
+        return std::nullopt;
+    }
 
-    LzEnd::Parsing parsing;
+    std::ifstream in(file_path, std::ios::binary);
+    in.seekg(PARSING_HEADER_BYTES);
 
-    while (!br.eof()) {
-        const auto        c           = br.read_int<LzEnd::Char>(char_width);
-        LzEnd::TextOffset prev_phrase = 0;
+    LzEnd::BasicParsing<Offset> parsing;
+    reserve_if_supported(parsing, num_phrases);
 
-        // TODO For the time being, this is assuming that int_width is a multiple of 8, in order to
-        //  implement little-endianness
-        for (size_t i = 0; i < int_bytes; ++i) {
-            const auto val = br.read_int<LzEnd::TextOffset>(CHAR_BIT);
-            prev_phrase |= val << (i * CHAR_BIT);
+    // DECODE_BLOCK_PHRASES is a multiple of 8, so every block starts at a byte boundary. The buffer is padded, so the
+    // last field of a block can be loaded as a full word.
+    static_assert(DECODE_BLOCK_PHRASES % CHAR_BIT == 0);
+    std::vector<uint8_t> buffer(DECODE_BLOCK_PHRASES * record_bits / CHAR_BIT + 2 * sizeof(uint64_t));
+    size_t               source_len = 0;
+    // The bitwise or of all lengths, to check whether they fit into Offset
+    uint64_t all_lengths = 0;
+
+    for (size_t block_start = 0; block_start < num_phrases; block_start += DECODE_BLOCK_PHRASES) {
+        const size_t block_phrases = std::min(DECODE_BLOCK_PHRASES, num_phrases - block_start);
+        const size_t block_bytes   = (block_phrases * record_bits + CHAR_BIT - 1) / CHAR_BIT;
+        in.read(reinterpret_cast<char *>(buffer.data()), (std::streamsize) block_bytes);
+
+        size_t record = 0;
+        for (size_t i = 0; i < block_phrases; i++, record += record_bits) {
+            const auto c           = (LzEnd::Char) load_bits(buffer.data(), record, char_bits);
+            const auto prev_phrase = load_bits(buffer.data(), record + char_bits, int_bits);
+            const auto phrase_len  = load_bits(buffer.data(), record + char_bits + int_bits, int_bits);
+
+            // Phrases of length 1 have no source
+            parsing.push_back({c, (Offset) (phrase_len > 1 ? prev_phrase : 0), (Offset) phrase_len});
+            source_len += phrase_len;
+            all_lengths |= phrase_len;
         }
-        LzEnd::TextOffset phrase_len = 0;
-        for (size_t i = 0; i < int_bytes; ++i) {
-            const auto val = br.read_int<LzEnd::TextOffset>(CHAR_BIT);
-            phrase_len |= val << (i * CHAR_BIT);
+    }
+
+    if (all_lengths > std::numeric_limits<Offset>::max()) {
+        return std::nullopt;
+    }
+    return std::make_pair(std::move(parsing), source_len);
+}
+
+/**
+ * @brief Reads an LzEnd parsing from a file with 64-bit links and lengths (see `try_decode`).
+ *
+ * @return The parsing and the length of the text
+ */
+inline auto decode(const std::string &file_path) -> std::pair<LzEnd::Parsing, size_t> {
+    return *try_decode<LzEnd::TextOffset>(file_path);
+}
+
+/**
+ * @brief Reads an LzEnd parsing from a file with 32-bit links and lengths if they fit, and with 64-bit ones
+ * otherwise, and calls a function with it.
+ *
+ * The width is chosen from the header before decoding, so the file is only decoded once: Integers of at most 32 bits
+ * always fit. Files with wider integers, such as those of the toolkit with 64-bit integers, are decoded with 64-bit
+ * links and lengths even if their values would fit into 32 bits.
+ *
+ * @param f A function called with the parsing (as an rvalue of either `LzEnd::BasicParsing<uint32_t>` or
+ * `LzEnd::Parsing`) and the length of the text
+ * @return The result of f
+ */
+template<typename F>
+auto with_decoded(const std::string &file_path, F &&f) {
+    const auto header = read_parsing_header(file_path);
+    if (header.int_bits <= 32 && header.num_phrases <= std::numeric_limits<uint32_t>::max()) {
+        auto [parsing, source_len] = *try_decode<uint32_t>(file_path);
+        return f(std::move(parsing), source_len);
+    }
+    auto [parsing, source_len] = decode(file_path);
+    return f(std::move(parsing), source_len);
+}
+
+/**
+ * @brief The estimated peak memory of `compute_lzend` in bytes per input character, including the input itself.
+ * This is used to derive the chunk size from a memory limit.
+ */
+constexpr size_t LZEND_PARSE_BYTES_PER_CHAR = 24;
+
+/**
+ * @brief The estimated peak memory of building an LzEnd index from a parsing in bytes per phrase, including the
+ * decoded parsing and the scratch arrays of the construction.
+ */
+constexpr size_t LZEND_INDEX_BYTES_PER_PHRASE = 48;
+
+/**
+ * @brief Returns the number of characters that can be parsed at once without exceeding the given amount of memory.
+ */
+inline auto chunk_size_for_memory(const size_t memory_bytes) -> size_t {
+    return std::max<size_t>(memory_bytes / LZEND_PARSE_BYTES_PER_CHAR, 1);
+}
+
+/**
+ * @brief Computes an LzEnd parsing of a stream with bounded memory by parsing it in chunks.
+ *
+ * The stream is read and parsed `chunk_size` characters at a time, and the phrases of each chunk are passed to the
+ * sink before the next chunk is read. Phrases never refer to sources in an earlier chunk, so the result is a valid
+ * LzEnd parsing of the whole text, but it can have more phrases than a parsing computed in one piece. The memory needed
+ * only depends on the chunk size, not on the length of the text.
+ *
+ * @param in The stream to parse
+ * @param chunk_size The maximum number of characters parsed at once
+ * @param sink A function that is called with each phrase in order. The links of the phrases are ids in the parsing of
+ * the whole text.
+ * @return The length of the text
+ */
+template<typename Sink>
+auto parse_chunked(std::istream &in, const size_t chunk_size, Sink &&sink) -> size_t {
+    using Char = LzEnd::Char;
+
+    std::vector<Char> chunk(chunk_size);
+    size_t            text_length  = 0;
+    size_t            phrase_count = 0;
+
+    // Parses a chunk with the given offset type and returns the number of phrases
+    const auto parse = [&]<typename Offset>(const size_t len) -> size_t {
+        LzEnd::BasicParsing<Offset> parsing;
+        compute_lzend<Char, Offset>(chunk.data(), len, &parsing);
+
+        const size_t chunk_phrases = parsing.size();
+        for (size_t i = 0; i < chunk_phrases; i++) {
+            const auto &p = parsing[i];
+            sink(LzEnd::Phrase{p.m_char, p.m_len > 1 ? p.m_link + phrase_count : 0, p.m_len});
+        }
+        return chunk_phrases;
+    };
+
+    while (in) {
+        in.read(reinterpret_cast<char *>(chunk.data()), (std::streamsize) chunk_size);
+        const size_t len = in.gcount();
+        if (len == 0) {
+            break;
         }
 
-        // TODO Idk if that middle term is right. I would have imagined that this is always 0 of phrase_len is 1
-        parsing.push_back({c, phrase_len > 1 ? prev_phrase : 0, phrase_len});
-        source_len += phrase_len;
+        // Chunks shorter than 2^32 are parsed with 32-bit offsets, which needs less memory
+        phrase_count += len <= UINT32_MAX ? parse.template operator()<uint32_t>(len)
+                                          : parse.template operator()<LzEnd::TextOffset>(len);
+        text_length += len;
     }
 
-    return std::make_pair(std::move(parsing), source_len);
+    return text_length;
+}
+
+/**
+ * @brief Writes an LzEnd parsing phrase by phrase in the format read by `decode`.
+ */
+class ParsingWriter {
+    std::ofstream m_out;
+    size_t        m_int_bits;
+    size_t        m_phrases;
+    // The bits of the last byte which have not been written yet
+    uint8_t m_pending;
+    size_t  m_pending_bits;
+
+    inline void write_bits(uint64_t value, size_t bits) {
+        while (bits > 0) {
+            const size_t take = std::min(bits, CHAR_BIT - m_pending_bits);
+            m_pending |= (uint8_t) ((value & ((1U << take) - 1)) << m_pending_bits);
+            m_pending_bits += take;
+            value >>= take;
+            bits -= take;
+            if (m_pending_bits == CHAR_BIT) {
+                m_out.put((char) m_pending);
+                m_pending      = 0;
+                m_pending_bits = 0;
+            }
+        }
+    }
+
+  public:
+    /**
+     * @brief Creates the file and writes the header.
+     *
+     * @param file_path The file to write to
+     * @param max_value An upper bound for all links and lengths, e.g. the length of the text
+     * @param packed Whether the integers use only as many bits as `max_value` needs. Otherwise they are padded to whole
+     * bytes, which tools expecting the format of LZ-End Toolkit can read as well.
+     */
+    ParsingWriter(const std::string &file_path, const uint64_t max_value, const bool packed = false) :
+        m_out(file_path, std::ios::binary),
+        // `decode` derives the number of phrases from the file size, so no padding is needed to mark the end
+        m_int_bits{std::max<size_t>(std::bit_width(max_value), 1)},
+        m_phrases{0},
+        m_pending{0},
+        m_pending_bits{0} {
+        if (!packed) {
+            m_int_bits = (m_int_bits + CHAR_BIT - 1) / CHAR_BIT * CHAR_BIT;
+        }
+        m_out.put((char) (sizeof(LzEnd::Char) * CHAR_BIT - 1));
+        m_out.put((char) (m_int_bits - 1));
+        for (size_t i = 0; i < 6; i++) {
+            m_out.put(0);
+        }
+    }
+
+    ParsingWriter(const ParsingWriter &) = delete;
+
+    /**
+     * @brief Pads the last phrase to a whole byte and writes it.
+     */
+    ~ParsingWriter() { finish(); }
+
+    /**
+     * @brief Pads the last phrase to a whole byte and writes it. No more phrases may be written afterwards.
+     */
+    inline void finish() {
+        if (m_pending_bits > 0) {
+            m_out.put((char) m_pending);
+            m_pending      = 0;
+            m_pending_bits = 0;
+        }
+        m_out.flush();
+    }
+
+    inline void write(const LzEnd::Phrase &phrase) {
+        write_bits(phrase.m_char, sizeof(LzEnd::Char) * CHAR_BIT);
+        write_bits(phrase.m_link, m_int_bits);
+        write_bits(phrase.m_len, m_int_bits);
+        m_phrases++;
+    }
+
+    /**
+     * @brief Returns the number of phrases written so far.
+     */
+    [[nodiscard]] inline auto num_phrases() const -> size_t { return m_phrases; }
+
+    [[nodiscard]] inline auto good() const -> bool { return m_out.good(); }
+};
+
+/**
+ * @brief Computes the LzEnd parsing of a text file with bounded memory and writes it in the format read by `decode`.
+ *
+ * @param text_path The text to parse
+ * @param out_path The file to write the parsing to
+ * @param chunk_size The maximum number of characters parsed at once (see `parse_chunked`)
+ * @return The length of the text and the number of phrases
+ */
+inline auto encode_chunked(const std::string &text_path, const std::string &out_path, const size_t chunk_size)
+    -> std::pair<size_t, size_t> {
+    std::ifstream in(text_path, std::ios::binary);
+    ParsingWriter writer(out_path, std::filesystem::file_size(text_path));
+
+    const size_t text_length =
+        parse_chunked(in, chunk_size, [&](const LzEnd::Phrase &phrase) { writer.write(phrase); });
+    return {text_length, writer.num_phrases()};
 }
 
-auto LzEnd::from_file(const std::string &file) -> LzEnd {
-    auto [parsing, source_len] = decode(file);
-    return from_parsing(std::move(parsing), source_len);
+template<typename PhraseLocator>
+auto BasicLzEnd<PhraseLocator>::from_file(const std::string &file) -> BasicLzEnd {
+    if (is_index_file(file)) {
+        return load(file);
+    }
+    return with_decoded(file, [](auto &&parsing, const size_t source_len) {
+        return from_parsing(std::move(parsing), source_len);
+    });
 }
 
 }; // namespace gracli::lz
@@ -0,0 +1,276 @@
+#pragma once
+
+#include <algorithm>
+#include <bit>
+#include <climits>
+#include <cstdint>
+#include <istream>
+#include <ostream>
+#include <vector>
+
+#include <util/memory_policy.hpp>
+#include <util/serialization.hpp>
+
+#include <sdsl/sd_vector.hpp>
+
+namespace gracli::lz {
+
+/**
+ * @brief Finds the phrase containing a text position using a sparse bit vector which marks the last position of each
+ * phrase.
+ *
+ * This is the bit vector B from the paper "Self-Index Based on LZ77" by Kreft and Navarro. It needs the least space of
+ * the phrase locators, but every query decodes Elias-Fano encoded positions.
+ */
+class SdPhraseLocator {
+    using BitVec = sdsl::sd_vector<sdsl::bit_vector>;
+    using Rank   = sdsl::rank_support_sd<1, sdsl::bit_vector>;
+    using Select = sdsl::select_support_sd<1, sdsl::bit_vector>;
+
+    /**
+     * @brief For each text position, stores a 1 if the position is the last character of a phrase.
+     */
+    BitVec m_last_pos;
+    Rank   m_last_pos_r;
+    Select m_last_pos_s;
+
+  public:
+    /**
+     * @brief Identifies this locator in serialized indices.
+     */
+    static constexpr uint64_t SERIAL_ID = 0;
+
+    SdPhraseLocator() : m_last_pos{}, m_last_pos_r{nullptr}, m_last_pos_s{nullptr} {}
+
+    /**
+     * @brief Builds the locator.
+     *
+     * @param n The length of the text
+     * @param n_phrases The number of phrases
+     * @param phrase_end A function that returns the last text position of the phrase with the given id. It is called
+     * exactly once for each phrase in ascending order.
+     */
+    template<typename EndFn>
+    SdPhraseLocator(const size_t n, const size_t n_phrases, EndFn &&phrase_end) {
+        sdsl::sd_vector_builder svb(n, n_phrases);
+        for (size_t k = 0; k < n_phrases; k++) {
+            svb.set(phrase_end(k));
+        }
+        m_last_pos   = BitVec(svb);
+        m_last_pos_r = Rank(&m_last_pos);
+        m_last_pos_s = Select(&m_last_pos);
+    }
+
+    SdPhraseLocator(SdPhraseLocator &&other) noexcept :
+        m_last_pos{std::move(other.m_last_pos)},
+        m_last_pos_r{&m_last_pos},
+        m_last_pos_s{&m_last_pos} {
+        other.m_last_pos_r = Rank(nullptr);
+        other.m_last_pos_s = Select(nullptr);
+    }
+
+    auto operator=(SdPhraseLocator &&other) noexcept -> SdPhraseLocator & {
+        m_last_pos         = std::move(other.m_last_pos);
+        m_last_pos_r       = Rank(&m_last_pos);
+        m_last_pos_s       = Select(&m_last_pos);
+        other.m_last_pos_r = Rank(nullptr);
+        other.m_last_pos_s = Select(nullptr);
+        return *this;
+    }
+
+    /**
+     * @brief Returns the id of the phrase containing the given text position.
+     * This is the number of phrases ending before it.
+     */
+    [[nodiscard]] inline auto phrase_of(const size_t i) const -> size_t { return m_last_pos_r.rank(i); }
+
+    /**
+     * @brief Returns the last text position of the phrase with the given id.
+     */
+    [[nodiscard]] inline auto phrase_end(const size_t phrase_id) const -> size_t {
+        return m_last_pos_s.select(phrase_id + 1);
+    }
+
+    /**
+     * @brief Returns the first text position of the phrase with the given id.
+     */
+    [[nodiscard]] inline auto phrase_start(const size_t phrase_id) const -> size_t {
+        return phrase_id > 0 ? phrase_end(phrase_id - 1) + 1 : 0;
+    }
+
+    /**
+     * @brief Checks whether the given text position is the last position of a phrase.
+     */
+    [[nodiscard]] inline auto is_phrase_end(const size_t i) const -> bool { return m_last_pos[i]; }
+
+    /**
+     * @brief Applies the memory policy to the bit vector, which is not allocated by a `PolicyAllocator`
+     */
+    void advise(const MemoryPolicy &policy) const {
+        policy.advise(m_last_pos.low.data(), m_last_pos.low.bit_size() / CHAR_BIT);
+        policy.advise(m_last_pos.high.data(), m_last_pos.high.bit_size() / CHAR_BIT);
+    }
+
+    void serialize(std::ostream &out) const { m_last_pos.serialize(out); }
+
+    void load(std::istream &in) {
+        m_last_pos.load(in);
+        m_last_pos_r = Rank(&m_last_pos);
+        m_last_pos_s = Select(&m_last_pos);
+    }
+};
+
+/**
+ * @brief Finds the phrase containing a text position using a plain array of phrase ends and a sampled lookup table.
+ *
+ * The text is divided into blocks of 2^k positions, where k is chosen such that a block contains about
+ * `PHRASES_PER_BLOCK` phrase ends on average. For each block, the table stores the number of phrases ending before
+ * it. A query looks up the block of its position and counts the phrase ends inside the block which lie before the
+ * position. Short ranges are counted with a branchless loop which the compiler vectorizes, long ranges (in blocks with
+ * many short phrases) are searched with a branchless binary search.
+ *
+ * Compared to `SdPhraseLocator`, this needs a full integer per phrase, but queries touch at most two cache lines in
+ * the common case and selecting a phrase end is a plain array access.
+ *
+ * @tparam PHRASES_PER_BLOCK The average number of phrases per block. Smaller values need more space for the table.
+ */
+template<size_t PHRASES_PER_BLOCK = 8>
+class SampledPhraseLocator {
+    /**
+     * @brief Ranges of at most this many phrase ends are counted linearly instead of using binary search.
+     */
+    static constexpr size_t LINEAR_SEARCH_LIMIT = 32;
+
+    /**
+     * @brief The last text position of each phrase.
+     */
+    std::vector<uint64_t, PolicyAllocator<uint64_t>> m_ends;
+
+    /**
+     * @brief For each block, the number of phrases ending before the block. Contains one more entry than there are
+     * blocks, so that the phrase ends of block b are always `m_ends[m_block_phrases[b]..m_block_phrases[b + 1]]`.
+     */
+    std::vector<uint64_t, PolicyAllocator<uint64_t>> m_block_phrases;
+
+    /**
+     * @brief Each block contains 2^m_block_bits text positions.
+     */
+    uint8_t m_block_bits;
+
+    /**
+     * @brief Counts the phrase ends in [first, last) which lie before the text position i.
+     */
+    [[nodiscard]] static inline auto count_before(const uint64_t *first, const uint64_t *last, const uint64_t i)
+        -> size_t {
+        size_t len = last - first;
+        if (len <= LINEAR_SEARCH_LIMIT) {
+            size_t count = 0;
+            for (size_t j = 0; j < len; j++) {
+                count += first[j] < i;
+            }
+            return count;
+        }
+
+        const uint64_t *base = first;
+        while (len > 1) {
+            const size_t half = len / 2;
+            base              = base[half - 1] < i ? base + half : base;
+            len -= half;
+        }
+        return (base - first) + (*base < i);
+    }
+
+  public:
+    /**
+     * @brief Identifies this locator in serialized indices.
+     */
+    static constexpr uint64_t SERIAL_ID = PHRASES_PER_BLOCK;
+
+    SampledPhraseLocator() : m_ends{}, m_block_phrases{}, m_block_bits{0} {}
+
+    /**
+     * @brief Builds the locator.
+     *
+     * @param n The length of the text
+     * @param n_phrases The number of phrases
+     * @param phrase_end A function that returns the last text position of the phrase with the given id. It is called
+     * exactly once for each phrase in ascending order.
+     */
+    template<typename EndFn>
+    SampledPhraseLocator(const size_t n, const size_t n_phrases, EndFn &&phrase_end) {
+        const size_t avg_phrase_len = n / std::max<size_t>(n_phrases, 1);
+        m_block_bits = std::bit_width(std::max<size_t>(avg_phrase_len * PHRASES_PER_BLOCK, 1)) - 1;
+
+        m_ends.resize(n_phrases);
+        for (size_t k = 0; k < n_phrases; k++) {
+            m_ends[k] = phrase_end(k);
+        }
+
+        const size_t n_blocks = (n >> m_block_bits) + 1;
+        m_block_phrases.resize(n_blocks + 1);
+        size_t phrase = 0;
+        for (size_t b = 0; b < n_blocks; b++) {
+            const size_t block_start = b << m_block_bits;
+            while (phrase < n_phrases && m_ends[phrase] < block_start) {
+                phrase++;
+            }
+            m_block_phrases[b] = phrase;
+        }
+        m_block_phrases[n_blocks] = n_phrases;
+    }
+
+    SampledPhraseLocator(SampledPhraseLocator &&other) noexcept = default;
+
+    auto operator=(SampledPhraseLocator &&other) noexcept -> SampledPhraseLocator & = default;
+
+    /**
+     * @brief Returns the id of the phrase containing the given text position.
+     * This is the number of phrases ending before it.
+     */
+    [[nodiscard]] inline auto phrase_of(const size_t i) const -> size_t {
+        const size_t    block = i >> m_block_bits;
+        const uint64_t *ends  = m_ends.data();
+        const size_t    first = m_block_phrases[block];
+        const size_t    last  = m_block_phrases[block + 1];
+        return first + count_before(ends + first, ends + last, i);
+    }
+
+    /**
+     * @brief Returns the last text position of the phrase with the given id.
+     */
+    [[nodiscard]] inline auto phrase_end(const size_t phrase_id) const -> size_t { return m_ends[phrase_id]; }
+
+    /**
+     * @brief Returns the first text position of the phrase with the given id.
+     */
+    [[nodiscard]] inline auto phrase_start(const size_t phrase_id) const -> size_t {
+        return phrase_id > 0 ? m_ends[phrase_id - 1] + 1 : 0;
+    }
+
+    /**
+     * @brief Checks whether the given text position is the last position of a phrase.
+     */
+    [[nodiscard]] inline auto is_phrase_end(const size_t i) const -> bool {
+        const size_t phrase_id = phrase_of(i);
+        return phrase_id < m_ends.size() && m_ends[phrase_id] == i;
+    }
+
+    /**
+     * @brief The arrays use a `PolicyAllocator`, so there is nothing left to advise.
+     */
+    void advise(const MemoryPolicy &) const {}
+
+    void serialize(std::ostream &out) const {
+        write_value<uint64_t>(out, m_block_bits);
+        write_vector(out, m_ends);
+        write_vector(out, m_block_phrases);
+    }
+
+    void load(std::istream &in) {
+        m_block_bits = read_value<uint64_t>(in);
+        read_vector(in, m_ends);
+        read_vector(in, m_block_phrases);
+    }
+};
+
+} // namespace gracli::lz
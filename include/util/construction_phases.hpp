@@ -0,0 +1,15 @@
+#pragma once
+
+namespace gracli {
+
+/**
+ * @brief A phase observer which ignores all phases.
+ *
+ * Data structures report the start of each of their construction phases to an observer (see `PhaseObserver`). This is
+ * the observer used when no one is interested in the phases.
+ */
+struct NoPhases {
+    inline void phase(const char *) {}
+};
+
+} // namespace gracli
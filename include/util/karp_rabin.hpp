@@ -0,0 +1,101 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+namespace gracli {
+
+/**
+ * @brief Karp-Rabin fingerprints modulo the Mersenne prime 2^61 - 1.
+ *
+ * The fingerprint of a string s of length m is s[0] * B^(m-1) + ... + s[m-1] * B^0 mod 2^61 - 1 for the base B.
+ * Equal strings have equal fingerprints, and two different strings of length m collide with probability at most
+ * m / 2^61 over the choice of the base.
+ */
+class KarpRabin {
+  public:
+    static constexpr uint64_t PRIME = (1ULL << 61) - 1;
+
+  private:
+    uint64_t m_base;
+
+  public:
+    /**
+     * @brief The base used if none is given. It is fixed so that fingerprints are the same in every run.
+     */
+    static constexpr uint64_t DEFAULT_BASE = 0x1d8e'4e27'c47d'124fULL % PRIME;
+
+    explicit KarpRabin(const uint64_t base = DEFAULT_BASE) : m_base{base % PRIME} {}
+
+    /**
+     * @brief Returns a * b mod 2^61 - 1 for a, b < 2^61 - 1.
+     */
+    static inline auto mul(const uint64_t a, const uint64_t b) -> uint64_t {
+        const __uint128_t product = (__uint128_t) a * b;
+        const uint64_t    sum     = (uint64_t) (product & PRIME) + (uint64_t) (product >> 61);
+        return sum >= PRIME ? sum - PRIME : sum;
+    }
+
+    /**
+     * @brief Returns a + b mod 2^61 - 1 for a, b < 2^61 - 1.
+     */
+    static inline auto add(const uint64_t a, const uint64_t b) -> uint64_t {
+        const uint64_t sum = a + b;
+        return sum >= PRIME ? sum - PRIME : sum;
+    }
+
+    /**
+     * @brief Returns a - b mod 2^61 - 1 for a, b < 2^61 - 1.
+     */
+    static inline auto sub(const uint64_t a, const uint64_t b) -> uint64_t { return a >= b ? a - b : a + PRIME - b; }
+
+    [[nodiscard]] inline auto base() const -> uint64_t { return m_base; }
+
+    /**
+     * @brief Returns B^e mod 2^61 - 1.
+     */
+    [[nodiscard]] auto pow(size_t e) const -> uint64_t {
+        uint64_t result = 1;
+        uint64_t power  = m_base;
+        for (; e > 0; e >>= 1) {
+            if (e & 1) {
+                result = mul(result, power);
+            }
+            power = mul(power, power);
+        }
+        return result;
+    }
+
+    /**
+     * @brief Returns the fingerprint of the string extended by one character on the right.
+     */
+    [[nodiscard]] inline auto append(const uint64_t fingerprint, const uint64_t c) const -> uint64_t {
+        return add(mul(fingerprint, m_base), c);
+    }
+
+    /**
+     * @brief Returns the fingerprint of the characters `text[0]` to `text[len - 1]`.
+     */
+    template<typename Char>
+    [[nodiscard]] auto fingerprint(const Char *text, const size_t len) const -> uint64_t {
+        uint64_t fingerprint = 0;
+        for (size_t i = 0; i < len; i++) {
+            fingerprint = append(fingerprint, (uint64_t) text[i]);
+        }
+        return fingerprint;
+    }
+
+    /**
+     * @brief Returns the fingerprint of a window of fixed length m shifted one character to the right, i.e. with `out`
+     * removed on the left and `in` appended on the right.
+     *
+     * @param fingerprint The fingerprint of the window before the shift
+     * @param out_pow The character leaving the window multiplied by B^(m-1), i.e. `mul(out, pow(m - 1))`
+     */
+    [[nodiscard]] inline auto roll(const uint64_t fingerprint, const uint64_t out_pow, const uint64_t in) const
+        -> uint64_t {
+        return append(sub(fingerprint, out_pow), in);
+    }
+};
+
+} // namespace gracli
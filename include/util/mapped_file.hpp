@@ -0,0 +1,99 @@
+#pragma once
+
+#include <cerrno>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <stdexcept>
+#include <string>
+#include <utility>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace gracli {
+
+/**
+ * @brief A file mapped read-only into memory.
+ *
+ * The pages are loaded from the page cache on first access and shared with every other process mapping the same file,
+ * so opening a mapping costs almost nothing regardless of the size of the file. The mapping is removed when the object
+ * is destroyed.
+ */
+class MappedFile {
+    const uint8_t *m_data;
+    size_t         m_size;
+
+    MappedFile(const uint8_t *data, const size_t size) : m_data{data}, m_size{size} {}
+
+  public:
+    /**
+     * @brief Maps a file. Throws a `std::runtime_error` if the file cannot be opened or mapped.
+     */
+    static auto open(const std::string &path) -> MappedFile {
+        const int fd = ::open(path.c_str(), O_RDONLY);
+        if (fd < 0) {
+            throw std::runtime_error("could not open " + path + ": " + std::strerror(errno));
+        }
+
+        struct stat st {};
+        if (fstat(fd, &st) != 0) {
+            const int error = errno;
+            close(fd);
+            throw std::runtime_error("could not stat " + path + ": " + std::strerror(error));
+        }
+
+        const auto size = (size_t) st.st_size;
+        if (size == 0) {
+            close(fd);
+            return {nullptr, 0};
+        }
+
+        void *data = mmap(nullptr, size, PROT_READ, MAP_SHARED, fd, 0);
+        // The mapping stays valid after the file is closed
+        close(fd);
+        if (data == MAP_FAILED) {
+            throw std::runtime_error("could not map " + path + ": " + std::strerror(errno));
+        }
+        return {static_cast<const uint8_t *>(data), size};
+    }
+
+    MappedFile() : m_data{nullptr}, m_size{0} {}
+
+    MappedFile(MappedFile &&other) noexcept :
+        m_data{std::exchange(other.m_data, nullptr)},
+        m_size{std::exchange(other.m_size, 0)} {}
+
+    auto operator=(MappedFile &&other) noexcept -> MappedFile & {
+        std::swap(m_data, other.m_data);
+        std::swap(m_size, other.m_size);
+        return *this;
+    }
+
+    MappedFile(const MappedFile &)                     = delete;
+    auto operator=(const MappedFile &) -> MappedFile & = delete;
+
+    ~MappedFile() {
+        if (m_data != nullptr) {
+            munmap(const_cast<uint8_t *>(m_data), m_size);
+        }
+    }
+
+    /**
+     * @brief Tells the kernel how the mapping will be accessed (see madvise(2)), e.g. `MADV_RANDOM` to disable
+     * read-ahead for random queries.
+     */
+    void advise(const int advice) const {
+        if (m_data != nullptr) {
+            madvise(const_cast<uint8_t *>(m_data), m_size, advice);
+        }
+    }
+
+    [[nodiscard]] inline auto data() const -> const uint8_t * { return m_data; }
+
+    [[nodiscard]] inline auto size() const -> size_t { return m_size; }
+};
+
+} // namespace gracli
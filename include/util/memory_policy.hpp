@@ -0,0 +1,320 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <cctype>
+#include <cstddef>
+#include <cstdint>
+#include <filesystem>
+#include <limits>
+#include <memory>
+#include <new>
+#include <string>
+#include <vector>
+
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+namespace gracli {
+
+/**
+ * @brief Whether large arrays should be backed by huge pages.
+ */
+enum class HugePages : uint8_t {
+    None,
+    /**
+     * @brief Advise the kernel to back the memory with transparent huge pages (madvise(MADV_HUGEPAGE)).
+     */
+    Transparent,
+    /**
+     * @brief Map memory from the explicit huge page pool (MAP_HUGETLB). Falls back to transparent huge pages if the pool
+     * is exhausted or the memory was not allocated by gracli.
+     */
+    Explicit,
+};
+
+/**
+ * @brief Where large arrays should be placed on NUMA machines.
+ */
+enum class NumaPlacement : uint8_t {
+    /**
+     * @brief Leave the placement to the kernel (usually first touch).
+     */
+    Default,
+    /**
+     * @brief Interleave the pages round-robin over all NUMA nodes.
+     */
+    Interleave,
+    /**
+     * @brief Bind the pages to a single NUMA node.
+     */
+    Bind,
+};
+
+/**
+ * @brief Describes how the large arrays of the data structures are allocated and placed in memory.
+ *
+ * There is one process-wide policy (see `global`) which is consulted by the data structures during construction. It
+ * is applied in two ways:
+ * - Arrays owned by gracli use `PolicyAllocator` which maps large allocations directly according to the policy.
+ * - Arrays owned by libraries (packed vectors, sdsl bit vectors) are advised after the fact using `advise`. This
+ * supports transparent huge pages and NUMA placement, but not explicit huge pages.
+ */
+class MemoryPolicy {
+  public:
+    /**
+     * @brief The size of a huge page. This is 2 MiB on x86-64.
+     */
+    static constexpr size_t HUGE_PAGE_SIZE = 2 * 1024 * 1024;
+
+    HugePages     huge_pages = HugePages::None;
+    NumaPlacement numa       = NumaPlacement::Default;
+    /**
+     * @brief The node to bind to if `numa` is `NumaPlacement::Bind`
+     */
+    size_t numa_node = 0;
+
+    /**
+     * @brief The process-wide policy used by the data structures.
+     */
+    static auto global() -> MemoryPolicy & {
+        static MemoryPolicy policy;
+        return policy;
+    }
+
+    /**
+     * @brief Parses a policy from the command line values for huge pages ("none", "thp" or "explicit") and NUMA
+     * placement ("default", "interleave" or the id of a node to bind to).
+     *
+     * @return Whether both values were valid
+     */
+    auto parse(const std::string &huge_pages_str, const std::string &numa_str) -> bool {
+        if (huge_pages_str == "none") {
+            huge_pages = HugePages::None;
+        } else if (huge_pages_str == "thp") {
+            huge_pages = HugePages::Transparent;
+        } else if (huge_pages_str == "explicit") {
+            huge_pages = HugePages::Explicit;
+        } else {
+            return false;
+        }
+
+        if (numa_str == "default") {
+            numa = NumaPlacement::Default;
+        } else if (numa_str == "interleave") {
+            numa = NumaPlacement::Interleave;
+        } else {
+            try {
+                numa_node = std::stoul(numa_str);
+            } catch (std::exception const &e) {
+                return false;
+            }
+            numa = NumaPlacement::Bind;
+        }
+        return true;
+    }
+
+    [[nodiscard]] auto huge_pages_name() const -> std::string {
+        switch (huge_pages) {
+            case HugePages::None:
+                return "none";
+            case HugePages::Transparent:
+                return "thp";
+            case HugePages::Explicit:
+                return "explicit";
+        }
+        return "";
+    }
+
+    [[nodiscard]] auto numa_name() const -> std::string {
+        switch (numa) {
+            case NumaPlacement::Default:
+                return "default";
+            case NumaPlacement::Interleave:
+                return "interleave";
+            case NumaPlacement::Bind:
+                return "node" + std::to_string(numa_node);
+        }
+        return "";
+    }
+
+    /**
+     * @brief The number of bytes currently allocated using `map`. These are not seen by malloc_count.
+     */
+    static auto mapped_bytes() -> size_t { return mapped_bytes_counter().load(std::memory_order_relaxed); }
+
+    [[nodiscard]] inline auto is_default() const -> bool {
+        return huge_pages == HugePages::None && numa == NumaPlacement::Default;
+    }
+
+    /**
+     * @brief Applies the huge page and NUMA policy to an existing memory range.
+     *
+     * Only the pages lying entirely inside the range are affected, so this never touches memory belonging to other
+     * allocations. Failures are ignored, since the policy is only an optimization.
+     *
+     * @param ptr The start of the range
+     * @param bytes The length of the range in bytes
+     */
+    void advise(const void *ptr, const size_t bytes) const {
+        if (is_default() || ptr == nullptr) {
+            return;
+        }
+        const auto page_size = (uintptr_t) sysconf(_SC_PAGESIZE);
+        const auto begin     = ((uintptr_t) ptr + page_size - 1) & ~(page_size - 1);
+        const auto end       = ((uintptr_t) ptr + bytes) & ~(page_size - 1);
+        if (end <= begin) {
+            return;
+        }
+        void *const  aligned = (void *) begin;
+        const size_t len     = end - begin;
+
+        if (huge_pages != HugePages::None) {
+            madvise(aligned, len, MADV_HUGEPAGE);
+        }
+        bind(aligned, len);
+    }
+
+    /**
+     * @brief Allocates memory according to this policy using mmap. The memory must be freed using `unmap`.
+     *
+     * @param bytes The number of bytes to allocate
+     * @return The allocated memory or nullptr if the allocation failed
+     */
+    [[nodiscard]] auto map(const size_t bytes) const -> void * {
+        const size_t len = mapped_length(bytes);
+        void        *ptr = MAP_FAILED;
+        if (huge_pages == HugePages::Explicit) {
+            ptr = mmap(nullptr, len, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+        }
+        if (ptr == MAP_FAILED) {
+            ptr = mmap(nullptr, len, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+            if (ptr == MAP_FAILED) {
+                return nullptr;
+            }
+            if (huge_pages != HugePages::None) {
+                madvise(ptr, len, MADV_HUGEPAGE);
+            }
+        }
+        bind(ptr, len);
+        mapped_bytes_counter().fetch_add(bytes, std::memory_order_relaxed);
+        return ptr;
+    }
+
+    /**
+     * @brief Frees memory allocated with `map`.
+     *
+     * @param ptr The memory returned by `map`
+     * @param bytes The number of bytes that were requested from `map`
+     */
+    static void unmap(void *ptr, const size_t bytes) {
+        munmap(ptr, mapped_length(bytes));
+        mapped_bytes_counter().fetch_sub(bytes, std::memory_order_relaxed);
+    }
+
+  private:
+    static auto mapped_bytes_counter() -> std::atomic<size_t> & {
+        static std::atomic<size_t> counter{0};
+        return counter;
+    }
+
+    /**
+     * @brief Mapped memory is always a multiple of the huge page size, so it can be unmapped without knowing whether
+     * huge pages were used.
+     */
+    static inline auto mapped_length(const size_t bytes) -> size_t {
+        return (bytes + HUGE_PAGE_SIZE - 1) / HUGE_PAGE_SIZE * HUGE_PAGE_SIZE;
+    }
+
+    static auto numa_node_count() -> size_t {
+        static const size_t count = [] {
+            size_t          n = 0;
+            std::error_code ec;
+            for (const auto &entry : std::filesystem::directory_iterator("/sys/devices/system/node", ec)) {
+                const auto name = entry.path().filename().string();
+                if (name.rfind("node", 0) == 0 && name.size() > 4 && std::isdigit(name[4])) {
+                    n++;
+                }
+            }
+            return std::max(n, (size_t) 1);
+        }();
+        return count;
+    }
+
+    /**
+     * @brief Applies the NUMA placement to a page-aligned range using mbind.
+     * We use the raw system call, so we do not need to link against libnuma.
+     */
+    void bind(void *aligned, const size_t len) const {
+        // Constants from numaif.h
+        constexpr int      MPOL_BIND_       = 2;
+        constexpr int      MPOL_INTERLEAVE_ = 3;
+        constexpr unsigned MPOL_MF_MOVE_    = 1 << 1;
+        constexpr size_t   WORD_BITS        = std::numeric_limits<unsigned long>::digits;
+
+        if (numa == NumaPlacement::Default) {
+            return;
+        }
+        const size_t nodes = numa_node_count();
+        if (numa == NumaPlacement::Bind && numa_node >= nodes) {
+            return;
+        }
+
+        std::vector<unsigned long> mask(nodes / WORD_BITS + 1, 0);
+        if (numa == NumaPlacement::Interleave) {
+            for (size_t node = 0; node < nodes; node++) {
+                mask[node / WORD_BITS] |= 1UL << (node % WORD_BITS);
+            }
+        } else {
+            mask[numa_node / WORD_BITS] |= 1UL << (numa_node % WORD_BITS);
+        }
+        const int mode = numa == NumaPlacement::Interleave ? MPOL_INTERLEAVE_ : MPOL_BIND_;
+        syscall(SYS_mbind, aligned, len, mode, mask.data(), mask.size() * WORD_BITS + 1, MPOL_MF_MOVE_);
+    }
+};
+
+/**
+ * @brief An allocator which allocates large arrays according to the global `MemoryPolicy`.
+ *
+ * Allocations of at least `MemoryPolicy::HUGE_PAGE_SIZE` bytes are mapped directly, all other allocations use the
+ * regular heap. Whether an allocation was mapped only depends on its size, so memory allocated under one policy can
+ * safely be freed after the policy changed.
+ */
+template<typename T>
+struct PolicyAllocator {
+    using value_type = T;
+
+    PolicyAllocator() noexcept = default;
+
+    template<typename U>
+    PolicyAllocator(const PolicyAllocator<U> &) noexcept {}
+
+    [[nodiscard]] auto allocate(const size_t n) -> T * {
+        const size_t bytes = n * sizeof(T);
+        if (bytes < MemoryPolicy::HUGE_PAGE_SIZE) {
+            return std::allocator<T>().allocate(n);
+        }
+        void *ptr = MemoryPolicy::global().map(bytes);
+        if (ptr == nullptr) {
+            throw std::bad_alloc();
+        }
+        return static_cast<T *>(ptr);
+    }
+
+    void deallocate(T *ptr, const size_t n) noexcept {
+        const size_t bytes = n * sizeof(T);
+        if (bytes < MemoryPolicy::HUGE_PAGE_SIZE) {
+            std::allocator<T>().deallocate(ptr, n);
+            return;
+        }
+        MemoryPolicy::unmap(ptr, bytes);
+    }
+
+    template<typename U>
+    auto operator==(const PolicyAllocator<U> &) const noexcept -> bool {
+        return true;
+    }
+};
+
+} // namespace gracli
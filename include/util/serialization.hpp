@@ -0,0 +1,72 @@
+#pragma once
+
+#include <cstdint>
+#include <istream>
+#include <ostream>
+#include <stdexcept>
+#include <string>
+#include <type_traits>
+#include <vector>
+
+namespace gracli {
+
+/**
+ * @brief Writes the bytes of a trivially copyable value to a stream.
+ */
+template<typename T>
+    requires std::is_trivially_copyable_v<T>
+void write_value(std::ostream &out, const T &value) {
+    out.write(reinterpret_cast<const char *>(&value), sizeof(T));
+}
+
+/**
+ * @brief Reads a value written by `write_value`.
+ */
+template<typename T>
+    requires std::is_trivially_copyable_v<T>
+auto read_value(std::istream &in) -> T {
+    T value{};
+    in.read(reinterpret_cast<char *>(&value), sizeof(T));
+    return value;
+}
+
+/**
+ * @brief Writes the length of a vector followed by its contents to a stream.
+ */
+template<typename T, typename Alloc>
+    requires std::is_trivially_copyable_v<T>
+void write_vector(std::ostream &out, const std::vector<T, Alloc> &vec) {
+    write_value<uint64_t>(out, vec.size());
+    out.write(reinterpret_cast<const char *>(vec.data()), (std::streamsize) (vec.size() * sizeof(T)));
+}
+
+/**
+ * @brief Reads a vector written by `write_vector` in a single read.
+ * The vector is resized to fit the contents exactly, so its allocator is used as usual.
+ */
+template<typename T, typename Alloc>
+    requires std::is_trivially_copyable_v<T>
+void read_vector(std::istream &in, std::vector<T, Alloc> &vec) {
+    const auto size = read_value<uint64_t>(in);
+    vec.resize(size);
+    vec.shrink_to_fit();
+    in.read(reinterpret_cast<char *>(vec.data()), (std::streamsize) (size * sizeof(T)));
+}
+
+/**
+ * @brief Writes the magic number identifying a file format.
+ */
+inline void write_magic(std::ostream &out, const uint64_t magic) { write_value(out, magic); }
+
+/**
+ * @brief Reads a magic number and throws a `std::runtime_error` if it is not the expected one.
+ *
+ * @param what A description of the expected format for the error message
+ */
+inline void expect_magic(std::istream &in, const uint64_t magic, const std::string &what) {
+    if (read_value<uint64_t>(in) != magic || !in) {
+        throw std::runtime_error("not a " + what + " file");
+    }
+}
+
+} // namespace gracli
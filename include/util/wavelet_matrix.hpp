@@ -0,0 +1,175 @@
+#pragma once
+
+#include <algorithm>
+#include <bit>
+#include <cstddef>
+#include <cstdint>
+#include <utility>
+#include <vector>
+
+namespace gracli {
+
+/**
+ * @brief A bit vector with constant time rank queries.
+ *
+ * The number of ones before each block of 512 bits is stored, so the rank support needs an eighth of the bits.
+ */
+class RankBitVector {
+    static constexpr size_t WORDS_PER_BLOCK = 8;
+
+    std::vector<uint64_t> m_words;
+    std::vector<uint64_t> m_block_ranks;
+
+  public:
+    RankBitVector() = default;
+
+    explicit RankBitVector(const size_t n) : m_words((n + 63) / 64, 0) {}
+
+    inline void set(const size_t i) { m_words[i / 64] |= 1ULL << (i % 64); }
+
+    [[nodiscard]] inline auto get(const size_t i) const -> bool { return (m_words[i / 64] >> (i % 64)) & 1; }
+
+    /**
+     * @brief Builds the rank support. This must be called after the last call to `set` and before the first call to
+     * `rank1`.
+     */
+    void build_rank() {
+        m_block_ranks.assign(m_words.size() / WORDS_PER_BLOCK + 1, 0);
+        uint64_t rank = 0;
+        for (size_t w = 0; w < m_words.size(); w++) {
+            if (w % WORDS_PER_BLOCK == 0) {
+                m_block_ranks[w / WORDS_PER_BLOCK] = rank;
+            }
+            rank += std::popcount(m_words[w]);
+        }
+        if (m_words.size() % WORDS_PER_BLOCK == 0) {
+            m_block_ranks.back() = rank;
+        }
+    }
+
+    /**
+     * @brief Returns the number of ones before position i.
+     */
+    [[nodiscard]] inline auto rank1(const size_t i) const -> size_t {
+        const size_t word = i / 64;
+        size_t       rank = m_block_ranks[word / WORDS_PER_BLOCK];
+        for (size_t w = word - word % WORDS_PER_BLOCK; w < word; w++) {
+            rank += std::popcount(m_words[w]);
+        }
+        if (i % 64 != 0) {
+            rank += std::popcount(m_words[word] & ((1ULL << (i % 64)) - 1));
+        }
+        return rank;
+    }
+
+    [[nodiscard]] auto size_in_bytes() const -> size_t {
+        return (m_words.capacity() + m_block_ranks.capacity()) * sizeof(uint64_t);
+    }
+};
+
+/**
+ * @brief A wavelet matrix over a sequence of integers, which counts and reports the values in a range of values that
+ * occur in a range of positions.
+ *
+ * There is one bit vector per bit of the values, from the most significant bit to the least significant one. On each
+ * level, the values are stably partitioned by their bit on that level, the values with a 0 bit first. A query descends
+ * the levels with rank queries and takes O(log σ) time per distinct reported value.
+ */
+class WaveletMatrix {
+    size_t                     m_size;
+    std::vector<RankBitVector> m_levels;
+    /**
+     * @brief The number of values with a 0 bit on each level
+     */
+    std::vector<size_t> m_zeros;
+
+    template<typename F>
+    void report(const size_t   level,
+                const size_t   begin,
+                const size_t   end,
+                const uint64_t node_min,
+                const uint64_t min,
+                const uint64_t max,
+                F             &f) const {
+        const uint64_t node_max = node_min + (1ULL << (m_levels.size() - level));
+        if (begin >= end || node_max <= min || max <= node_min) {
+            return;
+        }
+        if (level == m_levels.size()) {
+            f(node_min, end - begin);
+            return;
+        }
+        const RankBitVector &bits      = m_levels[level];
+        const size_t         ones_from = bits.rank1(begin);
+        const size_t         ones_to   = bits.rank1(end);
+        const uint64_t       half      = 1ULL << (m_levels.size() - level - 1);
+        report(level + 1, begin - ones_from, end - ones_to, node_min, min, max, f);
+        report(level + 1, m_zeros[level] + ones_from, m_zeros[level] + ones_to, node_min + half, min, max, f);
+    }
+
+  public:
+    WaveletMatrix() : m_size{0} {}
+
+    /**
+     * @brief Builds the wavelet matrix of the given values, consuming them.
+     *
+     * @param values The values, each of which is less than `2^bits`
+     * @param bits The number of bits of the values
+     */
+    WaveletMatrix(std::vector<uint32_t> &&values, const size_t bits) : m_size{values.size()} {
+        std::vector<uint32_t> next(values.size());
+        for (size_t level = 0; level < bits; level++) {
+            const size_t  shift = bits - level - 1;
+            RankBitVector level_bits(values.size());
+            size_t        zeros = 0;
+            for (size_t i = 0; i < values.size(); i++) {
+                if ((values[i] >> shift) & 1) {
+                    level_bits.set(i);
+                } else {
+                    zeros++;
+                }
+            }
+            level_bits.build_rank();
+
+            size_t zero_pos = 0;
+            size_t one_pos  = zeros;
+            for (const uint32_t value : values) {
+                next[(value >> shift) & 1 ? one_pos++ : zero_pos++] = value;
+            }
+            std::swap(values, next);
+            m_levels.push_back(std::move(level_bits));
+            m_zeros.push_back(zeros);
+        }
+    }
+
+    [[nodiscard]] inline auto size() const -> size_t { return m_size; }
+
+    /**
+     * @brief Calls `f(value, count)` for each distinct value in `[min, max)` that occurs `count > 0` times at the
+     * positions `[begin, end)`, in increasing order of the values.
+     */
+    template<typename F>
+    void report(const size_t begin, const size_t end, const uint64_t min, const uint64_t max, F &&f) const {
+        report(0, begin, std::min(end, m_size), 0, min, max, f);
+    }
+
+    /**
+     * @brief Returns the number of positions in `[begin, end)` whose value is in `[min, max)`.
+     */
+    [[nodiscard]] auto count(const size_t begin, const size_t end, const uint64_t min, const uint64_t max) const
+        -> size_t {
+        size_t count = 0;
+        report(begin, end, min, max, [&](uint64_t, const size_t c) { count += c; });
+        return count;
+    }
+
+    [[nodiscard]] auto size_in_bytes() const -> size_t {
+        size_t bytes = m_zeros.capacity() * sizeof(size_t);
+        for (const RankBitVector &bits : m_levels) {
+            bytes += bits.size_in_bytes();
+        }
+        return bytes;
+    }
+};
+
+} // namespace gracli
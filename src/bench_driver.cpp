@@ -0,0 +1,602 @@
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <random>
+#include <sstream>
+#include <string>
+#include <string_view>
+#include <type_traits>
+#include <vector>
+
+#include <omp.h>
+
+#include <benchmark/bench.hpp>
+#include <benchmark/grammar_type.hpp>
+#include <benchmark/perf_counter.hpp>
+#include <benchmark/report.hpp>
+#include <benchmark/statistics.hpp>
+#include <file_access/batch_reader.hpp>
+#include <util/memory_policy.hpp>
+
+#include <oocmd.hpp>
+
+using namespace gracli;
+
+/**
+ * @brief Parses a comma separated list of non-negative integers.
+ */
+auto parse_list(const std::string &s) -> std::vector<size_t> {
+    std::vector<size_t> values;
+    std::stringstream   ss(s);
+    std::string         item;
+    while (std::getline(ss, item, ',')) {
+        if (item.empty()) {
+            continue;
+        }
+        values.push_back(std::stoull(item));
+    }
+    return values;
+}
+
+template<typename DS>
+inline void extract(DS &ds, char *buf, const size_t start, const size_t len) {
+    ds.substr(buf, start, len);
+}
+
+inline void extract(std::string &s, char *buf, const size_t start, const size_t len) {
+    const size_t end = std::min(start + len, s.length());
+    std::copy(s.begin() + start, s.begin() + end, buf);
+}
+
+/**
+ * @brief Whether one instance of the data structure can be queried by several threads at once.
+ * The cache of LzEnd is not thread safe, so this is also checked at runtime with `has_cache`.
+ */
+template<typename DS>
+constexpr bool supports_threads = ConcurrentQueries<DS> || std::is_same_v<DS, std::string>;
+
+template<typename DS>
+inline auto has_cache(const DS &ds) -> bool {
+    return cache_counters(ds).bytes >= 0;
+}
+
+/**
+ * @brief Whether the data structure counts and locates patterns. The uncompressed baseline searches the whole text.
+ */
+template<typename DS>
+constexpr bool supports_patterns = PatternQueries<DS> || std::is_same_v<DS, std::string>;
+
+template<PatternQueries DS>
+inline auto find_pattern(const DS &ds, const std::string_view pattern, const bool locate) -> size_t {
+    return locate ? ds.locate(pattern).size() : ds.count(pattern);
+}
+
+inline auto find_pattern(const std::string &s, const std::string_view pattern, const bool locate) -> size_t {
+    std::vector<size_t> positions;
+    size_t              count = 0;
+    for (size_t pos = s.find(pattern); pos != std::string::npos; pos = s.find(pattern, pos + 1)) {
+        if (locate) {
+            positions.push_back(pos);
+        }
+        count++;
+    }
+    return locate ? positions.size() : count;
+}
+
+/**
+ * @brief Runs one batch of count or locate queries and returns the time it took in nanoseconds per query.
+ *
+ * @param occurrences Is set to the total number of occurrences of the patterns
+ */
+template<typename DS>
+auto run_patterns(const DS                       &ds,
+                  const std::vector<std::string> &patterns,
+                  const bool                      locate,
+                  size_t                         &occurrences) -> double {
+    occurrences = 0;
+    auto begin  = std::chrono::steady_clock::now();
+    for (const std::string &pattern : patterns) {
+        occurrences += find_pattern(ds, pattern, locate);
+    }
+    auto end = std::chrono::steady_clock::now();
+
+    const auto ns = std::chrono::duration_cast<std::chrono::nanoseconds>(end - begin).count();
+    return (double) ns / (double) std::max(patterns.size(), (size_t) 1);
+}
+
+/**
+ * @brief Runs the queries of one thread and returns the sum of the extracted characters.
+ */
+template<typename DS>
+inline auto run_queries(DS &ds, const size_t *positions, const size_t count, const size_t length, char *buf)
+    -> size_t {
+    size_t c = 0;
+    if (length == 0) {
+        for (size_t q = 0; q < count; q++) {
+            c += ds.at(positions[q]);
+        }
+    } else {
+        for (size_t q = 0; q < count; q++) {
+            extract(ds, buf, positions[q], length);
+            c += buf[0];
+        }
+    }
+    return c;
+}
+
+/**
+ * @brief Runs one batch of queries and returns the time it took in nanoseconds per query.
+ *
+ * @param ds The data structure to query
+ * @param positions The start positions of the queries
+ * @param length The substring length. If this is 0, random access queries are run instead.
+ * @param threads The number of threads the queries are split among in contiguous ranges
+ * @param dtlb A counter that counts dTLB load misses during the batch
+ * @param dtlb_misses Is set to the number of dTLB load misses during the batch or -1 if they could not be counted.
+ * The counter only counts the calling thread, so this is -1 with several threads.
+ */
+template<typename DS>
+auto run_batch(DS                        &ds,
+               const std::vector<size_t> &positions,
+               const size_t               length,
+               const size_t               threads,
+               PerfCounter               &dtlb,
+               int64_t                   &dtlb_misses) -> double {
+    size_t c = 0;
+    // One output buffer per thread, allocated and touched outside of the timed region
+    auto buffers = std::vector<std::vector<char>>(std::max(threads, (size_t) 1), std::vector<char>(length + 1));
+    dtlb.start();
+    auto begin = std::chrono::steady_clock::now();
+    if (threads <= 1) {
+        c = run_queries(ds, positions.data(), positions.size(), length, buffers[0].data());
+    } else {
+#pragma omp parallel num_threads(threads) reduction(+ : c)
+        {
+            const size_t t     = omp_get_thread_num();
+            const size_t nt    = omp_get_num_threads();
+            const size_t first = positions.size() * t / nt;
+            const size_t last  = positions.size() * (t + 1) / nt;
+            c                  = run_queries(ds, positions.data() + first, last - first, length, buffers[t].data());
+        }
+    }
+    auto end    = std::chrono::steady_clock::now();
+    dtlb_misses = dtlb.stop();
+    if (threads > 1) {
+        dtlb_misses = -1;
+    }
+
+    // so the calls are hopefully not optimized away
+    if (c < 1) {
+        std::cerr << c;
+    }
+
+    const auto ns = std::chrono::duration_cast<std::chrono::nanoseconds>(end - begin).count();
+    return (double) ns / (double) std::max(positions.size(), (size_t) 1);
+}
+
+/**
+ * @brief Runs one batch of queries through a `BatchReader` and returns the time it took in nanoseconds per query.
+ *
+ * @param latencies Is set to the latency of each query in nanoseconds
+ */
+template<typename DS>
+auto run_batched(const DS                  &ds,
+                 const std::vector<size_t> &positions,
+                 const size_t               length,
+                 const size_t               queue_depth,
+                 std::vector<double>       &latencies) -> double {
+    std::vector<BatchRequest> requests(positions.size());
+    for (size_t q = 0; q < positions.size(); q++) {
+        requests[q] = {positions[q], length};
+    }
+
+    const BatchReader<DS> reader(ds, queue_depth);
+    auto                  begin = std::chrono::steady_clock::now();
+    const size_t          c     = reader.run(requests, latencies);
+    auto                  end   = std::chrono::steady_clock::now();
+
+    // so the calls are hopefully not optimized away
+    if (c < 1) {
+        std::cerr << c;
+    }
+
+    const auto ns = std::chrono::duration_cast<std::chrono::nanoseconds>(end - begin).count();
+    return (double) ns / (double) std::max(positions.size(), (size_t) 1);
+}
+
+struct GracliBench : public oocmd::ConfigObject {
+
+    std::string  plain_file;
+    std::string  grammar_file;
+    std::string  lzend_file;
+    std::string  blocktree_file;
+    std::string  data_structures   = "0,1,2,3,4,5,6,7,8,9,10,11";
+    std::string  substring_lengths = "1,10,100,1000";
+    std::string  num_queries       = "10000";
+    std::string  thread_counts     = "1";
+    std::string  queue_depths;
+    std::string  pattern_lengths;
+    std::string  output_format     = "json";
+    std::string  output_file;
+    std::string  huge_pages        = "none";
+    std::string  numa              = "default";
+    unsigned int warmup            = 1;
+    unsigned int trials            = 5;
+    unsigned int seed              = 0;
+    unsigned int lzend_max_hops    = 0;
+    unsigned int lzend_cache_kib   = 0;
+    unsigned int bt_arity          = 2;
+    unsigned int bt_root_arity     = 128;
+    unsigned int bt_leaf_length    = 16;
+    unsigned int bt_prefix_suffix  = 0;
+    std::string  file_mode         = "pread";
+    std::string  file_advice       = "normal";
+    unsigned int direct_cache_kib  = 0;
+    unsigned int cb_block_size     = cb::CompressedBlocks::DEFAULT_BLOCK_SIZE;
+    unsigned int cb_cache_blocks   = 0;
+
+    GracliBench() :
+        ConfigObject("gracli_bench",
+                     "Sweeps data structures, substring lengths and query counts and writes the results as JSON or "
+                     "CSV") {
+        param('p',
+              "plain_file",
+              plain_file,
+              "The uncompressed input file for String, File on Disk, block trees built by gracli and Compressed "
+              "Blocks");
+        param('g',
+              "grammar_file",
+              grammar_file,
+              "The grammar-compressed input file for Naive, Sampled Scan and Grammar Index");
+        param('z', "lzend_file", lzend_file, "The LzEnd-compressed input file");
+        param('b', "blocktree_file", blocktree_file, "The block tree input file");
+        param('d',
+              "data_structures",
+              data_structures,
+              "Comma separated list of data structure ids to benchmark (see gracli --help). Data structures whose "
+              "input file is not given are skipped.");
+        param('l',
+              "substring_lengths",
+              substring_lengths,
+              "Comma separated list of substring lengths. A length of 0 benchmarks random access queries.");
+        param('n', "num_queries", num_queries, "Comma separated list of query counts per trial");
+        param('T',
+              "threads",
+              thread_counts,
+              "Comma separated list of thread counts. The queries of a trial are split among the threads, which all "
+              "query the same instance of the data structure.");
+        param('Q',
+              "queue_depths",
+              queue_depths,
+              "Comma separated list of queue depths. For each depth, the queries are additionally run as batches with "
+              "that many queries in flight, and the IOPS and latency percentiles are reported.");
+        param('x',
+              "pattern_lengths",
+              pattern_lengths,
+              "Comma separated list of pattern lengths. For data structures which find patterns (Grammar Index and "
+              "String), count and locate queries of patterns drawn from random positions of the text are run.");
+        param('w', "warmup", warmup, "The number of unmeasured warm-up runs before the trials of each configuration");
+        param('t', "trials", trials, "The number of measured trials of each configuration");
+        param('s', "seed", seed, "The seed for generating query positions");
+        param('F', "format", output_format, "The output format (json or csv)");
+        param('o', "output", output_file, "The output file. Results are written to stdout if this is empty.");
+        param('H',
+              "huge_pages",
+              huge_pages,
+              "Back the large arrays of the data structures with huge pages (none, thp = transparent huge pages, "
+              "explicit = huge page pool)");
+        param('N',
+              "numa",
+              numa,
+              "NUMA placement of the large arrays of the data structures (default, interleave or the id of the node "
+              "to bind to)");
+        param('j',
+              "lzend_max_hops",
+              lzend_max_hops,
+              "The maximum number of jumps per access in LzEnd. Phrases which need more jumps are stored explicitly. "
+              "0 = no bound");
+        param('c',
+              "lzend_cache",
+              lzend_cache_kib,
+              "The size in KiB of the cache of decoded text for LzEnd. The cache is kept between trials. 0 = no cache");
+        param('a', "bt_arity", bt_arity, "The number of children of an internal block in block trees built by gracli");
+        param('R',
+              "bt_root_arity",
+              bt_root_arity,
+              "The maximum number of top level blocks in block trees built by gracli");
+        param('L',
+              "bt_leaf_length",
+              bt_leaf_length,
+              "The length of the blocks on the lowest level of block trees built by gracli");
+        param('P',
+              "bt_prefix_suffix",
+              bt_prefix_suffix,
+              "The number of characters stored at the start and end of each back block in block trees built by gracli");
+        param('m',
+              "file_mode",
+              file_mode,
+              "How File on Disk reads the file (pread = one syscall per query, mmap = memory-mapped, direct = O_DIRECT "
+              "with a block cache)");
+        param('A',
+              "file_advice",
+              file_advice,
+              "The access pattern announced to the kernel for File on Disk (normal, random, sequential or willneed)");
+        param('C',
+              "direct_cache",
+              direct_cache_kib,
+              "The size in KiB of the block cache of File on Disk with -m direct. At least one block is cached.");
+        param('B',
+              "cb_block_size",
+              cb_block_size,
+              "The number of characters per block of Compressed Blocks (at most 65536)");
+        param('K',
+              "cb_cache_blocks",
+              cb_cache_blocks,
+              "The number of decoded blocks cached by Compressed Blocks. 0 = only the last block of each thread");
+    }
+
+    [[nodiscard]] auto input_file(const GrammarType type) const -> const std::string & {
+        switch (grammar_type_file_type(type)) {
+            case FileType::Plaintext:
+                return plain_file;
+            case FileType::Grammar:
+                return grammar_file;
+            case FileType::LzEnd:
+                return lzend_file;
+            case FileType::BlockTree:
+                return blocktree_file;
+        }
+        return plain_file;
+    }
+
+    template<typename DS>
+    void benchmark(const GrammarType type, std::vector<BenchmarkRecord> &records) const {
+        const std::string &file = input_file(type);
+        std::string        name = grammar_type_name(type);
+        if (grammar_type_file_type(type) == FileType::LzEnd) {
+            name += BuildOptions::global().lzend_suffix();
+        } else if (type == GrammarType::NativeBlockTree) {
+            name += BuildOptions::global().blocktree_suffix();
+        } else if (type == GrammarType::FileAccess) {
+            name += BuildOptions::global().file_access_suffix();
+        } else if (type == GrammarType::CompressedBlocks) {
+            name += BuildOptions::global().compressed_blocks_suffix();
+        }
+
+        std::cerr << "Building " << name << " from " << file << "..." << std::endl;
+        QueryDSResult<DS> data = build_random_access<DS>(file);
+        DS               &ds   = data.ds;
+        const size_t      n    = data.source_length;
+        if (n == 0) {
+            std::cerr << "Skipping " << name << ": empty input" << std::endl;
+            return;
+        }
+
+        std::string file_name = std::filesystem::path(file).filename();
+
+        const auto lengths = parse_list(substring_lengths);
+        const auto counts  = parse_list(num_queries);
+        const auto threads = parse_list(thread_counts);
+        const auto depths  = parse_list(queue_depths);
+
+        std::mt19937                          gen(seed);
+        std::uniform_int_distribution<size_t> rand_int(0, n - 1);
+        std::vector<size_t>                   positions;
+
+        for (const size_t length : lengths) {
+            for (const size_t count : counts) {
+                for (const size_t thread_count : threads) {
+                    if (thread_count > 1 && (!supports_threads<DS> || has_cache(ds))) {
+                        std::cerr << "  Skipping " << thread_count << " threads: " << name
+                                  << " can only be queried by one thread at a time" << std::endl;
+                        continue;
+                    }
+                    std::cerr << "  " << (length == 0 ? "random access" : "substring length " + std::to_string(length))
+                              << ", " << count << " queries, " << thread_count << " threads" << std::endl;
+
+                    std::vector<double> times;
+                    std::vector<double> dtlb_misses;
+                    PerfCounter         dtlb = PerfCounter::dtlb_load_misses();
+                    for (size_t run = 0; run < warmup + trials; run++) {
+                        if (run == warmup) {
+                            // Only count the cache hits of the measured trials
+                            reset_cache_counters(ds);
+                        }
+                        positions.resize(count);
+                        std::generate(positions.begin(), positions.end(), [&] { return rand_int(gen); });
+                        int64_t      misses;
+                        const double time = run_batch(ds, positions, length, thread_count, dtlb, misses);
+                        if (run >= warmup) {
+                            times.push_back(time);
+                            dtlb_misses.push_back(misses < 0 ? -1.0 : (double) misses / std::max(count, (size_t) 1));
+                        }
+                    }
+
+                    records.push_back({name,
+                                       file_name,
+                                       n,
+                                       length == 0 ? "random_access" : "substring",
+                                       length,
+                                       count,
+                                       thread_count,
+                                       warmup,
+                                       data.space,
+                                       data.constr_time,
+                                       data.profile.peak(),
+                                       MemoryPolicy::global().huge_pages_name(),
+                                       MemoryPolicy::global().numa_name(),
+                                       summarize(times),
+                                       summarize(dtlb_misses).mean,
+                                       cache_counters(ds)});
+                }
+
+                for (const size_t depth : depths) {
+                    if (depth == 0) {
+                        continue;
+                    }
+                    if constexpr (ConcurrentQueries<DS>) {
+                        if (has_cache(ds)) {
+                            std::cerr << "  Skipping queue depth " << depth << ": " << name
+                                      << " can only be queried by one thread at a time" << std::endl;
+                            continue;
+                        }
+                        std::cerr << "  "
+                                  << (length == 0 ? "random access" : "substring length " + std::to_string(length))
+                                  << ", " << count << " queries, queue depth " << depth << std::endl;
+
+                        std::vector<double> times;
+                        std::vector<double> iops;
+                        std::vector<double> latencies;
+                        std::vector<double> batch_latencies;
+                        for (size_t run = 0; run < warmup + trials; run++) {
+                            positions.resize(count);
+                            std::generate(positions.begin(), positions.end(), [&] { return rand_int(gen); });
+                            const double time = run_batched(ds, positions, length, depth, batch_latencies);
+                            if (run >= warmup) {
+                                times.push_back(time);
+                                iops.push_back(1e9 / time);
+                                latencies.insert(latencies.end(), batch_latencies.begin(), batch_latencies.end());
+                            }
+                        }
+
+                        BenchmarkRecord record{name,
+                                               file_name,
+                                               n,
+                                               length == 0 ? "random_access" : "substring",
+                                               length,
+                                               count,
+                                               depth,
+                                               warmup,
+                                               data.space,
+                                               data.constr_time,
+                                               data.profile.peak(),
+                                               MemoryPolicy::global().huge_pages_name(),
+                                               MemoryPolicy::global().numa_name(),
+                                               summarize(times),
+                                               -1,
+                                               cache_counters(ds)};
+                        record.queue_depth = depth;
+                        record.iops        = summarize(iops).mean;
+                        record.latency     = percentiles(std::move(latencies));
+                        records.push_back(std::move(record));
+                    } else {
+                        std::cerr << "  Skipping queue depth " << depth << ": " << name
+                                  << " can only be queried by one thread at a time" << std::endl;
+                    }
+                }
+            }
+        }
+
+        if constexpr (supports_patterns<DS>) {
+            for (const size_t length : parse_list(pattern_lengths)) {
+                if (length == 0 || length > n) {
+                    continue;
+                }
+                std::uniform_int_distribution<size_t> rand_start(0, n - length);
+                for (const size_t count : counts) {
+                    for (const bool locate : {false, true}) {
+                        std::cerr << "  " << (locate ? "locate" : "count") << " pattern length " << length << ", "
+                                  << count << " queries" << std::endl;
+
+                        std::vector<double>      times;
+                        std::vector<double>      occurrences;
+                        std::vector<std::string> patterns(count, std::string(length, '\0'));
+                        for (size_t run = 0; run < warmup + trials; run++) {
+                            for (std::string &pattern : patterns) {
+                                extract(ds, pattern.data(), rand_start(gen), length);
+                            }
+                            size_t       found;
+                            const double time = run_patterns(ds, patterns, locate, found);
+                            if (run >= warmup) {
+                                times.push_back(time);
+                                occurrences.push_back((double) found / std::max(count, (size_t) 1));
+                            }
+                        }
+
+                        BenchmarkRecord record{name,
+                                               file_name,
+                                               n,
+                                               locate ? "locate" : "count",
+                                               length,
+                                               count,
+                                               1,
+                                               warmup,
+                                               data.space,
+                                               data.constr_time,
+                                               data.profile.peak(),
+                                               MemoryPolicy::global().huge_pages_name(),
+                                               MemoryPolicy::global().numa_name(),
+                                               summarize(times),
+                                               -1,
+                                               cache_counters(ds)};
+                        record.occurrences = summarize(occurrences).mean;
+                        records.push_back(std::move(record));
+                    }
+                }
+            }
+        }
+    }
+
+    int run(oocmd::Application const &app) {
+        if (output_format != "json" && output_format != "csv") {
+            std::cerr << "Unknown output format " << output_format << std::endl;
+            return -1;
+        }
+
+        if (!MemoryPolicy::global().parse(huge_pages, numa)) {
+            std::cerr << "Invalid memory policy: huge_pages=" << huge_pages << " numa=" << numa << std::endl;
+            return -1;
+        }
+
+        FileAccessOptions &file_access = BuildOptions::global().file_access;
+        if (!file_access.parse(file_mode, file_advice)) {
+            std::cerr << "Invalid file access: file_mode=" << file_mode << " file_advice=" << file_advice << std::endl;
+            return -1;
+        }
+        file_access.direct_cache_kib = direct_cache_kib;
+
+        BuildOptions::global().lzend_max_hops  = lzend_max_hops;
+        BuildOptions::global().lzend_cache_kib = lzend_cache_kib;
+        BuildOptions::global().blocktree       = {bt_arity, bt_root_arity, bt_leaf_length, bt_prefix_suffix};
+        BuildOptions::global().cb_block_size   = cb_block_size;
+        BuildOptions::global().cb_cache_blocks = cb_cache_blocks;
+
+        std::vector<BenchmarkRecord> records;
+        for (const size_t id : parse_list(data_structures)) {
+            if (id >= GRAMMAR_TYPE_COUNT) {
+                std::cerr << "Unknown data structure " << id << std::endl;
+                continue;
+            }
+            const auto         type = static_cast<GrammarType>(id);
+            const std::string &file = input_file(type);
+            if (file.empty()) {
+                continue;
+            }
+            if (!std::filesystem::exists(file)) {
+                std::cerr << "file " << file << " does not exist" << std::endl;
+                continue;
+            }
+            with_grammar_type(type, [&]<typename DS>() { benchmark<DS>(type, records); });
+        }
+
+        std::ofstream out_file;
+        if (!output_file.empty()) {
+            out_file.open(output_file);
+        }
+        std::ostream &out = output_file.empty() ? std::cout : out_file;
+        if (output_format == "json") {
+            write_json(out, records);
+        } else {
+            write_csv(out, records);
+        }
+        return 0;
+    }
+};
+
+auto main(int argc, char **argv) -> int {
+    GracliBench bench;
+    oocmd::Application::run(bench, argc, argv);
+}
@@ -1,13 +1,20 @@
 #include <algorithm>
+#include <chrono>
 #include <cstdint>
 #include <cstring>
 #include <filesystem>
 #include <iostream>
+#include <optional>
 #include <sstream>
+#include <string_view>
+#include <type_traits>
 
 #include <benchmark/bench.hpp>
+#include <benchmark/grammar_type.hpp>
 #include <blocktree/blocktree.hpp>
+#include <compressed_blocks/compressed_blocks.hpp>
 #include <file_access/file_access.hpp>
+#include <grammar/grammar_index.hpp>
 #include <grammar/naive_query_grammar.hpp>
 #include <grammar/sampled_scan_query_grammar.hpp>
 #include <lzend/lzend.hpp>
@@ -15,16 +22,21 @@
 #include <oocmd.hpp>
 #include <progressbar.hpp>
 
-enum class GrammarType : uint8_t {
-    ReproducedString,
-    Naive,
-    SampledScan512,
-    SampledScan6400,
-    SampledScan25600,
-    LzEnd,
-    FileAccess,
-    BlockTree,
-};
+/**
+ * @brief Loads a data structure from a file, building it with the global build options if it needs any.
+ */
+template<gracli::FromFile DS>
+auto load_ds(const std::string &path) -> DS {
+    if constexpr (requires { DS::from_file(path, gracli::BuildOptions::global().blocktree); }) {
+        return DS::from_file(path, gracli::BuildOptions::global().blocktree);
+    } else if constexpr (requires { DS::from_file(path, gracli::BuildOptions::global().file_access); }) {
+        return DS::from_file(path, gracli::BuildOptions::global().file_access);
+    } else if constexpr (std::is_same_v<DS, gracli::cb::CompressedBlocks>) {
+        return DS::from_file(path, gracli::BuildOptions::global().cb_block_size);
+    } else {
+        return DS::from_file(path);
+    }
+}
 
 template<gracli::FromFile DS>
 void verify_ds(const std::string &source_path, const std::string &compressed_path) requires gracli::Substring<DS> &&
@@ -49,8 +61,11 @@ void verify_ds(const std::string &source_path, const std::string &compressed_pat
         source = ss.str();
     }
 
-    DS     ds = DS::from_file(compressed_path);
+    DS     ds = load_ds<DS>(compressed_path);
     size_t n  = source.length();
+    if constexpr (requires { ds.bound_hops(size_t{}); }) {
+        ds.bound_hops(gracli::BuildOptions::global().lzend_max_hops);
+    }
 
     std::cout << "Checking Random Access..." << std::endl;
     progressbar bar(100);
@@ -106,7 +121,7 @@ void query_interactive(const std::string &path) requires gracli::Substring<DS> &
         std::cerr << "file " << path << " does not exist" << std::endl;
         return;
     }
-    DS          ds = DS::from_file(path);
+    DS          ds = load_ds<DS>(path);
     std::string s;
     size_t      n = ds.source_length();
     while (true) {
@@ -118,6 +133,9 @@ void query_interactive(const std::string &path) requires gracli::Substring<DS> &
             std::cout << "bounds => print the bounds of the string" << std::endl;
             std::cout << "<from>:<to> => access a substring" << std::endl;
             std::cout << "<index> => access a character" << std::endl;
+            if constexpr (gracli::PatternQueries<DS>) {
+                std::cout << "?<pattern> => count and locate the occurrences of a pattern" << std::endl;
+            }
             continue;
         }
 
@@ -130,6 +148,20 @@ void query_interactive(const std::string &path) requires gracli::Substring<DS> &
             continue;
         }
 
+        if constexpr (gracli::PatternQueries<DS>) {
+            if (s.starts_with('?')) {
+                const std::string_view pattern   = std::string_view(s).substr(1);
+                std::vector<size_t>    positions = ds.locate(pattern);
+                std::sort(positions.begin(), positions.end());
+                std::cout << ds.count(pattern) << " occurrences";
+                for (size_t i = 0; i < std::min<size_t>(positions.size(), 20); i++) {
+                    std::cout << (i == 0 ? ": " : ", ") << positions[i];
+                }
+                std::cout << (positions.size() > 20 ? ", ..." : "") << std::endl;
+                continue;
+            }
+        }
+
         size_t colon_pos = s.find(':');
 
         if (colon_pos == std::string::npos) {
@@ -187,10 +219,26 @@ struct Gracli : public oocmd::ConfigObject {
     bool         interactive      = false;
     bool         random_access    = false;
     bool         substring        = false;
+    bool         lce              = false;
+    bool         rank_select      = false;
+    std::string  rank_alphabet    = "";
     bool         verify           = false;
     unsigned int substring_length = 10;
     unsigned int num_queries      = 100;
     unsigned int type             = 0;
+    std::string  huge_pages       = "none";
+    std::string  numa             = "default";
+    unsigned int lzend_max_hops   = 0;
+    unsigned int lzend_cache_kib  = 0;
+    unsigned int bt_arity         = 2;
+    unsigned int bt_root_arity    = 128;
+    unsigned int bt_leaf_length   = 16;
+    unsigned int bt_prefix_suffix = 0;
+    std::string  file_mode        = "pread";
+    std::string  file_advice      = "normal";
+    unsigned int direct_cache_kib = 0;
+    unsigned int cb_block_size    = gracli::cb::CompressedBlocks::DEFAULT_BLOCK_SIZE;
+    unsigned int cb_cache_blocks  = 0;
 
     Gracli() : ConfigObject("gracli", "Offers various data structures for random access on compressed sequences") {
         param('f', "file", file, "The compressed input file");
@@ -208,6 +256,19 @@ struct Gracli : public oocmd::ConfigObject {
               "substring",
               substring,
               "Benchmarks runtime of a Grammar's substring queries. Value is the number of queries.");
+        param('e',
+              "lce",
+              lce,
+              "Benchmarks runtime of longest common extension queries of random pairs of positions (String, Sampled "
+              "Scan, LzEnd and Grammar Index only)");
+        param('k',
+              "rank_select",
+              rank_select,
+              "Benchmarks runtime and space of rank and select queries of characters (Sampled Scan only)");
+        param('u',
+              "rank_alphabet",
+              rank_alphabet,
+              "The characters supported by rank and select queries with -k. Empty = all characters of the text");
         param('v',
               "verify",
               verify,
@@ -222,27 +283,102 @@ struct Gracli : public oocmd::ConfigObject {
               "data_structure",
               type,
               "The Access Data Structure to use. (0 = String, 1 = Naive, 2 = Sampled Scan 512, 3 = Sampled Scan "
-              "6400, 4 = Sampled Scan 25600, 5 = LzEnd, 6 = File on Disk, 7 = Block Trees)");
+              "6400, 4 = Sampled Scan 25600, 5 = LzEnd, 6 = File on Disk, 7 = Block Trees, 8 = LzEnd with sampled "
+              "phrase lookup, 9 = Block Trees built by gracli, 10 = Compressed Blocks, 11 = Grammar Index)");
+        param('H',
+              "huge_pages",
+              huge_pages,
+              "Back the large arrays of the data structure with huge pages (none, thp = transparent huge pages, "
+              "explicit = huge page pool)");
+        param('N',
+              "numa",
+              numa,
+              "NUMA placement of the large arrays of the data structure (default, interleave or the id of the node "
+              "to bind to)");
+        param('j',
+              "lzend_max_hops",
+              lzend_max_hops,
+              "The maximum number of jumps per access in LzEnd. Phrases which need more jumps are stored explicitly. "
+              "0 = no bound");
+        param('c',
+              "lzend_cache",
+              lzend_cache_kib,
+              "The size in KiB of the cache of decoded text for LzEnd benchmarks. 0 = no cache");
+        param('a', "bt_arity", bt_arity, "The number of children of an internal block in block trees built by gracli");
+        param('R',
+              "bt_root_arity",
+              bt_root_arity,
+              "The maximum number of top level blocks in block trees built by gracli");
+        param('L',
+              "bt_leaf_length",
+              bt_leaf_length,
+              "The length of the blocks on the lowest level of block trees built by gracli");
+        param('P',
+              "bt_prefix_suffix",
+              bt_prefix_suffix,
+              "The number of characters stored at the start and end of each back block in block trees built by gracli");
+        param('m',
+              "file_mode",
+              file_mode,
+              "How File on Disk reads the file (pread = one syscall per query, mmap = memory-mapped, direct = O_DIRECT "
+              "with a block cache)");
+        param('A',
+              "file_advice",
+              file_advice,
+              "The access pattern announced to the kernel for File on Disk (normal, random, sequential or willneed)");
+        param('C',
+              "direct_cache",
+              direct_cache_kib,
+              "The size in KiB of the block cache of File on Disk with -m direct. At least one block is cached.");
+        param('B',
+              "cb_block_size",
+              cb_block_size,
+              "The number of characters per block of Compressed Blocks (at most 65536)");
+        param('K',
+              "cb_cache_blocks",
+              cb_cache_blocks,
+              "The number of decoded blocks cached by Compressed Blocks. 0 = only the last block of each thread");
     }
 
     int run(oocmd::Application const &app) {
+        using namespace gracli;
 
         if (verify && (src_file.empty() || file.empty())) {
             std::cerr << "Both -f and -S are needed to use -v" << std::endl;
             return -1;
         }
 
-        if (!(interactive || random_access || substring || verify)) {
+        if (!(interactive || random_access || substring || lce || rank_select || verify)) {
             interactive = true;
         }
 
-        if (type > 7) {
+        if (!MemoryPolicy::global().parse(huge_pages, numa)) {
+            std::cerr << "Invalid memory policy: huge_pages=" << huge_pages << " numa=" << numa << std::endl;
+            return -1;
+        }
+
+        FileAccessOptions &file_access = BuildOptions::global().file_access;
+        if (!file_access.parse(file_mode, file_advice)) {
+            std::cerr << "Invalid file access: file_mode=" << file_mode << " file_advice=" << file_advice << std::endl;
+            return -1;
+        }
+        file_access.direct_cache_kib = direct_cache_kib;
+
+        if (type >= GRAMMAR_TYPE_COUNT) {
             type = 0;
         }
 
         auto grammar_type = static_cast<GrammarType>(type);
 
-        using namespace gracli;
+        BuildOptions::global().lzend_max_hops  = lzend_max_hops;
+        BuildOptions::global().lzend_cache_kib = lzend_cache_kib;
+        BuildOptions::global().blocktree       = {bt_arity, bt_root_arity, bt_leaf_length, bt_prefix_suffix};
+        BuildOptions::global().cb_block_size   = cb_block_size;
+        BuildOptions::global().cb_cache_blocks = cb_cache_blocks;
+        const std::string lzend_suffix         = BuildOptions::global().lzend_suffix();
+        const std::string blocktree_suffix     = BuildOptions::global().blocktree_suffix();
+        const std::string file_access_suffix   = BuildOptions::global().file_access_suffix();
+        const std::string cb_suffix            = BuildOptions::global().compressed_blocks_suffix();
 
         if (interactive) {
             switch (grammar_type) {
@@ -278,6 +414,22 @@ struct Gracli : public oocmd::ConfigObject {
                     query_interactive<BlockTreeRandomAccess>(file);
                     break;
                 }
+                case GrammarType::SampledLzEnd: {
+                    query_interactive<lz::SampledLzEnd>(file);
+                    break;
+                }
+                case GrammarType::NativeBlockTree: {
+                    query_interactive<bt::BlockTree>(file);
+                    break;
+                }
+                case GrammarType::CompressedBlocks: {
+                    query_interactive<cb::CompressedBlocks>(file);
+                    break;
+                }
+                case GrammarType::GrammarIndex: {
+                    query_interactive<GrammarIndex<6400>>(file);
+                    break;
+                }
             }
         } else if (verify) {
             switch (grammar_type) {
@@ -313,6 +465,22 @@ struct Gracli : public oocmd::ConfigObject {
                     verify_ds<BlockTreeRandomAccess>(src_file, file);
                     break;
                 }
+                case GrammarType::SampledLzEnd: {
+                    verify_ds<lz::SampledLzEnd>(src_file, file);
+                    break;
+                }
+                case GrammarType::NativeBlockTree: {
+                    verify_ds<bt::BlockTree>(src_file, file);
+                    break;
+                }
+                case GrammarType::CompressedBlocks: {
+                    verify_ds<cb::CompressedBlocks>(src_file, file);
+                    break;
+                }
+                case GrammarType::GrammarIndex: {
+                    verify_ds<GrammarIndex<6400>>(src_file, file);
+                    break;
+                }
             }
         }
         if (random_access) {
@@ -338,17 +506,33 @@ struct Gracli : public oocmd::ConfigObject {
                     break;
                 }
                 case GrammarType::LzEnd: {
-                    benchmark_random_access<lz::LzEnd>(file, num_queries, "lzend");
+                    benchmark_random_access<lz::LzEnd>(file, num_queries, "lzend" + lzend_suffix);
                     break;
                 }
                 case GrammarType::FileAccess: {
-                    benchmark_random_access<FileAccess>(file, num_queries, "file_access");
+                    benchmark_random_access<FileAccess>(file, num_queries, "file_access" + file_access_suffix);
                     break;
                 }
                 case GrammarType::BlockTree: {
                     benchmark_random_access<BlockTreeRandomAccess>(file, num_queries, "blocktree");
                     break;
                 }
+                case GrammarType::SampledLzEnd: {
+                    benchmark_random_access<lz::SampledLzEnd>(file, num_queries, "lzend_sampled" + lzend_suffix);
+                    break;
+                }
+                case GrammarType::NativeBlockTree: {
+                    benchmark_random_access<bt::BlockTree>(file, num_queries, "blocktree_native" + blocktree_suffix);
+                    break;
+                }
+                case GrammarType::CompressedBlocks: {
+                    benchmark_random_access<cb::CompressedBlocks>(file, num_queries, "compressed_blocks" + cb_suffix);
+                    break;
+                }
+                case GrammarType::GrammarIndex: {
+                    benchmark_random_access<GrammarIndex<6400>>(file, num_queries, "grammar_index");
+                    break;
+                }
             }
         } else if (substring) {
             switch (grammar_type) {
@@ -382,25 +566,324 @@ struct Gracli : public oocmd::ConfigObject {
                     break;
                 }
                 case GrammarType::LzEnd: {
-                    benchmark_substring<lz::LzEnd>(file, num_queries, substring_length, "lzend");
+                    benchmark_substring<lz::LzEnd>(file, num_queries, substring_length, "lzend" + lzend_suffix);
                     break;
                 }
                 case GrammarType::FileAccess: {
-                    benchmark_substring<FileAccess>(file, num_queries, substring_length, "file_access");
+                    benchmark_substring<FileAccess>(file,
+                                                    num_queries,
+                                                    substring_length,
+                                                    "file_access" + file_access_suffix);
                     break;
                 }
                 case GrammarType::BlockTree: {
                     benchmark_substring<BlockTreeRandomAccess>(file, num_queries, substring_length, "blocktree");
                     break;
                 }
+                case GrammarType::SampledLzEnd: {
+                    benchmark_substring<lz::SampledLzEnd>(file,
+                                                          num_queries,
+                                                          substring_length,
+                                                          "lzend_sampled" + lzend_suffix);
+                    break;
+                }
+                case GrammarType::NativeBlockTree: {
+                    benchmark_substring<bt::BlockTree>(file,
+                                                       num_queries,
+                                                       substring_length,
+                                                       "blocktree_native" + blocktree_suffix);
+                    break;
+                }
+                case GrammarType::CompressedBlocks: {
+                    benchmark_substring<cb::CompressedBlocks>(file,
+                                                              num_queries,
+                                                              substring_length,
+                                                              "compressed_blocks" + cb_suffix);
+                    break;
+                }
+                case GrammarType::GrammarIndex: {
+                    benchmark_substring<GrammarIndex<6400>>(file, num_queries, substring_length, "grammar_index");
+                    break;
+                }
             }
+        } else if (lce) {
+            switch (grammar_type) {
+                case GrammarType::ReproducedString: {
+                    benchmark_lce<std::string>(file, num_queries, "string");
+                    break;
+                }
+                case GrammarType::SampledScan512: {
+                    benchmark_lce<SampledScanQueryGrammar<512>>(file, num_queries, "sampled_scan_512");
+                    break;
+                }
+                case GrammarType::SampledScan6400: {
+                    benchmark_lce<SampledScanQueryGrammar<6400>>(file, num_queries, "sampled_scan_6400");
+                    break;
+                }
+                case GrammarType::SampledScan25600: {
+                    benchmark_lce<SampledScanQueryGrammar<25600>>(file, num_queries, "sampled_scan_25600");
+                    break;
+                }
+                case GrammarType::LzEnd: {
+                    benchmark_lce<lz::LzEnd>(file, num_queries, "lzend" + lzend_suffix);
+                    break;
+                }
+                case GrammarType::SampledLzEnd: {
+                    benchmark_lce<lz::SampledLzEnd>(file, num_queries, "lzend_sampled" + lzend_suffix);
+                    break;
+                }
+                case GrammarType::GrammarIndex: {
+                    benchmark_lce<GrammarIndex<6400>>(file, num_queries, "grammar_index");
+                    break;
+                }
+                case GrammarType::Naive:
+                case GrammarType::FileAccess:
+                case GrammarType::BlockTree:
+                case GrammarType::NativeBlockTree:
+                case GrammarType::CompressedBlocks: {
+                    std::cerr << "LCE queries not supported on " << grammar_type_name(grammar_type) << std::endl;
+                    break;
+                }
+            }
+        } else if (rank_select) {
+            const std::vector<uint8_t> alphabet(rank_alphabet.begin(), rank_alphabet.end());
+            switch (grammar_type) {
+                case GrammarType::SampledScan512: {
+                    benchmark_rank_select<SampledScanQueryGrammar<512>>(file,
+                                                                        num_queries,
+                                                                        alphabet,
+                                                                        "sampled_scan_512");
+                    break;
+                }
+                case GrammarType::SampledScan6400: {
+                    benchmark_rank_select<SampledScanQueryGrammar<6400>>(file,
+                                                                         num_queries,
+                                                                         alphabet,
+                                                                         "sampled_scan_6400");
+                    break;
+                }
+                case GrammarType::SampledScan25600: {
+                    benchmark_rank_select<SampledScanQueryGrammar<25600>>(file,
+                                                                          num_queries,
+                                                                          alphabet,
+                                                                          "sampled_scan_25600");
+                    break;
+                }
+                case GrammarType::ReproducedString:
+                case GrammarType::Naive:
+                case GrammarType::LzEnd:
+                case GrammarType::FileAccess:
+                case GrammarType::BlockTree:
+                case GrammarType::SampledLzEnd:
+                case GrammarType::NativeBlockTree:
+                case GrammarType::CompressedBlocks:
+                case GrammarType::GrammarIndex: {
+                    std::cerr << "Rank and select not supported on " << grammar_type_name(grammar_type) << std::endl;
+                    break;
+                }
+            }
+        }
+
+        return 0;
+    }
+};
+
+struct GracliBuild : public oocmd::ConfigObject {
+
+    std::string  file;
+    std::string  output;
+    bool         lzend            = false;
+    bool         index            = false;
+    unsigned int type             = 5;
+    unsigned int memory_mib       = 1024;
+    unsigned int lzend_max_hops   = 0;
+    bool         blocktree        = false;
+    unsigned int bt_arity         = 2;
+    unsigned int bt_root_arity    = 128;
+    unsigned int bt_leaf_length   = 16;
+    unsigned int bt_prefix_suffix = 0;
+    bool         compressed       = false;
+    unsigned int cb_block_size    = gracli::cb::CompressedBlocks::DEFAULT_BLOCK_SIZE;
+
+    GracliBuild() : ConfigObject("gracli build", "Compresses a text file into an input file for the data structures") {
+        param('f', "file", file, "The uncompressed input file");
+        param('o', "output", output, "The output file. Defaults to the input file with the extension of the format");
+        param('z', "lzend", lzend, "Computes the LzEnd parsing of the input");
+        param('m',
+              "memory",
+              memory_mib,
+              "The memory limit in MiB. Larger inputs are parsed in chunks, which may increase the number of phrases");
+        param('i',
+              "index",
+              index,
+              "Writes the complete index instead of the parsing. It can be loaded without being rebuilt. Building it "
+              "needs memory proportional to the number of phrases, which must not exceed the limit of -m");
+        param('d',
+              "data_structure",
+              type,
+              "The data structure to build the index for with -i (5 = LzEnd, 8 = LzEnd with sampled phrase lookup)");
+        param('j',
+              "lzend_max_hops",
+              lzend_max_hops,
+              "The maximum number of jumps per access in the index built with -i. 0 = no bound");
+        param('b', "blocktree", blocktree, "Builds a block tree of the input which can be used with -d 9");
+        param('a', "bt_arity", bt_arity, "The number of children of an internal block in the block tree");
+        param('R', "bt_root_arity", bt_root_arity, "The maximum number of top level blocks in the block tree");
+        param('L', "bt_leaf_length", bt_leaf_length, "The length of the blocks on the lowest level of the block tree");
+        param('P',
+              "bt_prefix_suffix",
+              bt_prefix_suffix,
+              "The number of characters stored at the start and end of each back block in the block tree");
+        param('c',
+              "compressed_blocks",
+              compressed,
+              "Compresses the input into independently compressed blocks which can be used with -d 10");
+        param('B', "cb_block_size", cb_block_size, "The number of characters per compressed block (at most 65536)");
+    }
+
+    /**
+     * @brief Compresses the input into blocks and saves them.
+     */
+    int build_compressed_blocks() {
+        using namespace gracli;
+
+        if (output.empty()) {
+            output = file + ".gcb";
+        }
+
+        auto begin = std::chrono::steady_clock::now();
+        auto cb    = cb::CompressedBlocks::from_file(file, cb_block_size);
+        cb.save(output);
+        auto end  = std::chrono::steady_clock::now();
+        auto time = std::chrono::duration_cast<std::chrono::milliseconds>(end - begin).count();
+
+        std::cout << "RESULT type=build ds=compressed_blocks input_file=" << file << " output_file=" << output
+                  << " input_size=" << std::filesystem::file_size(file) << " block_size=" << cb.block_size()
+                  << " num_blocks=" << cb.num_blocks() << " compressed_size=" << cb.compressed_size()
+                  << " output_size=" << std::filesystem::file_size(output) << " time=" << time << std::endl;
+        return 0;
+    }
+
+    /**
+     * @brief Builds a block tree of the input and saves it.
+     */
+    int build_blocktree() {
+        using namespace gracli;
+
+        if (output.empty()) {
+            output = file + ".gbt";
+        }
+
+        const bt::BlockTreeParams params{bt_arity, bt_root_arity, bt_leaf_length, bt_prefix_suffix};
+
+        auto begin = std::chrono::steady_clock::now();
+        auto tree  = bt::BlockTree::from_file(file, params);
+        tree.save(output);
+        auto end  = std::chrono::steady_clock::now();
+        auto time = std::chrono::duration_cast<std::chrono::milliseconds>(end - begin).count();
+
+        std::cout << "RESULT type=build ds=blocktree_native input_file=" << file << " output_file=" << output
+                  << " input_size=" << std::filesystem::file_size(file) << " arity=" << params.arity
+                  << " root_arity=" << params.root_arity << " leaf_length=" << params.leaf_length
+                  << " prefix_suffix=" << params.prefix_suffix << " num_levels=" << tree.num_levels()
+                  << " output_size=" << std::filesystem::file_size(output) << " time=" << time << std::endl;
+        return 0;
+    }
+
+    /**
+     * @brief Parses the input in chunks, builds the index from the parsing and saves it.
+     *
+     * The parsing is written to a temporary file next to the output while it is computed, so only the current chunk
+     * is kept in memory. The index is only built if its estimated memory (see `LZEND_INDEX_BYTES_PER_PHRASE`) does not
+     * exceed the memory limit.
+     *
+     * @return The number of phrases or an empty optional if building the index would exceed the memory limit
+     */
+    template<typename LzEndDS>
+    auto build_index(const size_t chunk_size) -> std::optional<size_t> {
+        const std::string parsing_file = output + ".parsing.tmp";
+        const size_t      num_phrases  = gracli::lz::encode_chunked(file, parsing_file, chunk_size).second;
+        const size_t      memory_needed = num_phrases * gracli::lz::LZEND_INDEX_BYTES_PER_PHRASE;
+        if (memory_needed > ((size_t) memory_mib << 20)) {
+            std::filesystem::remove(parsing_file);
+            std::cerr << "Building the index of " << num_phrases << " phrases needs about " << (memory_needed >> 20)
+                      << " MiB, which exceeds the memory limit. Increase -m or write the parsing without -i"
+                      << std::endl;
+            return std::nullopt;
+        }
+
+        LzEndDS ds = LzEndDS::from_file(parsing_file);
+        std::filesystem::remove(parsing_file);
+        if (lzend_max_hops > 0) {
+            ds.bound_hops(lzend_max_hops);
+        }
+        ds.save(output);
+        return ds.num_phrases();
+    }
+
+    int run(oocmd::Application const &app) {
+        using namespace gracli;
+
+        if (lzend + blocktree + compressed != 1) {
+            std::cerr << "Exactly one output format must be given. Use --lzend, --blocktree or --compressed_blocks"
+                      << std::endl;
+            return -1;
+        }
+
+        if (!std::filesystem::exists(file)) {
+            std::cerr << "file " << file << " does not exist" << std::endl;
+            return -1;
+        }
+
+        if (blocktree) {
+            return build_blocktree();
+        }
+        if (compressed) {
+            return build_compressed_blocks();
+        }
+
+        const auto grammar_type = static_cast<GrammarType>(type);
+        if (index && grammar_type != GrammarType::LzEnd && grammar_type != GrammarType::SampledLzEnd) {
+            std::cerr << "Indices can only be built for LzEnd (5 or 8)" << std::endl;
+            return -1;
+        }
+
+        if (output.empty()) {
+            output = file + (index ? ".lzidx" : ".lzend");
         }
 
+        const size_t chunk_size = lz::chunk_size_for_memory((size_t) memory_mib << 20);
+
+        auto   begin       = std::chrono::steady_clock::now();
+        size_t num_phrases = 0;
+        if (!index) {
+            num_phrases = lz::encode_chunked(file, output, chunk_size).second;
+        } else {
+            const auto built = grammar_type == GrammarType::LzEnd ? build_index<lz::LzEnd>(chunk_size)
+                                                                  : build_index<lz::SampledLzEnd>(chunk_size);
+            if (!built) {
+                return -1;
+            }
+            num_phrases = *built;
+        }
+        auto end  = std::chrono::steady_clock::now();
+        auto time = std::chrono::duration_cast<std::chrono::milliseconds>(end - begin).count();
+
+        std::cout << "RESULT type=build ds=" << (index ? grammar_type_name(grammar_type) : "lzend_parsing")
+                  << " input_file=" << file << " output_file=" << output
+                  << " input_size=" << std::filesystem::file_size(file) << " num_phrases=" << num_phrases
+                  << " chunk_size=" << chunk_size << " time=" << time << std::endl;
         return 0;
     }
 };
 
 auto main(int argc, char **argv) -> int {
+    if (argc > 1 && std::string_view(argv[1]) == "build") {
+        GracliBuild build;
+        oocmd::Application::run(build, argc - 1, argv + 1);
+        return 0;
+    }
+
     Gracli gracli;
     oocmd::Application::run(gracli, argc, argv);
 }
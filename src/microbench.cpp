@@ -0,0 +1,331 @@
+#include <algorithm>
+#include <cstdint>
+#include <numeric>
+#include <random>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include <blocktree/native_block_tree.hpp>
+#include <grammar/grammar.hpp>
+#include <grammar/grammar_tuple_coder.hpp>
+#include <grammar/sampled_scan_query_grammar.hpp>
+#include <lzend/lzend.hpp>
+#include <util/bit_input_stream.hpp>
+#include <util/permutation.hpp>
+#include <util/util.hpp>
+
+#include <benchmark/benchmark.h>
+
+#ifndef GRACLI_TEST_DATA_DIR
+#define GRACLI_TEST_DATA_DIR "test/test_data"
+#endif
+
+using namespace gracli;
+
+namespace {
+
+const std::string TEST_DATA = GRACLI_TEST_DATA_DIR;
+
+/**
+ * @brief The number of queries run per benchmark iteration in the query benchmarks
+ */
+constexpr size_t BATCH = 1024;
+
+/**
+ * @brief Generates a repetitive text by copying random earlier parts of the text with some random mutations.
+ */
+auto repetitive_text(const size_t n, const uint32_t seed = 0) -> std::string {
+    std::mt19937                            gen(seed);
+    std::uniform_int_distribution<int>      rand_char('a', 'z');
+    std::uniform_int_distribution<uint32_t> rand_percent(0, 99);
+
+    std::string text;
+    text.reserve(n);
+    for (size_t i = 0; i < std::min<size_t>(n, 256); i++) {
+        text.push_back((char) rand_char(gen));
+    }
+    while (text.size() < n) {
+        std::uniform_int_distribution<size_t> rand_pos(0, text.size() - 1);
+        const size_t                          src = rand_pos(gen);
+        const size_t len = std::min({(size_t) 1 + rand_pos(gen) % 512, text.size() - src, n - text.size()});
+        for (size_t i = 0; i < len; i++) {
+            text.push_back(rand_percent(gen) == 0 ? (char) rand_char(gen) : text[src + i]);
+        }
+    }
+    return text;
+}
+
+auto random_positions(const size_t count, const size_t n, const uint32_t seed = 0) -> std::vector<size_t> {
+    std::mt19937                          gen(seed);
+    std::uniform_int_distribution<size_t> rand_int(0, n - 1);
+    std::vector<size_t>                   positions(count);
+    std::generate(positions.begin(), positions.end(), [&] { return rand_int(gen); });
+    return positions;
+}
+
+const std::vector<std::string> GRAMMAR_FILES = {TEST_DATA + "/fox.txt.rp", TEST_DATA + "/fox.txt.seq"};
+
+} // namespace
+
+// ------------------------------ BitIStream ------------------------------
+
+/**
+ * Reads integers of width state.range(0) from a random byte buffer of 1 MiB.
+ */
+static void BM_BitIStream_read_int(benchmark::State &state) {
+    const size_t bits = state.range(0);
+
+    std::mt19937                       gen(0);
+    std::uniform_int_distribution<int> rand_byte(0, UINT8_MAX);
+    std::string                        data(1 << 20, 0);
+    std::generate(data.begin(), data.end(), [&] { return (char) rand_byte(gen); });
+
+    // Leave some headroom, so the stream never runs dry
+    const size_t num_ints = (data.size() * CHAR_BIT) / bits - 2;
+    for (auto _ : state) {
+        std::istringstream in(data);
+        BitIStream         br(std::move(in));
+        for (size_t i = 0; i < num_ints; i++) {
+            benchmark::DoNotOptimize(br.read_int<uint64_t>(bits));
+        }
+    }
+    state.SetItemsProcessed(state.iterations() * num_ints);
+    state.SetBytesProcessed(state.iterations() * num_ints * bits / CHAR_BIT);
+}
+BENCHMARK(BM_BitIStream_read_int)->Arg(1)->Arg(7)->Arg(8)->Arg(13)->Arg(32)->Arg(64);
+
+// ------------------------------ GrammarTupleCoder ------------------------------
+
+/**
+ * Decodes the grammar file GRAMMAR_FILES[state.range(0)].
+ */
+static void BM_GrammarTupleCoder_decode(benchmark::State &state) {
+    const std::string &file = GRAMMAR_FILES[state.range(0)];
+    state.SetLabel(file.substr(file.find_last_of('/') + 1));
+    for (auto _ : state) {
+        auto rules = GrammarTupleCoder::decode(file);
+        benchmark::DoNotOptimize(rules.symbol_count());
+    }
+}
+BENCHMARK(BM_GrammarTupleCoder_decode)->DenseRange(0, 1)->Unit(benchmark::kMicrosecond);
+
+// ------------------------------ SampledScanQueryGrammar ------------------------------
+
+/**
+ * Queries the expanded length of random symbols in the grammar GRAMMAR_FILES[state.range(0)].
+ */
+static void BM_SampledScan_symbol_length(benchmark::State &state) {
+    const std::string &file = GRAMMAR_FILES[state.range(0)];
+    state.SetLabel(file.substr(file.find_last_of('/') + 1));
+    const auto grm = SampledScanQueryGrammar<512>::from_file(file);
+
+    // Random (rule, index) pairs
+    std::mt19937                          gen(0);
+    std::uniform_int_distribution<size_t> rand_rule(0, grm.rule_count() - 1);
+    std::vector<std::pair<size_t, size_t>> symbols(BATCH);
+    for (auto &[rule, index] : symbols) {
+        rule = rand_rule(gen);
+        while (grm[rule].size() == 0) {
+            rule = rand_rule(gen);
+        }
+        index = std::uniform_int_distribution<size_t>(0, grm[rule].size() - 1)(gen);
+    }
+
+    for (auto _ : state) {
+        for (const auto &[rule, index] : symbols) {
+            benchmark::DoNotOptimize(grm.symbol_length(rule, index));
+        }
+    }
+    state.SetItemsProcessed(state.iterations() * BATCH);
+}
+BENCHMARK(BM_SampledScan_symbol_length)->DenseRange(0, 1);
+
+/**
+ * Random access on the grammar GRAMMAR_FILES[state.range(0)].
+ */
+static void BM_SampledScan_at(benchmark::State &state) {
+    const std::string &file = GRAMMAR_FILES[state.range(0)];
+    state.SetLabel(file.substr(file.find_last_of('/') + 1));
+    const auto grm       = SampledScanQueryGrammar<512>::from_file(file);
+    const auto positions = random_positions(BATCH, grm.source_length());
+    for (auto _ : state) {
+        for (const size_t i : positions) {
+            benchmark::DoNotOptimize(grm.at(i));
+        }
+    }
+    state.SetItemsProcessed(state.iterations() * BATCH);
+}
+BENCHMARK(BM_SampledScan_at)->DenseRange(0, 1);
+
+/**
+ * Fingerprints of substrings of length state.range(1) on the grammar GRAMMAR_FILES[state.range(0)].
+ */
+static void BM_SampledScan_fingerprint(benchmark::State &state) {
+    const std::string &file = GRAMMAR_FILES[state.range(0)];
+    state.SetLabel(file.substr(file.find_last_of('/') + 1));
+    const auto   grm       = SampledScanQueryGrammar<512>::from_file(file);
+    const size_t len       = state.range(1);
+    const auto   positions = random_positions(BATCH, grm.source_length() - len + 1);
+    for (auto _ : state) {
+        for (const size_t i : positions) {
+            benchmark::DoNotOptimize(grm.fingerprint(i, len));
+        }
+    }
+    state.SetItemsProcessed(state.iterations() * BATCH);
+}
+BENCHMARK(BM_SampledScan_fingerprint)->ArgsProduct({{0, 1}, {16, 1024}});
+
+// ------------------------------ LzEnd ------------------------------
+
+/**
+ * Decodes the LzEnd parsing of the test data.
+ */
+static void BM_LzEnd_decode(benchmark::State &state) {
+    const std::string file = TEST_DATA + "/fox.txt.lzend";
+    size_t            num_phrases = 0;
+    for (auto _ : state) {
+        auto [parsing, source_len] = lz::decode(file);
+        num_phrases                = parsing.size();
+        benchmark::DoNotOptimize(source_len);
+    }
+    state.SetItemsProcessed(state.iterations() * num_phrases);
+}
+BENCHMARK(BM_LzEnd_decode)->Unit(benchmark::kMicrosecond);
+
+/**
+ * Random access on the LzEnd parsing of the test data.
+ */
+template<typename LzEndDS>
+static void BM_LzEnd_at_test_data(benchmark::State &state) {
+    const auto lzend     = LzEndDS::from_file(TEST_DATA + "/fox.txt.lzend");
+    const auto positions = random_positions(BATCH, lzend.source_length());
+    for (auto _ : state) {
+        for (const size_t i : positions) {
+            benchmark::DoNotOptimize(lzend.at(i));
+        }
+    }
+    state.SetItemsProcessed(state.iterations() * BATCH);
+}
+BENCHMARK_TEMPLATE(BM_LzEnd_at_test_data, lz::LzEnd);
+BENCHMARK_TEMPLATE(BM_LzEnd_at_test_data, lz::SampledLzEnd);
+
+/**
+ * Random access on the LzEnd parsing of a synthetic repetitive text of length state.range(0).
+ */
+template<typename LzEndDS>
+static void BM_LzEnd_at_synthetic(benchmark::State &state) {
+    const auto lzend     = LzEndDS::from_string(repetitive_text(state.range(0)));
+    const auto positions = random_positions(BATCH, lzend.source_length());
+    state.counters["phrases"] = (double) lzend.num_phrases();
+    for (auto _ : state) {
+        for (const size_t i : positions) {
+            benchmark::DoNotOptimize(lzend.at(i));
+        }
+    }
+    state.SetItemsProcessed(state.iterations() * BATCH);
+}
+BENCHMARK_TEMPLATE(BM_LzEnd_at_synthetic, lz::LzEnd)->RangeMultiplier(16)->Range(1 << 12, 1 << 24);
+BENCHMARK_TEMPLATE(BM_LzEnd_at_synthetic, lz::SampledLzEnd)->RangeMultiplier(16)->Range(1 << 12, 1 << 24);
+
+/**
+ * Extraction of substrings of length state.range(0) from the LzEnd parsing of a synthetic repetitive text of length
+ * 2^20.
+ */
+static void BM_LzEnd_substr(benchmark::State &state) {
+    const auto        lzend     = lz::LzEnd::from_string(repetitive_text(1 << 20));
+    const size_t      len       = state.range(0);
+    const auto        positions = random_positions(BATCH, lzend.source_length() - len);
+    std::vector<char> buf(len);
+    for (auto _ : state) {
+        for (const size_t i : positions) {
+            benchmark::DoNotOptimize(lzend.substr(buf.data(), i, len));
+        }
+    }
+    state.SetBytesProcessed(state.iterations() * BATCH * len);
+}
+BENCHMARK(BM_LzEnd_substr)->RangeMultiplier(16)->Range(16, 1 << 16);
+
+/**
+ * Substrings of length state.range(0) from a block tree of arity 2 without prefix/suffix data of a synthetic
+ * repetitive text of length 2^20.
+ */
+static void BM_BlockTree_substr(benchmark::State &state) {
+    const auto        text      = repetitive_text(1 << 20);
+    const auto       *data      = reinterpret_cast<const bt::BlockTree::Char *>(text.data());
+    const auto        bt        = bt::BlockTree::from_text(data, text.length(), {2, 128, 16, 0});
+    const size_t      len       = state.range(0);
+    const auto        positions = random_positions(BATCH, bt.source_length() - len);
+    std::vector<char> buf(len);
+    for (auto _ : state) {
+        for (const size_t i : positions) {
+            benchmark::DoNotOptimize(bt.substr(buf.data(), i, len));
+        }
+    }
+    state.SetBytesProcessed(state.iterations() * BATCH * len);
+}
+BENCHMARK(BM_BlockTree_substr)->RangeMultiplier(16)->Range(16, 1 << 16);
+
+/**
+ * Random access on the LzEnd parsing of a synthetic repetitive text of length 2^20 with at most state.range(0) jumps
+ * per access (0 = no bound).
+ */
+static void BM_LzEnd_at_bounded_hops(benchmark::State &state) {
+    auto       lzend     = lz::LzEnd::from_string(repetitive_text(1 << 20));
+    const auto positions = random_positions(BATCH, lzend.source_length());
+    state.counters["explicit_phrases"] = (double) lzend.bound_hops(state.range(0));
+    for (auto _ : state) {
+        for (const size_t i : positions) {
+            benchmark::DoNotOptimize(lzend.at(i));
+        }
+    }
+    state.SetItemsProcessed(state.iterations() * BATCH);
+}
+BENCHMARK(BM_LzEnd_at_bounded_hops)->Arg(0)->RangeMultiplier(2)->Range(1, 64);
+
+/**
+ * Random access on the LzEnd parsing of a synthetic repetitive text of length 2^20 with a cache of state.range(0) KiB
+ * (0 = no cache). The cache is kept between iterations.
+ */
+static void BM_LzEnd_at_cached(benchmark::State &state) {
+    auto       lzend     = lz::LzEnd::from_string(repetitive_text(1 << 20));
+    const auto positions = random_positions(BATCH, lzend.source_length());
+    lzend.enable_cache(state.range(0) << 10);
+    for (auto _ : state) {
+        for (const size_t i : positions) {
+            benchmark::DoNotOptimize(lzend.at(i));
+        }
+    }
+    state.SetItemsProcessed(state.iterations() * BATCH);
+    if (const auto *cache = lzend.cache()) {
+        state.counters["hit_rate"]    = cache->hit_rate();
+        state.counters["cache_bytes"] = (double) cache->size_in_bytes();
+    }
+}
+BENCHMARK(BM_LzEnd_at_cached)->Arg(0)->RangeMultiplier(8)->Range(64, 1 << 15);
+
+// ------------------------------ Permutation ------------------------------
+
+/**
+ * Inverse lookups in a random permutation of size state.range(0).
+ */
+static void BM_Permutation_previous(benchmark::State &state) {
+    const size_t        n = state.range(0);
+    std::vector<size_t> values(n);
+    std::iota(values.begin(), values.end(), 0);
+    std::shuffle(values.begin(), values.end(), std::mt19937(0));
+
+    Permutation<> perm;
+    perm.construct(values);
+
+    const auto positions = random_positions(BATCH, n);
+    for (auto _ : state) {
+        for (const size_t i : positions) {
+            benchmark::DoNotOptimize(perm.previous(i));
+        }
+    }
+    state.SetItemsProcessed(state.iterations() * BATCH);
+}
+BENCHMARK(BM_Permutation_previous)->RangeMultiplier(16)->Range(1 << 8, 1 << 24);
+
+BENCHMARK_MAIN();
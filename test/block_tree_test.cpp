@@ -0,0 +1,182 @@
+#include <blocktree/native_block_tree.hpp>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <gtest/gtest.h>
+#include <random>
+#include <string>
+#include <util/util.hpp>
+
+const std::string FOX_IN_SOCKS = "test/test_data/fox.txt";
+
+using gracli::bt::BlockTree;
+using gracli::bt::BlockTreeParams;
+
+namespace {
+
+auto build(const std::string &s, const BlockTreeParams &params) -> BlockTree {
+    return BlockTree::from_text(reinterpret_cast<const BlockTree::Char *>(s.data()), s.length(), params);
+}
+
+void check_access(const std::string &s, const BlockTree &bt, const std::string &what) {
+    ASSERT_EQ(s.length(), bt.source_length()) << "Incorrect source length for " << what;
+    for (size_t i = 0; i < s.length(); i++) {
+        ASSERT_EQ(s.at(i), bt.at(i)) << "Incorrect random access at index " << i << " for " << what;
+    }
+}
+
+/**
+ * @brief A text consisting of mutated copies of a random seed, like a versioned document.
+ */
+auto repetitive_text(const size_t length, const size_t seed_length, const unsigned int seed) -> std::string {
+    std::mt19937                       gen(seed);
+    std::uniform_int_distribution<int> letter('a', 'd');
+    std::string                        base(seed_length, 'a');
+    for (auto &c : base) {
+        c = (char) letter(gen);
+    }
+    std::string s;
+    while (s.length() < length) {
+        base[gen() % base.length()] = (char) letter(gen);
+        s += base;
+    }
+    s.resize(length);
+    return s;
+}
+
+} // namespace
+
+TEST(block_tree_test, random_access_test) {
+    auto source_path = std::filesystem::absolute(FOX_IN_SOCKS);
+    ASSERT_TRUE(std::filesystem::exists(source_path)) << "Test file " << source_path << " does not exist";
+    auto s = gracli::read_to_string(source_path);
+
+    for (const BlockTreeParams params : {BlockTreeParams{2, 128, 16, 0},
+                                         BlockTreeParams{2, 128, 2, 0},
+                                         BlockTreeParams{32, 128, 16, 0},
+                                         BlockTreeParams{4, 1, 4, 0},
+                                         BlockTreeParams{2, 128, 16, 4},
+                                         BlockTreeParams{32, 128, 2, 16}}) {
+        const auto bt = build(s, params);
+        check_access(s, bt,
+                     "arity " + std::to_string(params.arity) + ", leaf length " + std::to_string(params.leaf_length) +
+                         ", prefix/suffix " + std::to_string(params.prefix_suffix));
+    }
+}
+
+TEST(block_tree_test, repetitive_test) {
+    for (const size_t length : {1, 7, 1000, 100000}) {
+        const auto s = repetitive_text(length, 300, length);
+        check_access(s, build(s, {2, 16, 4, 0}), "repetitive text of length " + std::to_string(length));
+        check_access(s, build(s, {3, 8, 5, 2}), "repetitive text of length " + std::to_string(length));
+    }
+
+    const std::string unary(5000, 'a');
+    check_access(unary, build(unary, {2, 4, 1, 0}), "unary text");
+}
+
+TEST(block_tree_test, substring_test) {
+    const auto s = repetitive_text(20000, 500, 1);
+
+    std::string buf(s.length(), '\0');
+    for (const BlockTreeParams params : {BlockTreeParams{4, 32, 8, 0},
+                                         BlockTreeParams{2, 16, 2, 0},
+                                         BlockTreeParams{2, 16, 16, 4},
+                                         BlockTreeParams{3, 8, 5, 2}}) {
+        const auto bt = build(s, params);
+        for (size_t start = 0; start < s.length(); start += 97) {
+            for (const size_t len : {1, 10, 100, 300, 20000}) {
+                const size_t expected_len = std::min(len, s.length() - start);
+                const char  *end          = bt.substr(buf.data(), start, len);
+                ASSERT_EQ(expected_len, (size_t) (end - buf.data())) << "Incorrect length at " << start;
+                ASSERT_EQ(s.substr(start, expected_len), buf.substr(0, expected_len))
+                    << "Incorrect substring at " << start << " with length " << len << " and arity " << params.arity;
+            }
+        }
+    }
+}
+
+TEST(block_tree_test, full_leaf_word_substring_test) {
+    // Random text has no repetitions, so with these parameters all 64 leaves are internal and fill exactly one word of
+    // the leaf level's bit vector
+    std::mt19937                       gen(1);
+    std::uniform_int_distribution<int> byte(0, UINT8_MAX);
+    std::string                        s(1024, '\0');
+    for (auto &c : s) {
+        c = (char) byte(gen);
+    }
+
+    const auto  bt = build(s, {2, 32, 16, 0});
+    std::string buf(s.length(), '\0');
+    for (size_t start = 900; start < s.length(); start++) {
+        const size_t len = s.length() - start;
+        const char  *end = bt.substr(buf.data(), start, len);
+        ASSERT_EQ(len, (size_t) (end - buf.data())) << "Incorrect length at " << start;
+        ASSERT_EQ(s.substr(start), buf.substr(0, len)) << "Incorrect substring at " << start;
+    }
+}
+
+TEST(block_tree_test, save_load_test) {
+    auto source_path = std::filesystem::absolute(FOX_IN_SOCKS);
+    auto index_path  = std::filesystem::temp_directory_path() / "gracli_block_tree_test.gbt";
+    auto s           = gracli::read_to_string(source_path);
+
+    ASSERT_FALSE(BlockTree::is_index_file(source_path)) << "Text is recognized as a block tree";
+    build(s, {4, 64, 8, 2}).save(index_path);
+    ASSERT_TRUE(BlockTree::is_index_file(index_path)) << "Saved block tree is not recognized";
+
+    const auto loaded = BlockTree::from_file(index_path);
+    ASSERT_EQ(4, loaded.params().arity) << "Parameters are not restored";
+    check_access(s, loaded, "loaded block tree");
+
+    std::string buf(s.length(), '\0');
+    loaded.substr(buf.data(), 0, s.length());
+    ASSERT_EQ(s, buf) << "Incorrect substring of loaded block tree";
+
+    // A mapped tree is saved unchanged
+    auto copy_path = std::filesystem::temp_directory_path() / "gracli_block_tree_test_copy.gbt";
+    loaded.save(copy_path);
+    ASSERT_EQ(gracli::read_to_string(index_path), gracli::read_to_string(copy_path)) << "Saved copy differs";
+
+    std::filesystem::resize_file(copy_path, std::filesystem::file_size(copy_path) / 2);
+    ASSERT_THROW(BlockTree::load(copy_path), std::runtime_error) << "Truncated block tree is loaded";
+    std::filesystem::remove(copy_path);
+    std::filesystem::remove(index_path);
+}
+
+TEST(block_tree_test, inconsistent_load_test) {
+    auto source_path = std::filesystem::absolute(FOX_IN_SOCKS);
+    auto index_path  = std::filesystem::temp_directory_path() / "gracli_block_tree_test_inconsistent.gbt";
+    auto s           = gracli::read_to_string(source_path);
+    build(s, {2, 16, 8, 0}).save(index_path);
+    const auto image = gracli::read_to_string(index_path);
+    build("", {}).save(index_path);
+    const auto empty_image = gracli::read_to_string(index_path);
+
+    // Changes a 64 bit field of the header (see BlockTree::Header), whose level headers start after its 10 fields
+    const auto load_changed = [&](const std::string &original, const size_t field, const int64_t change) {
+        std::string changed = original;
+        uint64_t    value;
+        std::memcpy(&value, changed.data() + field * sizeof(uint64_t), sizeof(value));
+        value += change;
+        std::memcpy(changed.data() + field * sizeof(uint64_t), &value, sizeof(value));
+        std::ofstream(index_path, std::ios::binary).write(changed.data(), (std::streamsize) changed.size());
+        return BlockTree::load(index_path);
+    };
+    ASSERT_NO_THROW(load_changed(image, 0, 0)) << "Unchanged block tree is not loaded";
+    ASSERT_THROW(load_changed(image, 9, -8), std::runtime_error) << "Block tree with missing leaves is loaded";
+    ASSERT_THROW(load_changed(image, 10 + 1, 64), std::runtime_error)
+        << "Block tree with too many top level blocks is loaded";
+    ASSERT_THROW(load_changed(image, 2, (int64_t) s.length()), std::runtime_error)
+        << "Block tree whose top level does not cover the text is loaded";
+    ASSERT_THROW(load_changed(empty_image, 2, 5), std::runtime_error) << "Block tree without levels is not empty";
+    std::filesystem::remove(index_path);
+}
+
+TEST(block_tree_test, empty_test) {
+    auto index_path = std::filesystem::temp_directory_path() / "gracli_block_tree_test_empty.gbt";
+    build("", {}).save(index_path);
+    const auto loaded = BlockTree::load(index_path);
+    ASSERT_EQ(0, loaded.source_length()) << "Empty block tree is not empty after loading";
+    std::filesystem::remove(index_path);
+}
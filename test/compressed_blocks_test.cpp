@@ -0,0 +1,102 @@
+#include <compressed_blocks/compressed_blocks.hpp>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <gtest/gtest.h>
+#include <random>
+#include <string>
+#include <util/util.hpp>
+#include <vector>
+
+const std::string FOX_IN_SOCKS = "test/test_data/fox.txt";
+
+using gracli::cb::CompressedBlocks;
+using gracli::cb::LzBlockCodec;
+
+namespace {
+
+auto build(const std::string &s, const size_t block_size) -> CompressedBlocks {
+    const auto *text = reinterpret_cast<const CompressedBlocks::Char *>(s.data());
+    return CompressedBlocks::from_text(text, s.length(), block_size);
+}
+
+void check_queries(const std::string &s, const CompressedBlocks &cb, const std::string &what) {
+    ASSERT_EQ(s.length(), cb.source_length()) << "Incorrect source length for " << what;
+    for (size_t i = 0; i < s.length(); i++) {
+        ASSERT_EQ(s.at(i), cb.at(i)) << "Incorrect random access at index " << i << " for " << what;
+    }
+
+    std::string buf(s.length(), '\0');
+    for (size_t start = 0; start < s.length(); start += 37) {
+        for (const size_t len : {1, 10, 300, 5000, 100000}) {
+            const size_t expected_len = std::min(len, s.length() - start);
+            const char  *end          = cb.substr(buf.data(), start, len);
+            ASSERT_EQ(expected_len, (size_t) (end - buf.data())) << "Incorrect length at " << start << " for " << what;
+            ASSERT_EQ(s.substr(start, expected_len), buf.substr(0, expected_len))
+                << "Incorrect substring at " << start << " with length " << len << " for " << what;
+        }
+    }
+}
+
+} // namespace
+
+TEST(compressed_blocks_test, codec_test) {
+    std::mt19937 gen(1);
+    for (const size_t len : {0, 1, 3, 4, 100, 4096, 65536}) {
+        for (const int alphabet : {1, 4, 256}) {
+            std::vector<uint8_t> text(len);
+            for (auto &c : text) {
+                c = (uint8_t) (gen() % alphabet);
+            }
+            std::vector<uint8_t> compressed;
+            LzBlockCodec::compress(text.data(), len, compressed);
+
+            std::vector<uint8_t> decompressed(len);
+            LzBlockCodec::decompress(compressed.data(), compressed.size(), decompressed.data(), len);
+            ASSERT_EQ(text, decompressed) << "Incorrect round trip of length " << len << " with alphabet " << alphabet;
+            if (alphabet == 1 && len > 100) {
+                ASSERT_LT(compressed.size(), len / 50) << "Unary text of length " << len << " is not compressed";
+            }
+        }
+    }
+}
+
+TEST(compressed_blocks_test, random_access_test) {
+    auto source_path = std::filesystem::absolute(FOX_IN_SOCKS);
+    ASSERT_TRUE(std::filesystem::exists(source_path)) << "Test file " << source_path << " does not exist";
+    auto s = gracli::read_to_string(source_path);
+
+    for (const size_t block_size : {1, 64, 1000, 4096, 65536}) {
+        auto cb = build(s, block_size);
+        if (block_size >= 1000) {
+            ASSERT_LT(cb.compressed_size(), s.length()) << "Text is not compressed with block size " << block_size;
+        }
+        check_queries(s, cb, "block size " + std::to_string(block_size));
+        cb.enable_cache(3);
+        check_queries(s, cb, "block size " + std::to_string(block_size) + " with cache");
+        ASSERT_GT(cb.cache()->hits(), 0) << "Cache is not used with block size " << block_size;
+    }
+}
+
+TEST(compressed_blocks_test, save_load_test) {
+    auto source_path = std::filesystem::absolute(FOX_IN_SOCKS);
+    auto index_path  = std::filesystem::temp_directory_path() / "gracli_compressed_blocks_test.gcb";
+    auto s           = gracli::read_to_string(source_path);
+
+    ASSERT_FALSE(CompressedBlocks::is_index_file(source_path)) << "Text is recognized as compressed blocks";
+    build(s, 512).save(index_path);
+    ASSERT_TRUE(CompressedBlocks::is_index_file(index_path)) << "Saved compressed blocks are not recognized";
+
+    const auto loaded = CompressedBlocks::from_file(index_path);
+    ASSERT_EQ(512, loaded.block_size()) << "Block size is not restored";
+    check_queries(s, loaded, "loaded compressed blocks");
+
+    // The second block offset, after the magic number, the source length, the block size and the number of offsets
+    std::string image = gracli::read_to_string(index_path);
+    ASSERT_GT(loaded.num_blocks(), 2) << "Too few blocks to corrupt an offset";
+    const uint64_t offset = loaded.compressed_size();
+    std::memcpy(image.data() + 5 * sizeof(uint64_t), &offset, sizeof(offset));
+    std::ofstream(index_path, std::ios::binary).write(image.data(), (std::streamsize) image.size());
+    ASSERT_THROW(CompressedBlocks::load(index_path), std::runtime_error) << "Decreasing block offsets are loaded";
+    std::filesystem::remove(index_path);
+}
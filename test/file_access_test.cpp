@@ -0,0 +1,88 @@
+#include <file_access/batch_reader.hpp>
+#include <file_access/file_access.hpp>
+#include <filesystem>
+#include <gtest/gtest.h>
+#include <optional>
+#include <string>
+#include <vector>
+#include <util/util.hpp>
+
+const std::string FOX_IN_SOCKS = "test/test_data/fox.txt";
+
+using gracli::FileAccess;
+using gracli::FileAccessOptions;
+
+namespace {
+
+void check_file_access(const std::string &mode, const std::string &advice, const size_t cache_kib) {
+    auto source_path = std::filesystem::absolute(FOX_IN_SOCKS);
+    ASSERT_TRUE(std::filesystem::exists(source_path)) << "Test file " << source_path << " does not exist";
+    auto s = gracli::read_to_string(source_path);
+
+    FileAccessOptions options;
+    ASSERT_TRUE(options.parse(mode, advice)) << "Options " << mode << ", " << advice << " are not recognized";
+    options.direct_cache_kib = cache_kib;
+
+    std::optional<FileAccess> file_access;
+    try {
+        file_access.emplace(FileAccess::from_file(source_path, options));
+    } catch (const std::runtime_error &e) {
+        // Some file systems, like tmpfs, do not support O_DIRECT
+        GTEST_SKIP() << e.what();
+    }
+    const std::string what = mode + " with " + advice + " advice";
+
+    ASSERT_EQ(s.length(), file_access->source_length()) << "Incorrect source length for " << what;
+    for (size_t i = 0; i < s.length(); i++) {
+        ASSERT_EQ(s.at(i), file_access->at(i)) << "Incorrect random access at index " << i << " for " << what;
+    }
+
+    std::string buf(s.length(), '\0');
+    for (size_t start = 0; start < s.length(); start += 61) {
+        for (const size_t len : {1, 100, 5000, 100000}) {
+            const size_t expected_len = std::min(len, s.length() - start);
+            const char  *end          = file_access->substr(buf.data(), start, len);
+            ASSERT_EQ(expected_len, (size_t) (end - buf.data())) << "Incorrect length at " << start << " for " << what;
+            ASSERT_EQ(s.substr(start, expected_len), buf.substr(0, expected_len))
+                << "Incorrect substring at " << start << " with length " << len << " for " << what;
+        }
+    }
+}
+
+} // namespace
+
+TEST(file_access_test, pread_test) {
+    check_file_access("pread", "normal", 0);
+    check_file_access("pread", "random", 0);
+}
+
+TEST(file_access_test, mmap_test) {
+    check_file_access("mmap", "normal", 0);
+    check_file_access("mmap", "sequential", 0);
+    check_file_access("mmap", "willneed", 0);
+}
+
+TEST(file_access_test, direct_test) {
+    check_file_access("direct", "normal", 0);
+    check_file_access("direct", "normal", 16);
+}
+
+TEST(file_access_test, batch_test) {
+    auto source_path = std::filesystem::absolute(FOX_IN_SOCKS);
+    auto s           = gracli::read_to_string(source_path);
+    auto file_access = FileAccess::from_file(source_path);
+
+    std::vector<gracli::BatchRequest> requests;
+    size_t                            expected = 0;
+    for (size_t i = 0; i < s.length(); i += 7) {
+        requests.push_back({i, i % 3 == 0 ? 0 : i % 50});
+        expected += s[i];
+    }
+
+    std::vector<double> latencies;
+    for (const size_t depth : {1, 4, 32}) {
+        const gracli::BatchReader reader(file_access, depth);
+        ASSERT_EQ(expected, reader.run(requests, latencies)) << "Incorrect results with queue depth " << depth;
+        ASSERT_EQ(requests.size(), latencies.size()) << "Missing latencies with queue depth " << depth;
+    }
+}
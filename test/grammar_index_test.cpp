@@ -0,0 +1,61 @@
+#include <algorithm>
+#include <filesystem>
+#include <grammar/grammar_index.hpp>
+#include <gtest/gtest.h>
+#include <string>
+#include <util/util.hpp>
+#include <vector>
+
+const std::string FOX_IN_SOCKS = "test/test_data/fox.txt";
+
+using gracli::GrammarIndex;
+
+namespace {
+
+auto naive_locate(const std::string &s, const std::string &pattern) -> std::vector<size_t> {
+    std::vector<size_t> positions;
+    if (pattern.empty()) {
+        return positions;
+    }
+    for (size_t pos = s.find(pattern); pos != std::string::npos; pos = s.find(pattern, pos + 1)) {
+        positions.push_back(pos);
+    }
+    return positions;
+}
+
+void check_pattern(const std::string &s, const GrammarIndex<512> &index, const std::string &pattern) {
+    const std::vector<size_t> expected = naive_locate(s, pattern);
+    std::vector<size_t>       located  = index.locate(pattern);
+    std::sort(located.begin(), located.end());
+    ASSERT_EQ(expected.size(), index.count(pattern)) << "Incorrect count of \"" << pattern << "\"";
+    ASSERT_EQ(expected, located) << "Incorrect occurrences of \"" << pattern << "\"";
+}
+
+void check_index(const std::string &compressed_path) {
+    auto source_path = std::filesystem::absolute(FOX_IN_SOCKS);
+    ASSERT_TRUE(std::filesystem::exists(source_path)) << "Test file " << source_path << " does not exist";
+    ASSERT_TRUE(std::filesystem::exists(compressed_path)) << "Test file " << compressed_path << " does not exist";
+    auto s     = gracli::read_to_string(source_path);
+    auto index = GrammarIndex<512>::from_file(std::filesystem::absolute(compressed_path));
+
+    ASSERT_EQ(s.length(), index.source_length()) << "Incorrect source length";
+    for (size_t i = 0; i < s.length(); i += 7) {
+        ASSERT_EQ(s.at(i), index.at(i)) << "Incorrect random access at index " << i;
+    }
+
+    for (size_t start = 0; start < s.length(); start += 97) {
+        for (const size_t len : {1, 2, 3, 5, 8, 13, 40, 200}) {
+            check_pattern(s, index, s.substr(start, len));
+        }
+    }
+    check_pattern(s, index, s);
+    for (const std::string pattern : {"", "Fox Fox Fox", "sox!", "\x01", "zzz"}) {
+        check_pattern(s, index, pattern);
+    }
+}
+
+} // namespace
+
+TEST(grammar_index_test, repair_test) { check_index("test/test_data/fox.txt.rp"); }
+
+TEST(grammar_index_test, sequitur_test) { check_index("test/test_data/fox.txt.seq"); }
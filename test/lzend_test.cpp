@@ -2,6 +2,7 @@
 // Created by skadic on 04.10.22.
 //
 #include "lzend/lzend.hpp"
+#include <algorithm>
 #include <filesystem>
 #include <gtest/gtest.h>
 #include <util/util.hpp>
@@ -48,6 +49,106 @@ TEST(lzend_test, substring_test) {
     }
 }
 
+TEST(lzend_test, long_substring_test) {
+    auto source_path     = std::filesystem::absolute(FOX_IN_SOCKS);
+    auto compressed_path = source_path.string() + ".lzend";
+    ASSERT_TRUE(std::filesystem::exists(source_path)) << "Test file " << source_path << " does not exist";
+    ASSERT_TRUE(std::filesystem::exists(compressed_path)) << "Test file " << compressed_path << " does not exist";
+
+    auto lzend = gracli::lz::LzEnd::from_file(compressed_path);
+    auto s     = gracli::read_to_string(source_path);
+    auto n     = s.length();
+
+    std::string buf(n, 0);
+    for (size_t l : {n / 64, n / 8, n / 2, n}) {
+        for (size_t i = 0; i + l <= n; i += std::max(n / 16, (size_t) 1)) {
+            char *end = lzend.substr(buf.data(), i, l);
+            ASSERT_EQ(end - buf.data(), l) << "Incorrect substring length at index " << i << " with length " << l;
+            ASSERT_EQ(buf.substr(0, l), s.substr(i, l)) << "Incorrect substring at index " << i << " with length " << l;
+        }
+    }
+}
+
+TEST(lzend_test, sampled_random_access_test) {
+    auto source_path     = std::filesystem::absolute(FOX_IN_SOCKS);
+    auto compressed_path = source_path.string() + ".lzend";
+    ASSERT_TRUE(std::filesystem::exists(source_path)) << "Test file " << source_path << " does not exist";
+    ASSERT_TRUE(std::filesystem::exists(compressed_path)) << "Test file " << compressed_path << " does not exist";
+
+    auto s     = gracli::read_to_string(source_path);
+    auto lzend = gracli::lz::SampledLzEnd::from_file(compressed_path);
+
+    for (size_t i = 0; i < s.length(); i++) {
+        ASSERT_EQ(s.at(i), lzend.at(i)) << "Incorrect random access at index " << i;
+    }
+}
+
+TEST(lzend_test, sampled_substring_test) {
+    auto source_path     = std::filesystem::absolute(FOX_IN_SOCKS);
+    auto compressed_path = source_path.string() + ".lzend";
+    ASSERT_TRUE(std::filesystem::exists(source_path)) << "Test file " << source_path << " does not exist";
+    ASSERT_TRUE(std::filesystem::exists(compressed_path)) << "Test file " << compressed_path << " does not exist";
+
+    auto lzend = gracli::lz::SampledLzEnd::from_file(compressed_path);
+    auto s     = gracli::read_to_string(source_path);
+    auto n     = s.length();
+
+    char buf1[n + 1];
+    char buf2[n + 1];
+
+    for (size_t l = 1; l < 10; l++) {
+        buf1[l] = 0;
+        buf2[l] = 0;
+        for (size_t i = 0; i < n - l + 1; i++) {
+            std::copy(s.begin() + i, s.begin() + i + l, buf1);
+            lzend.substr(buf2, i, l);
+            ASSERT_EQ(strcmp(buf1, buf2), 0)
+                << "Incorrect substring at index " << i << " with length " << l << ": \""
+                << const_cast<const char *>(buf1) << "\" vs \"" << const_cast<const char *>(buf2) << "\"";
+        }
+    }
+}
+
+TEST(lzend_test, bounded_hops_test) {
+    auto source_path     = std::filesystem::absolute(FOX_IN_SOCKS);
+    auto compressed_path = source_path.string() + ".lzend";
+    ASSERT_TRUE(std::filesystem::exists(source_path)) << "Test file " << source_path << " does not exist";
+    ASSERT_TRUE(std::filesystem::exists(compressed_path)) << "Test file " << compressed_path << " does not exist";
+
+    auto lzend = gracli::lz::LzEnd::from_file(compressed_path);
+    auto s     = gracli::read_to_string(source_path);
+    auto n     = s.length();
+
+    char buf1[n + 1];
+    char buf2[n + 1];
+
+    size_t unbounded_hops = 0;
+    for (size_t i = 0; i < n; i++) {
+        unbounded_hops = std::max(unbounded_hops, lzend.hops(i));
+    }
+    ASSERT_GT(unbounded_hops, 4) << "The test data needs more than 4 hops for the bounds to have an effect";
+
+    for (size_t max_hops : {1, 2, 4}) {
+        lzend.bound_hops(max_hops);
+        for (size_t i = 0; i < n; i++) {
+            ASSERT_EQ(s.at(i), lzend.at(i)) << "Incorrect random access at index " << i << " with at most " << max_hops
+                                            << " hops";
+            ASSERT_LE(lzend.hops(i), max_hops) << "Too many hops for index " << i << " with at most " << max_hops
+                                               << " hops";
+        }
+        for (size_t l = 1; l < 10; l++) {
+            buf1[l] = 0;
+            buf2[l] = 0;
+            for (size_t i = 0; i < n - l + 1; i++) {
+                std::copy(s.begin() + i, s.begin() + i + l, buf1);
+                lzend.substr(buf2, i, l);
+                ASSERT_EQ(strcmp(buf1, buf2), 0) << "Incorrect substring at index " << i << " with length " << l
+                                                 << " with at most " << max_hops << " hops";
+            }
+        }
+    }
+}
+
 TEST(lzend_test, decode_test) {
     using namespace gracli::lz;
     // Get the expected data constructed directly from the source text
@@ -79,3 +180,221 @@ TEST(lzend_test, decode_test) {
         ASSERT_EQ(p1.m_len, p2.m_len) << "Length of factor " << i << " is different";
     }
 }
+
+TEST(lzend_test, compact_decode_test) {
+    using namespace gracli::lz;
+    auto compressed_path = std::filesystem::absolute(FOX_IN_SOCKS).string() + ".lzend";
+    ASSERT_TRUE(std::filesystem::exists(compressed_path))
+        << "Test file" << compressed_path << "does not exist in the test directory";
+
+    auto [l1, s1] = decode(compressed_path);
+    auto compact  = try_decode<uint32_t>(compressed_path);
+    ASSERT_TRUE(compact.has_value()) << "Parsing does not fit into 32 bits";
+    auto &[l2, s2] = *compact;
+
+    ASSERT_EQ(l1.size(), l2.size()) << "Different number of factors";
+    ASSERT_EQ(s1, s2) << "Different text size";
+    for (size_t i = 0; i < l1.size(); i++) {
+        ASSERT_EQ(l1[i].m_char, l2[i].m_char) << "Character of factor " << i << " is different";
+        ASSERT_EQ(l1[i].m_link, l2[i].m_link) << "Source of factor " << i << " is different";
+        ASSERT_EQ(l1[i].m_len, l2[i].m_len) << "Length of factor " << i << " is different";
+    }
+
+    auto wide   = LzEnd::from_parsing(std::move(l1), s1);
+    auto narrow  = LzEnd::from_parsing(std::move(l2), s2);
+    for (size_t i = 0; i < s1; i++) {
+        ASSERT_EQ(wide.at(i), narrow.at(i)) << "Incorrect random access at index " << i;
+    }
+}
+
+TEST(lzend_test, writer_roundtrip_test) {
+    using namespace gracli::lz;
+    auto compressed_path = std::filesystem::absolute(FOX_IN_SOCKS).string() + ".lzend";
+    ASSERT_TRUE(std::filesystem::exists(compressed_path)) << "Test file " << compressed_path << " does not exist";
+
+    auto [l1, s1] = decode(compressed_path);
+
+    auto written_path = std::filesystem::temp_directory_path() / "gracli_writer_roundtrip.lzend";
+    {
+        ParsingWriter writer(written_path, s1);
+        for (size_t i = 0; i < l1.size(); i++) {
+            writer.write(l1[i]);
+        }
+        ASSERT_TRUE(writer.good()) << "Could not write " << written_path;
+    }
+    auto [l2, s2] = decode(written_path);
+    std::filesystem::remove(written_path);
+
+    ASSERT_EQ(l1.size(), l2.size()) << "Different number of factors";
+    ASSERT_EQ(s1, s2) << "Different text size";
+    for (size_t i = 0; i < l1.size(); i++) {
+        LzEnd::Phrase p1 = l1[i];
+        LzEnd::Phrase p2 = l2[i];
+        ASSERT_EQ(p1.m_char, p2.m_char) << "Character of factor " << i << " is different";
+        ASSERT_EQ(p1.m_link, p2.m_link) << "Source of factor " << i << " is different";
+        ASSERT_EQ(p1.m_len, p2.m_len) << "Length of factor " << i << " is different";
+    }
+}
+
+TEST(lzend_test, packed_writer_roundtrip_test) {
+    using namespace gracli::lz;
+    // More phrases than a block of the decoder, so blocks of records which are not byte aligned are read
+    const size_t   num_phrases = DECODE_BLOCK_PHRASES + 1000;
+    LzEnd::Parsing l1;
+    size_t         s1 = 0;
+    for (size_t i = 0; i < num_phrases; i++) {
+        const size_t len = 1 + i % 5;
+        l1.push_back({(LzEnd::Char) ('a' + i % 26), len > 1 ? i / 2 : 0, len});
+        s1 += len;
+    }
+
+    auto written_path = std::filesystem::temp_directory_path() / "gracli_packed_writer_roundtrip.lzend";
+    {
+        ParsingWriter writer(written_path, s1, true);
+        for (size_t i = 0; i < l1.size(); i++) {
+            writer.write(l1[i]);
+        }
+        ASSERT_TRUE(writer.good()) << "Could not write " << written_path;
+    }
+
+    std::ifstream in(written_path, std::ios::binary);
+    char          header[2];
+    in.read(header, sizeof(header));
+    in.close();
+    ASSERT_NE((header[1] + 1) % CHAR_BIT, 0) << "The integers are padded to whole bytes";
+
+    auto [l2, s2] = decode(written_path);
+    std::filesystem::remove(written_path);
+
+    ASSERT_EQ(l1.size(), l2.size()) << "Different number of factors";
+    ASSERT_EQ(s1, s2) << "Different text size";
+    for (size_t i = 0; i < l1.size(); i++) {
+        ASSERT_EQ(l1[i].m_char, l2[i].m_char) << "Character of factor " << i << " is different";
+        ASSERT_EQ(l1[i].m_link, l2[i].m_link) << "Source of factor " << i << " is different";
+        ASSERT_EQ(l1[i].m_len, l2[i].m_len) << "Length of factor " << i << " is different";
+    }
+}
+
+TEST(lzend_test, chunked_parse_test) {
+    using namespace gracli::lz;
+    auto source_path = std::filesystem::absolute(FOX_IN_SOCKS);
+    ASSERT_TRUE(std::filesystem::exists(source_path)) << "Test file " << source_path << " does not exist";
+
+    auto s = gracli::read_to_string(source_path);
+
+    for (size_t chunk_size : {1000, 4096, 1 << 20}) {
+        std::ifstream  in(source_path, std::ios::binary);
+        LzEnd::Parsing parsing;
+        size_t n     = parse_chunked(in, chunk_size, [&](const LzEnd::Phrase &phrase) { parsing.push_back(phrase); });
+        auto   lzend = LzEnd::from_parsing(std::move(parsing), n);
+
+        ASSERT_EQ(s.length(), n) << "Incorrect text length with chunk size " << chunk_size;
+        for (size_t i = 0; i < n; i++) {
+            ASSERT_EQ(s.at(i), lzend.at(i)) << "Incorrect random access at index " << i << " with chunk size "
+                                            << chunk_size;
+        }
+    }
+}
+
+template<typename LzEndDS>
+void check_index_roundtrip(const size_t max_hops) {
+    auto source_path     = std::filesystem::absolute(FOX_IN_SOCKS);
+    auto compressed_path = source_path.string() + ".lzend";
+    ASSERT_TRUE(std::filesystem::exists(source_path)) << "Test file " << source_path << " does not exist";
+    ASSERT_TRUE(std::filesystem::exists(compressed_path)) << "Test file " << compressed_path << " does not exist";
+
+    auto s     = gracli::read_to_string(source_path);
+    auto lzend = LzEndDS::from_file(compressed_path);
+    if (max_hops > 0) {
+        lzend.bound_hops(max_hops);
+    }
+
+    auto index_path = (std::filesystem::temp_directory_path() / "gracli_index_roundtrip.lzidx").string();
+    lzend.save(index_path);
+    ASSERT_TRUE(LzEndDS::is_index_file(index_path)) << "Saved index is not recognized";
+    ASSERT_FALSE(LzEndDS::is_index_file(compressed_path)) << "Parsing is recognized as an index";
+
+    auto loaded = LzEndDS::from_file(index_path);
+    std::filesystem::remove(index_path);
+
+    ASSERT_EQ(s.length(), loaded.source_length()) << "Incorrect source length after loading";
+    for (size_t i = 0; i < s.length(); i++) {
+        ASSERT_EQ(s.at(i), loaded.at(i)) << "Incorrect random access at index " << i << " after loading";
+    }
+}
+
+TEST(lzend_test, index_roundtrip_test) {
+    check_index_roundtrip<gracli::lz::LzEnd>(0);
+    check_index_roundtrip<gracli::lz::LzEnd>(2);
+    check_index_roundtrip<gracli::lz::SampledLzEnd>(0);
+}
+
+TEST(lzend_test, index_wrong_locator_test) {
+    auto compressed_path = std::filesystem::absolute(FOX_IN_SOCKS).string() + ".lzend";
+    ASSERT_TRUE(std::filesystem::exists(compressed_path)) << "Test file " << compressed_path << " does not exist";
+
+    auto index_path = (std::filesystem::temp_directory_path() / "gracli_index_locator.lzidx").string();
+    gracli::lz::LzEnd::from_file(compressed_path).save(index_path);
+    EXPECT_THROW(gracli::lz::SampledLzEnd::load(index_path), std::runtime_error);
+    std::filesystem::remove(index_path);
+}
+
+TEST(lzend_test, cache_test) {
+    auto source_path     = std::filesystem::absolute(FOX_IN_SOCKS);
+    auto compressed_path = source_path.string() + ".lzend";
+    ASSERT_TRUE(std::filesystem::exists(source_path)) << "Test file " << source_path << " does not exist";
+    ASSERT_TRUE(std::filesystem::exists(compressed_path)) << "Test file " << compressed_path << " does not exist";
+
+    auto lzend = gracli::lz::LzEnd::from_file(compressed_path);
+    auto s     = gracli::read_to_string(source_path);
+    auto n     = s.length();
+
+    char buf1[n + 1];
+    char buf2[n + 1];
+
+    // A tiny cache which is constantly evicting and one which holds the entire text
+    for (size_t capacity : {1 << 10, 1 << 20}) {
+        lzend.enable_cache(capacity);
+        for (size_t round = 0; round < 2; round++) {
+            for (size_t i = 0; i < n; i++) {
+                ASSERT_EQ(s.at(i), lzend.at(i)) << "Incorrect random access at index " << i << " with a cache of "
+                                                << capacity << " bytes";
+            }
+            for (size_t l : {1, 7, 64, 100}) {
+                buf1[l] = 0;
+                buf2[l] = 0;
+                for (size_t i = 0; i < n - l + 1; i++) {
+                    std::copy(s.begin() + i, s.begin() + i + l, buf1);
+                    lzend.substr(buf2, i, l);
+                    ASSERT_EQ(strcmp(buf1, buf2), 0) << "Incorrect substring at index " << i << " with length " << l
+                                                     << " with a cache of " << capacity << " bytes";
+                }
+            }
+        }
+        ASSERT_GT(lzend.cache()->hits(), 0) << "No cache hits with a cache of " << capacity << " bytes";
+    }
+}
+
+TEST(lzend_test, lce_test) {
+    auto source_path     = std::filesystem::absolute(FOX_IN_SOCKS);
+    auto compressed_path = source_path.string() + ".lzend";
+    ASSERT_TRUE(std::filesystem::exists(source_path)) << "Test file " << source_path << " does not exist";
+    ASSERT_TRUE(std::filesystem::exists(compressed_path)) << "Test file " << compressed_path << " does not exist";
+
+    auto lzend = gracli::lz::LzEnd::from_file(compressed_path);
+    auto s     = gracli::read_to_string(source_path);
+    auto n     = s.length();
+
+    for (size_t max_hops : {0, 2}) {
+        lzend.bound_hops(max_hops);
+        for (size_t i = 0; i < n; i += 3) {
+            for (size_t j = 0; j < n; j += 11) {
+                const auto   mismatch = std::mismatch(s.begin() + i, s.end(), s.begin() + j, s.end());
+                const size_t expected = mismatch.first - (s.begin() + i);
+                ASSERT_EQ(expected, lzend.lce(i, j))
+                    << "Incorrect LCE of indices " << i << " and " << j << " with at most " << max_hops << " hops";
+            }
+        }
+    }
+    ASSERT_EQ(0, lzend.lce(0, n)) << "Positions outside the text have no common extension";
+}
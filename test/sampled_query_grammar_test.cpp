@@ -1,13 +1,98 @@
 
 #include "query_grammar_tests.hpp"
+#include <algorithm>
 #include <grammar/sampled_scan_query_grammar.hpp>
 
-class SampledScanQGTestFixture : public QueryGrammarTestFixture<gracli::SampledScanQueryGrammar<512>> {};
+class SampledScanQGTestFixture : public QueryGrammarTestFixture<gracli::SampledScanQueryGrammar<512>> {
+  public:
+    void test_fingerprint() {
+        using namespace gracli;
+        QueryGrammarTestInput in = GetParam();
+        in.check_paths();
+
+        std::string source = read_to_string(in.source_path);
+        size_t      n      = source.length();
+        auto        grm    = SampledScanQueryGrammar<512>::from_file(in.compressed_path);
+        auto        text   = reinterpret_cast<const uint8_t *>(source.data());
+
+        ASSERT_EQ(grm.karp_rabin().fingerprint(text, n), grm.fingerprint(0, n)) << "Incorrect fingerprint of the text";
+        for (size_t i = 0; i < n; i++) {
+            for (const size_t len : {1, 2, 7, 64, 513, 2000}) {
+                const size_t expected_len = std::min(len, n - i);
+                ASSERT_EQ(grm.karp_rabin().fingerprint(text + i, expected_len), grm.fingerprint(i, len))
+                    << "Incorrect fingerprint of substring at index " << i << " with length " << len;
+            }
+        }
+
+        for (size_t i = 0; i < n; i += 13) {
+            for (size_t j = 0; j < n; j += 17) {
+                const size_t len = std::min<size_t>(in.len, n - std::max(i, j));
+                ASSERT_EQ(source.compare(i, len, source, j, len) == 0, grm.equal(i, j, len))
+                    << "Incorrect equality of substrings at indices " << i << " and " << j << " with length " << len;
+            }
+        }
+        ASSERT_FALSE(grm.equal(0, n - 1, 2)) << "Substrings outside the text must not be equal";
+    }
+
+    void test_lce() {
+        using namespace gracli;
+        QueryGrammarTestInput in = GetParam();
+        in.check_paths();
+
+        std::string source = read_to_string(in.source_path);
+        size_t      n      = source.length();
+        auto        grm    = SampledScanQueryGrammar<512>::from_file(in.compressed_path);
+
+        for (size_t i = 0; i < n; i += 3) {
+            for (size_t j = 0; j < n; j += 11) {
+                const auto   begin    = source.begin();
+                const auto   mismatch = std::mismatch(begin + i, source.end(), begin + j, source.end());
+                const size_t expected = mismatch.first - (begin + i);
+                ASSERT_EQ(expected, grm.lce(i, j)) << "Incorrect LCE of indices " << i << " and " << j;
+            }
+        }
+        ASSERT_EQ(0, grm.lce(0, n)) << "Positions outside the text have no common extension";
+    }
+
+    void test_rank_select() {
+        using namespace gracli;
+        QueryGrammarTestInput in = GetParam();
+        in.check_paths();
+
+        std::string source = read_to_string(in.source_path);
+        size_t      n      = source.length();
+        auto        grm    = SampledScanQueryGrammar<512>::from_file(in.compressed_path);
+
+        for (const std::vector<uint8_t> &alphabet : {std::vector<uint8_t>{}, std::vector<uint8_t>{'e', 'x', '\n'}}) {
+            grm.enable_rank_select(alphabet);
+            for (const uint8_t c : grm.rank_alphabet()) {
+                size_t count = 0;
+                for (size_t i = 0; i <= n; i++) {
+                    ASSERT_EQ(count, grm.rank(c, i)) << "Incorrect rank of character " << (int) c << " at index " << i;
+                    if (i < n && (uint8_t) source[i] == c) {
+                        count++;
+                        ASSERT_EQ(i, grm.select(c, count))
+                            << "Incorrect select of occurrence " << count << " of character " << (int) c;
+                    }
+                }
+                ASSERT_EQ(n, grm.select(c, count + 1)) << "Select beyond the last occurrence must return the length";
+            }
+        }
+        ASSERT_EQ(3, grm.rank_alphabet().size()) << "Incorrect alphabet for rank and select";
+        ASSERT_THROW((void) grm.rank('a', 0), std::invalid_argument) << "Unsupported characters must be rejected";
+    }
+};
 
 TEST_P(SampledScanQGTestFixture, RandomAccessTest) { test_random_access(); }
 
 TEST_P(SampledScanQGTestFixture, SubstringTest) { test_substr(); }
 
+TEST_P(SampledScanQGTestFixture, FingerprintTest) { test_fingerprint(); }
+
+TEST_P(SampledScanQGTestFixture, LceTest) { test_lce(); }
+
+TEST_P(SampledScanQGTestFixture, RankSelectTest) { test_rank_select(); }
+
 INSTANTIATE_TEST_SUITE_P(SampledScanQGTests,
                          SampledScanQGTestFixture,
                          ::testing::Values(QueryGrammarTestInput("test/test_data/fox.txt", "test/test_data/fox.txt.seq", 25)),